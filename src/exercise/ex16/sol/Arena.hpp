@@ -0,0 +1,114 @@
+#ifndef _ARENA_HPP__
+#define _ARENA_HPP__
+
+#include <vector>
+#include <new>
+#include <cstdlib>
+#include <cstddef>
+#include <utility>
+#include <type_traits>
+
+/**
+  * The arena is a bump allocator: objects are placed one after another in
+  * large blocks of memory, and are all freed at once when the arena is
+  * destroyed. Allocating is just a pointer increment, the objects of a scene
+  * end up next to each other in memory, and tearing down a scene with
+  * millions of objects takes a handful of calls to free().
+  */
+class Arena {
+public:
+	Arena(size_t block_size=64*1024) {
+		this->block_size = block_size;
+		current = NULL;
+		remaining = 0;
+	}
+
+	~Arena() {
+		clear();
+	}
+
+	/**
+	  * Constructs a T in the arena. The arena owns the object, and calls its
+	  * destructor when the arena is cleared or destroyed.
+	  */
+	template <class T, class... Args>
+	T* create(Args&&... args) {
+		void* memory = allocate(sizeof(T), alignof(T));
+		T* object = new (memory) T(std::forward<Args>(args)...);
+		if (!std::is_trivially_destructible<T>::value)
+			destructors.push_back(Destructor(object, &destroy<T>));
+		return object;
+	}
+
+	/**
+	  * Returns size bytes of memory aligned to alignment
+	  */
+	void* allocate(size_t size, size_t alignment) {
+		size_t padding = (alignment - reinterpret_cast<size_t>(current) % alignment) % alignment;
+		if (current == NULL || padding + size > remaining) {
+			reserve(size + alignment);
+			padding = (alignment - reinterpret_cast<size_t>(current) % alignment) % alignment;
+		}
+		void* memory = current + padding;
+		current += padding + size;
+		remaining -= padding + size;
+		return memory;
+	}
+
+	/**
+	  * Makes sure the next size bytes can be allocated without allocating a
+	  * new block, e.g. before creating a large scene
+	  */
+	void reserve(size_t size) {
+		if (current != NULL && size <= remaining)
+			return;
+		//Grow the blocks geometrically, so n objects take O(log n) blocks
+		if (!blocks.empty())
+			block_size *= 2;
+		size_t bytes = (size > block_size) ? size : block_size;
+		char* block = static_cast<char*>(std::malloc(bytes));
+		if (block == NULL)
+			throw std::bad_alloc();
+		blocks.push_back(block);
+		current = block;
+		remaining = bytes;
+	}
+
+	/**
+	  * Destroys all objects in the arena (in reverse order of creation) and
+	  * frees its memory
+	  */
+	void clear() {
+		for (size_t k=destructors.size(); k>0; --k)
+			destructors[k-1].destroy(destructors[k-1].object);
+		destructors.clear();
+		for (size_t k=0; k<blocks.size(); ++k)
+			std::free(blocks[k]);
+		blocks.clear();
+		current = NULL;
+		remaining = 0;
+	}
+
+private:
+	Arena(const Arena&);
+	Arena& operator=(const Arena&);
+
+	struct Destructor {
+		Destructor(void* object, void (*destroy)(void*)) : object(object), destroy(destroy) {}
+		void* object;
+		void (*destroy)(void*);
+	};
+
+	template <class T>
+	static void destroy(void* object) {
+		static_cast<T*>(object)->~T();
+	}
+
+	std::vector<char*> blocks;
+	std::vector<Destructor> destructors; //< Only for objects that need them
+	char* current;      //< Next free byte in the current block
+	size_t remaining;   //< Free bytes left in the current block
+	size_t block_size;
+};
+
+#endif
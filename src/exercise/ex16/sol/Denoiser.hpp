@@ -0,0 +1,146 @@
+#ifndef _DENOISER_HPP__
+#define _DENOISER_HPP__
+
+#include <vector>
+#include <cassert>
+#include <cmath>
+#include <limits>
+#include <algorithm>
+
+#include <glm/glm.hpp>
+
+#include "FrameBuffer.hpp"
+
+/**
+  * The denoiser smooths a noisy rendering with an edge-avoiding a-trous
+  * wavelet filter (Dammertz et al. 2010, with the variance guided weights of
+  * Schied et al. 2017). Every pass blurs with a 5x5 B3-spline kernel whose
+  * taps are spread 2^pass pixels apart. A tap is weighted down when its
+  * normal or depth differs from the center pixel, or when its luminance
+  * differs more than the noise of the center pixel can explain, so that
+  * silhouettes, textures and reflections stay sharp.
+  */
+class Denoiser {
+public:
+	/**
+	  * @param passes Number of wavelet passes, the filter reaches 2^(passes+1) pixels
+	  * @param sigma_luminance How many standard deviations of luminance we blur across
+	  * @param sigma_normal Exponent that makes the filter stop at creases
+	  * @param sigma_depth How large relative depth differences we blur across
+	  */
+	Denoiser(unsigned int passes=5, float sigma_luminance=4.0f, float sigma_normal=64.0f, float sigma_depth=0.1f) {
+		this->passes = passes;
+		this->sigma_luminance = sigma_luminance;
+		this->sigma_normal = sigma_normal;
+		this->sigma_depth = sigma_depth;
+	}
+
+	/**
+	  * Filters the colors of fb in place, guided by its normals, depths and variances
+	  */
+	void apply(FrameBuffer& fb) {
+		const float kernel[3] = { 3.0f/8.0f, 1.0f/4.0f, 1.0f/16.0f };
+		const glm::vec3 luminance(0.2126f, 0.7152f, 0.0722f);
+		const int width = fb.getWidth();
+		const int height = fb.getHeight();
+		const std::vector<float>& normals = fb.getNormals();
+		const std::vector<float>& depths = fb.getDepths();
+
+		std::vector<float> in = fb.getData();
+		std::vector<float> out(in.size());
+		std::vector<float> variance_in = fb.getVariances();
+		std::vector<float> variance_out(variance_in.size());
+
+		for (unsigned int pass=0; pass<passes; ++pass) {
+			const int step = 1 << pass;
+
+			#pragma omp parallel for
+			for (int j=0; j<height; ++j) {
+				for (int i=0; i<width; ++i) {
+					const int p = i+j*width;
+					const glm::vec3 c_p(in[3*p], in[3*p+1], in[3*p+2]);
+					const glm::vec3 n_p(normals[3*p], normals[3*p+1], normals[3*p+2]);
+					const float l_p = glm::dot(c_p, luminance);
+					const float z_p = depths[p];
+					const float inv_l = 1.0f / (sigma_luminance*std::sqrt(variance_in[p]) + 1e-4f);
+					const float inv_z = 1.0f / (sigma_depth*step*std::max(z_p, 1.0f));
+
+					glm::vec3 sum(0.0f);
+					float weight_sum = 0.0f;
+					float variance_sum = 0.0f;
+
+					for (int dy=-2; dy<=2; ++dy) {
+						const int y = j+dy*step;
+						if (y < 0 || y >= height) continue;
+						for (int dx=-2; dx<=2; ++dx) {
+							const int x = i+dx*step;
+							if (x < 0 || x >= width) continue;
+
+							const int q = x+y*width;
+							const glm::vec3 c_q(in[3*q], in[3*q+1], in[3*q+2]);
+							const glm::vec3 n_q(normals[3*q], normals[3*q+1], normals[3*q+2]);
+
+							float w_l = std::exp(-std::abs(l_p-glm::dot(c_q, luminance))*inv_l);
+							float w_n = std::pow(std::max(glm::dot(n_p, n_q), 0.0f), sigma_normal);
+							float w_z = depthWeight(z_p, depths[q], inv_z);
+
+							float w = kernel[std::abs(dx)]*kernel[std::abs(dy)]*w_l*w_n*w_z;
+							sum += w*c_q;
+							weight_sum += w;
+							variance_sum += w*w*variance_in[q];
+						}
+					}
+
+					//The center tap always has weight > 0
+					sum /= weight_sum;
+					out[3*p] = sum.r;
+					out[3*p+1] = sum.g;
+					out[3*p+2] = sum.b;
+					variance_out[p] = variance_sum / (weight_sum*weight_sum);
+				}
+			}
+
+			//The next pass sees the filtered image, and its reduced noise
+			in.swap(out);
+			variance_in.swap(variance_out);
+		}
+
+		fb.setData(in);
+	}
+
+	/**
+	  * Computes the peak signal-to-noise ratio (in dB) of image a compared to
+	  * the reference image b. Used to report the quality of the denoiser.
+	  */
+	static float psnr(const std::vector<float>& a, const std::vector<float>& b) {
+		assert(a.size() == b.size());
+		double mse = 0.0;
+		for (size_t k=0; k<a.size(); ++k) {
+			double d = glm::clamp(a[k], 0.0f, 1.0f) - glm::clamp(b[k], 0.0f, 1.0f);
+			mse += d*d;
+		}
+		mse /= static_cast<double>(a.size());
+		if (mse == 0.0)
+			return std::numeric_limits<float>::infinity();
+		return static_cast<float>(-10.0*std::log10(mse));
+	}
+
+private:
+	/**
+	  * Weight for a tap at depth z_q seen from a pixel at depth z_p. The
+	  * background sits at infinity, and only matches other background pixels.
+	  */
+	static inline float depthWeight(float z_p, float z_q, float inv_z) {
+		const float far = std::numeric_limits<float>::max();
+		if (z_p == far || z_q == far)
+			return (z_p == z_q) ? 1.0f : 0.0f;
+		return std::exp(-std::abs(z_p-z_q)*inv_z);
+	}
+
+	unsigned int passes;
+	float sigma_luminance;
+	float sigma_normal;
+	float sigma_depth;
+};
+
+#endif
@@ -8,7 +8,9 @@
 
 /**
   * Our framebuffer class is essentially just a wrapper for a pointer to
-  * memory where we store our output pixels
+  * memory where we store our output pixels. Next to the colors it keeps
+  * the normal and depth of the first hit and the variance of the samples
+  * for every pixel, which the denoiser uses to find edges and noise.
   */
 class FrameBuffer {
 public:
@@ -16,26 +18,68 @@ public:
 		this->width = width;
 		this->height = height;
 		data.resize(width*height*3);
+		normals.resize(width*height*3);
+		depths.resize(width*height);
+		variances.resize(width*height);
 	}
 
 	inline unsigned int getWidth() { return width; }
 	inline unsigned int getHeight() {return height; }
 	inline const std::vector<float>& getData() { return data; }
+	inline const std::vector<float>& getNormals() { return normals; }
+	inline const std::vector<float>& getDepths() { return depths; }
+	inline const std::vector<float>& getVariances() { return variances; }
 
 	/**
 	  * Sets the pixel at (i, j) to the color (r, g, b).
 	  */
 	inline void setPixel(unsigned int i, unsigned int j, glm::vec3 color) {
-		assert(i >= 0 && i < width);
-		assert(j >= 0 && j < height);
+		assert(i < width);
+		assert(j < height);
 		unsigned int index = 3*(i+j*width);
 		data.at(index) = color.r;
 		data.at(index+1) = color.g;
 		data.at(index+2) = color.b;
 	}
 
+	/**
+	  * Returns the color of the pixel at (i, j)
+	  */
+	inline glm::vec3 getPixel(unsigned int i, unsigned int j) const {
+		assert(i < width);
+		assert(j < height);
+		unsigned int index = 3*(i+j*width);
+		return glm::vec3(data[index], data[index+1], data[index+2]);
+	}
+
+	/**
+	  * Stores the normal n and the distance d to the first hit seen
+	  * through pixel (i, j), and the variance of the pixel's luminance
+	  */
+	inline void setFeatures(unsigned int i, unsigned int j, glm::vec3 n, float d, float variance) {
+		assert(i < width);
+		assert(j < height);
+		unsigned int index = i+j*width;
+		normals.at(3*index) = n.x;
+		normals.at(3*index+1) = n.y;
+		normals.at(3*index+2) = n.z;
+		depths.at(index) = d;
+		variances.at(index) = variance;
+	}
+
+	/**
+	  * Replaces all colors, e.g. with a filtered version of the image
+	  */
+	inline void setData(const std::vector<float>& data) {
+		assert(data.size() == this->data.size());
+		this->data = data;
+	}
+
 private:
 	std::vector<float> data;
+	std::vector<float> normals; //< first-hit normal per pixel
+	std::vector<float> depths;  //< first-hit distance per pixel
+	std::vector<float> variances; //< variance of the luminance estimate per pixel
 	unsigned int width, height;
 };
 
@@ -14,6 +14,12 @@ RayTracer::RayTracer(unsigned int width, unsigned int height, int num_rays, floa
 
 	//Initialize framebuffer and virtual screen
 	fb = new FrameBuffer(width, height);
+	this->width = width;
+	this->height = height;
+	region.x = 0;
+	region.y = 0;
+	region.width = width;
+	region.height = height;
 	float aspect = width/static_cast<float>(height);
 	screen.top = 1.0f;
 	screen.bottom = -1.0f;
@@ -35,19 +41,41 @@ RayTracer::~RayTracer(){
 
 void RayTracer::addSceneObject(SceneObject* o) {
 	state->getScene().push_back(o);
+	state->getHeapObjects().push_back(o);
 }
 
-void RayTracer::render() {
-	float offsets[4][2] = {
-			{0.25, 0.25},
-			{-0.25, -0.25},
-			{-0.25, 0.25},
-			{0.25, -0.25}};
+void RayTracer::reserveScene(size_t num_objects, size_t bytes) {
+	state->getScene().reserve(state->getScene().size() + num_objects);
+	state->getArena().reserve(bytes);
+}
+
+void RayTracer::setRegion(unsigned int x, unsigned int y, unsigned int width, unsigned int height) {
+	if (width == 0 || height == 0 || x > this->width || width > this->width - x
+			|| y > this->height || height > this->height - y) {
+		std::stringstream log;
+		log << "Region " << width << "x" << height << "+" << x << "+" << y
+			<< " is outside the " << this->width << "x" << this->height << " frame";
+		throw std::runtime_error(log.str());
+	}
+
+	region.x = x;
+	region.y = y;
+	region.width = width;
+	region.height = height;
+
+	delete fb;
+	fb = new FrameBuffer(width, height);
+}
 
+void RayTracer::render() {
 	//For every pixel
 	#pragma omp parallel for
 	for (int j=0; j< (int)(fb->getHeight()); ++j) {
 		for (unsigned int i=0; i<fb->getWidth(); ++i) {
+			// Position of the pixel in the whole frame
+			unsigned int px = region.x + i;
+			unsigned int py = region.y + j;
+
 			glm::vec3 out_color(0.0, 0.0, 0.0);
 			float x, y, z;
 			
@@ -56,25 +84,30 @@ void RayTracer::render() {
 
 			unsigned int rays = this->num_rays;
 			unsigned int rays_fired = 0;
+			float luminance_sum = 0.0f;
+			float luminance_sq_sum = 0.0f;
 
 			while(rays_fired < rays){
-				float du = (r / RAND_MAX) * (1.0f * rand());
-				float dv = (r / RAND_MAX) * (1.0f * rand());
-
 				glm::vec3 c;
 
 				// Shoot 4 rays pr pixel
 				for(int k = 0; k < 4; k++){
+					// Place the ray inside the pixel and on the lens, using the
+					// next point of the sample sequence for this pixel
+					unsigned int index = 4*rays_fired + k;
+					glm::vec2 offset = sampler.get2D(px, py, index, Sampler::PIXEL) - glm::vec2(0.5f);
+					glm::vec2 lens = r * Sampler::toDisk(sampler.get2D(px, py, index, Sampler::LENS));
+
 					// Create the ray using the view screen definition 
-					x = ((float)i + offsets[k][0])*(screen.right-screen.left)/static_cast<float>(fb->getWidth()) + screen.left;
-					y = ((float)j + offsets[k][1])*(screen.top-screen.bottom)/static_cast<float>(fb->getHeight()) + screen.bottom;
+					x = ((float)px + offset.x)*(screen.right-screen.left)/static_cast<float>(width) + screen.left;
+					y = ((float)py + offset.y)*(screen.top-screen.bottom)/static_cast<float>(height) + screen.bottom;
 					z = -1.0f;
 
 					glm::vec3 direction = glm::vec3(-x, -y, -z);
 					glm::vec3 start = state->getCamPos() + direction;
 					glm::vec3 aimed = start + focus * glm::vec3(x, y, z);
 
-					glm::vec3 start0 = start + glm::vec3(du, dv, 0.0f);
+					glm::vec3 start0 = start + glm::vec3(lens.x, lens.y, 0.0f);
 
 					Ray r = Ray(start0, aimed - start0);
 					c += state->rayTrace(r);
@@ -83,14 +116,46 @@ void RayTracer::render() {
 				c *= 0.25f;
 				out_color += c;
 				rays_fired++;
+
+				float luminance = glm::dot(c, glm::vec3(0.2126f, 0.7152f, 0.0722f));
+				luminance_sum += luminance;
+				luminance_sq_sum += luminance*luminance;
 			}
 			
 			out_color /= (float)rays_fired;
 			fb->setPixel(i, j, out_color);
+
+			// Variance of the mean luminance over the aperture samples, tells
+			// the denoiser how noisy the pixel is
+			float mean = luminance_sum / rays_fired;
+			float variance = glm::max(luminance_sq_sum / rays_fired - mean*mean, 0.0f) / rays_fired;
+
+			// Record what the pixel center sees, to guide the denoiser
+			x = ((float)px)*(screen.right-screen.left)/static_cast<float>(width) + screen.left;
+			y = ((float)py)*(screen.top-screen.bottom)/static_cast<float>(height) + screen.bottom;
+			z = -1.0f;
+
+			glm::vec3 direction = glm::vec3(-x, -y, -z);
+			Ray center(state->getCamPos() + direction, glm::vec3(x, y, z));
+			glm::vec3 normal = -glm::normalize(center.getDirection());
+			float depth = std::numeric_limits<float>::max();
+
+			float t;
+			int k = state->rayCast(center, t);
+			if (k >= 0) {
+				normal = state->getScene().at(k)->computeNormal(center, t);
+				if (t < std::numeric_limits<float>::max())
+					depth = t*glm::length(center.getDirection());
+			}
+			fb->setFeatures(i, j, normal, depth, variance);
 		}
 	}
 }
 
+void RayTracer::denoise(Denoiser& denoiser) {
+	denoiser.apply(*fb);
+}
+
 void RayTracer::save(std::string basename) {
 	
 	struct stat buffer;
@@ -113,9 +178,20 @@ void RayTracer::save(std::string basename) {
 	std::vector<unsigned char> copy;
 	copy.resize(fb->getWidth()* fb->getHeight()* 3);
 	for(size_t i = 0; i < copy.size(); i++){
-		copy[i] = (unsigned char)(fb->getData()[i] * 255.0f);
+		copy[i] = colorToByte(fb->getData()[i]);
 	}
 	tgaInfo* img = tgaCreate(fb->getWidth(), fb->getHeight(), 3, copy.data());
 	tgaSave(filename.str().c_str(), img);
 	tgaDestroy(img);
 }
+
+void RayTracer::saveTile(std::string filename) {
+	TileHeader header;
+	header.frame_width = width;
+	header.frame_height = height;
+	header.x = region.x;
+	header.y = region.y;
+	header.width = region.width;
+	header.height = region.height;
+	writeTile(filename, header, fb->getData());
+}
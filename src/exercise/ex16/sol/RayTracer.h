@@ -6,6 +6,9 @@
 #include <vector>
 
 #include "FrameBuffer.hpp"
+#include "Denoiser.hpp"
+#include "Sampler.hpp"
+#include "Tile.hpp"
 #include "SceneObject.hpp"
 #include "RayTracerState.hpp"
 
@@ -19,27 +22,97 @@ public:
 	~RayTracer();
 	
 	/**
-	  * Adds an object to the scene
+	  * Adds an object allocated with new to the scene, which takes ownership of it
 	  */
 	void addSceneObject(SceneObject* o);
 
+	/**
+	  * Creates an object of type T in the scene's arena and adds it to the scene
+	  */
+	template <class T, class... Args>
+	T* createSceneObject(Args&&... args) {
+		T* o = state->getArena().create<T>(std::forward<Args>(args)...);
+		state->getScene().push_back(o);
+		return o;
+	}
+
+	/**
+	  * Creates an effect of type T in the scene's arena. It lives as long as
+	  * the scene objects using it.
+	  */
+	template <class T, class... Args>
+	T* createSceneObjectEffect(Args&&... args) {
+		return state->getArena().create<T>(std::forward<Args>(args)...);
+	}
+
+	/**
+	  * Prepares the scene for num_objects more objects, that together with
+	  * their effects take up bytes bytes
+	  */
+	void reserveScene(size_t num_objects, size_t bytes);
+
 	/**
 	  * Renders the current scene
 	  */
 	void render();
 
+	/**
+	  * Filters noise from the rendered frame, using the normals and
+	  * depths recorded by render() to preserve edges
+	  */
+	void denoise(Denoiser& denoiser);
+
 	/**
 	  * Saves the currently rendered frame as an image file
 	  */
 	void save(std::string basename);
 
+	/**
+	  * Restricts rendering to a region of the frame (a crop window), with
+	  * (x, y) the lower left pixel. The frame buffer then only holds the
+	  * region, and every pixel comes out exactly as in a full render.
+	  */
+	void setRegion(unsigned int x, unsigned int y, unsigned int width, unsigned int height);
+
+	/**
+	  * Saves the currently rendered region as a tile file, which records
+	  * where in the frame it belongs (see Tile.hpp)
+	  */
+	void saveTile(std::string filename);
+
+	/**
+	  * Sets the number of aperture samples used per pixel
+	  */
+	inline void setNumRays(int num_rays) { this->num_rays = num_rays; }
+
+	/**
+	  * Sets the sample sequence used for pixel and lens positions
+	  */
+	inline void setSampler(const Sampler& sampler) { this->sampler = sampler; }
+
+	inline FrameBuffer& getFrameBuffer() { return *fb; }
+
 private:
 	FrameBuffer* fb;
 	RayTracerState* state;
 
+	unsigned int width;  //< Size of the whole frame
+	unsigned int height;
+
+	/**
+	  * The part of the frame that we render into fb
+	  */
+	struct {
+		unsigned int x;
+		unsigned int y;
+		unsigned int width;
+		unsigned int height;
+	} region;
+
 	float focus_length;
 	float aperture_radius;
 	int num_rays;
+	Sampler sampler;
 	/**
 	  * Defines the virtual screen we project our rays through
 	  */
@@ -5,11 +5,14 @@
 
 #include <glm/glm.hpp>
 #include "SceneObject.hpp"
+#include "Arena.hpp"
 
 /**
   * The RayTracerState class keeps track of the state of the ray-tracing:
   * the objects in the scene, camera position, etc, and its main responsibility
-  * is to RayTrace the whole scene for each ray.
+  * is to RayTrace the whole scene for each ray. The scene objects and their
+  * effects live in an arena owned by the state, so they are laid out next to
+  * each other in memory and freed in one go.
   */
 class RayTracerState {
 public:
@@ -18,13 +21,16 @@ public:
 	}
 	
 	~RayTracerState(){
-		for (unsigned int k=0; k<scene.size(); ++k) {
-			delete scene[k];
+		for (unsigned int k=0; k<heap_objects.size(); ++k) {
+			delete heap_objects[k];
 		}
+		heap_objects.clear();
 		scene.clear();
 	}
 	
 	inline std::vector<SceneObject*>& getScene() { return scene; }
+	inline std::vector<SceneObject*>& getHeapObjects() { return heap_objects; }
+	inline Arena& getArena() { return arena; }
 	inline glm::vec3 getCamPos() { return camera_position; }
 
 	/**
@@ -33,15 +39,12 @@ public:
 	  * @param t The parameter so that t*ray gives the first intersection point
 	  * @return -1 if no intersection found, otherwise the object index in the scene
 	  */
-	inline glm::vec3 rayTrace(Ray& ray) {
+	inline int rayCast(const Ray& ray, float& t_min) {
 		const float z_offset = 10e-4f;
 
 		float t = -1;
-		float t_min = std::numeric_limits<float>::max();
 		int k_min=-1;
-
-		if (!ray.isValid()) 
-			return glm::vec3(0.0f);
+		t_min = std::numeric_limits<float>::max();
 
 		//Loop through all the objects, to find the closest intersection, if any
 		//This is essentially just ray-casting
@@ -54,6 +57,21 @@ public:
 			}
 		}
 
+		return k_min;
+	}
+
+	/**
+	  * Performs recursive ray-tracing on the scene for the ray ray
+	  * @return the color seen along the ray
+	  */
+	inline glm::vec3 rayTrace(Ray& ray) {
+		float t_min;
+
+		if (!ray.isValid()) 
+			return glm::vec3(0.0f);
+
+		int k_min = rayCast(ray, t_min);
+
 		if (k_min >= 0) {
 			return scene.at(k_min)->rayTrace(ray, t_min, *this);
 		}
@@ -65,6 +83,8 @@ public:
 
 private:
 	std::vector<SceneObject*> scene;
+	std::vector<SceneObject*> heap_objects; //< Objects in scene allocated with new
+	Arena arena; //< Holds the objects and effects of the scene, freed all at once
 	glm::vec3 camera_position;
 };
 
@@ -0,0 +1,187 @@
+#ifndef _SAMPLER_HPP__
+#define _SAMPLER_HPP__
+
+#include <stdint.h>
+
+#include <glm/glm.hpp>
+
+/**
+  * The sampler hands out the 2D sample points we use to place rays inside a
+  * pixel, on the lens, and (later) when sampling BSDFs. Low-discrepancy
+  * sequences cover the domain much more evenly than independent random
+  * numbers, so the image converges faster for the same number of rays.
+  *
+  * Every pixel gets its own Owen scrambling of the sequence, seeded by a hash
+  * of the pixel coordinates. This keeps the good stratification within each
+  * pixel while decorrelating neighbouring pixels (no visible patterns), and it
+  * makes every sample a pure function of (pixel, index, dimension): the image
+  * does not depend on thread scheduling or on which part of the frame is
+  * rendered.
+  */
+class Sampler {
+public:
+	enum Sequence {
+		RANDOM, //< Independent (hashed) random numbers
+		HALTON, //< Owen scrambled Halton sequence
+		SOBOL   //< Owen scrambled and shuffled Sobol (0,2)-sequence
+	};
+
+	enum Dimension {
+		PIXEL = 0, //< Position inside the pixel
+		LENS = 1,  //< Position on the lens aperture
+		BSDF = 2   //< Direction when sampling a material
+	};
+
+	Sampler(Sequence sequence=SOBOL, uint32_t seed=0) {
+		this->sequence = sequence;
+		this->seed = seed;
+	}
+
+	inline Sequence getSequence() const { return sequence; }
+
+	/**
+	  * Returns sample number index in [0, 1)^2 for pixel (i, j) and the
+	  * given dimension
+	  */
+	glm::vec2 get2D(unsigned int i, unsigned int j, uint32_t index, Dimension dimension) const {
+		uint32_t pixel_seed = hash(hash(hash(seed ^ i) ^ j) ^ static_cast<uint32_t>(dimension));
+
+		switch (sequence) {
+		case SOBOL: {
+			//Shuffle the order of the points, so that the dimensions are
+			//decorrelated, then scramble each coordinate (Burley 2020)
+			uint32_t shuffled = nestedUniformScramble(index, pixel_seed);
+			uint32_t x = nestedUniformScramble(sobol(shuffled, 0), hash(pixel_seed ^ 0x9e3779b9u));
+			uint32_t y = nestedUniformScramble(sobol(shuffled, 1), hash(pixel_seed ^ 0x7f4a7c15u));
+			return glm::vec2(toFloat(x), toFloat(y));
+		}
+		case HALTON: {
+			static const uint32_t primes[3][2] = { {2, 3}, {5, 7}, {11, 13} };
+			return glm::vec2(
+				owenScrambledRadicalInverse(index, primes[dimension][0], pixel_seed),
+				owenScrambledRadicalInverse(index, primes[dimension][1], hash(pixel_seed)));
+		}
+		case RANDOM:
+		default: {
+			uint32_t h = hash(pixel_seed ^ hash(index));
+			return glm::vec2(toFloat(h), toFloat(hash(h)));
+		}
+		}
+	}
+
+	/**
+	  * Maps a point in the unit square to the unit disk, keeping the
+	  * stratification of the points (Shirley and Chiu 1997)
+	  */
+	static glm::vec2 toDisk(glm::vec2 u) {
+		const float pi = 3.14159265358979f;
+		float a = 2.0f*u.x - 1.0f;
+		float b = 2.0f*u.y - 1.0f;
+
+		if (a == 0.0f && b == 0.0f)
+			return glm::vec2(0.0f);
+
+		float r, phi;
+		if (glm::abs(a) > glm::abs(b)) {
+			r = a;
+			phi = (pi/4.0f)*(b/a);
+		}
+		else {
+			r = b;
+			phi = (pi/2.0f) - (pi/4.0f)*(a/b);
+		}
+		return r*glm::vec2(glm::cos(phi), glm::sin(phi));
+	}
+
+	/**
+	  * Integer hash with good avalanche behaviour (lowbias32 by C. Wellons)
+	  */
+	static inline uint32_t hash(uint32_t x) {
+		x ^= x >> 16;
+		x *= 0x7feb352du;
+		x ^= x >> 15;
+		x *= 0x846ca68bu;
+		x ^= x >> 16;
+		return x;
+	}
+
+private:
+	/**
+	  * Returns the first (van der Corput) or second dimension of the Sobol
+	  * sequence as a 32 bit fixed point number
+	  */
+	static inline uint32_t sobol(uint32_t index, int dimension) {
+		if (dimension == 0)
+			return reverseBits(index);
+
+		uint32_t v = 1u << 31;
+		uint32_t result = 0;
+		for (; index != 0; index >>= 1, v ^= v >> 1) {
+			if (index & 1)
+				result ^= v;
+		}
+		return result;
+	}
+
+	static inline uint32_t reverseBits(uint32_t x) {
+		x = ((x >> 1) & 0x55555555u) | ((x & 0x55555555u) << 1);
+		x = ((x >> 2) & 0x33333333u) | ((x & 0x33333333u) << 2);
+		x = ((x >> 4) & 0x0f0f0f0fu) | ((x & 0x0f0f0f0fu) << 4);
+		x = ((x >> 8) & 0x00ff00ffu) | ((x & 0x00ff00ffu) << 8);
+		return (x >> 16) | (x << 16);
+	}
+
+	/**
+	  * Owen scrambling of a 32 bit fixed point number: every bit is flipped
+	  * depending on a hash of the bits above it (Laine and Karras 2011,
+	  * with the constants of Vegdahl)
+	  */
+	static inline uint32_t nestedUniformScramble(uint32_t x, uint32_t seed) {
+		x = reverseBits(x);
+		x ^= x * 0x3d20adeau;
+		x += seed;
+		x *= (seed >> 16) | 1;
+		x ^= x * 0x05526c56u;
+		x ^= x * 0x53a22864u;
+		return reverseBits(x);
+	}
+
+	/**
+	  * Owen scrambled radical inverse of index in the given base: every digit
+	  * is shifted by a hash of the digits in front of it
+	  */
+	static inline float owenScrambledRadicalInverse(uint32_t index, uint32_t base, uint32_t seed) {
+		//Base 2 is the van der Corput sequence, which we can scramble bitwise
+		if (base == 2)
+			return toFloat(nestedUniformScramble(reverseBits(index), seed));
+
+		const float inv_base = 1.0f / base;
+		float inv_base_m = 1.0f;
+		float result = 0.0f;
+		uint32_t prefix = 0;
+
+		//Keep going after index runs out of digits, so the trailing zeros are
+		//scrambled as well
+		while (inv_base_m > 1e-7f) {
+			uint32_t next = index / base;
+			uint32_t digit = index - next*base;
+			digit = (digit + hash(seed ^ (prefix*0x9e3779b9u))) % base;
+
+			prefix = prefix*base + digit + 1;
+			inv_base_m *= inv_base;
+			result += digit*inv_base_m;
+			index = next;
+		}
+		return glm::min(result, 0.99999994f);
+	}
+
+	static inline float toFloat(uint32_t x) {
+		//Use the upper 24 bits, which are exactly representable
+		return (x >> 8) * (1.0f / 16777216.0f);
+	}
+
+	Sequence sequence;
+	uint32_t seed;
+};
+
+#endif
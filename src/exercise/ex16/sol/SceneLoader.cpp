@@ -0,0 +1,331 @@
+#include "SceneLoader.h"
+
+#include <fstream>
+#include <sstream>
+#include <map>
+#include <algorithm>
+#include <cstring>
+#include <cstdio>
+#include <stdexcept>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "Sphere.hpp"
+#include "CubeMap.hpp"
+#include "SceneObjectEffect.hpp"
+
+/**
+  * The cache file starts with this header, followed by the effect, sphere and
+  * cube map records, and finally a table of NUL-terminated strings
+  */
+struct SceneLoader::Header {
+	char magic[4];          //< "RTSC"
+	uint32_t version;       //< Cache format version
+	uint64_t source_hash;   //< Hash of the scene file the cache was compiled from
+	Camera camera;
+	uint32_t num_effects;
+	uint32_t num_spheres;
+	uint32_t num_cubemaps;
+	uint32_t strings_size;  //< Size of the string table in bytes
+};
+
+struct SceneLoader::EffectRecord {
+	enum { COLOR, REFLECTIVE, FRESNEL };
+	uint32_t type;
+	float params[3];        //< color for COLOR, eta0 and eta1 for FRESNEL
+};
+
+struct SceneLoader::SphereRecord {
+	float center[3];
+	float radius;
+	uint32_t effect;        //< Index of the effect record
+};
+
+struct SceneLoader::CubeMapRecord {
+	uint32_t faces[6];      //< Offsets of the image file names in the string table
+};
+
+static const uint32_t cache_version = 2;
+
+SceneLoader::SceneLoader(std::string filename, std::string cache_filename) {
+	data = NULL;
+	size = 0;
+	mapping = NULL;
+	compiled = false;
+
+	std::ifstream in(filename.c_str(), std::ios::in | std::ios::binary);
+	if (!in.good())
+		throw std::runtime_error("Error reading from " + filename);
+	std::stringstream source;
+	source << in.rdbuf();
+
+	if (cache_filename.empty())
+		cache_filename = filename + ".cache";
+
+	//Relative image file names are relative to the scene file
+	size_t slash = filename.find_last_of('/');
+	if (slash != std::string::npos)
+		directory = filename.substr(0, slash+1);
+
+	uint64_t source_hash = hash(source.str());
+	if (mapCache(cache_filename, source_hash))
+		return;
+
+	compile(filename, source.str(), source_hash, buffer);
+	compiled = true;
+	data = &buffer[0];
+	size = buffer.size();
+
+	//Write to a temporary file first, so that other processes loading the
+	//same scene never see a half written cache
+	std::stringstream temp_filename;
+	temp_filename << cache_filename << "." << getpid();
+	std::ofstream out(temp_filename.str().c_str(), std::ios::out | std::ios::binary);
+	out.write(data, size);
+	out.close();
+	if (!out.good() || rename(temp_filename.str().c_str(), cache_filename.c_str()) != 0)
+		remove(temp_filename.str().c_str()); //Not fatal, we just compile again next time
+}
+
+SceneLoader::~SceneLoader() {
+	unmapCache();
+}
+
+const SceneLoader::Camera& SceneLoader::getCamera() const {
+	return reinterpret_cast<const Header*>(data)->camera;
+}
+
+void SceneLoader::build(RayTracer& rt) const {
+	const Header* header = reinterpret_cast<const Header*>(data);
+	const EffectRecord* effects = reinterpret_cast<const EffectRecord*>(header + 1);
+	const SphereRecord* spheres = reinterpret_cast<const SphereRecord*>(effects + header->num_effects);
+	const CubeMapRecord* cubemaps = reinterpret_cast<const CubeMapRecord*>(spheres + header->num_spheres);
+	const char* strings = reinterpret_cast<const char*>(cubemaps + header->num_cubemaps);
+
+	//Everything goes into one block of the scene's arena
+	size_t effects_size = std::max(sizeof(ColorEffect), std::max(sizeof(ReflectiveEffect), sizeof(FresnelEffect)));
+	rt.reserveScene(header->num_spheres + header->num_cubemaps,
+			header->num_effects*(effects_size + alignof(SceneObjectEffect))
+			+ header->num_spheres*(sizeof(Sphere) + alignof(Sphere))
+			+ header->num_cubemaps*(sizeof(CubeMap) + alignof(CubeMap)));
+
+	std::vector<SceneObjectEffect*> scene_effects(header->num_effects);
+	for (uint32_t k=0; k<header->num_effects; ++k) {
+		const EffectRecord& e = effects[k];
+		switch (e.type) {
+		case EffectRecord::COLOR:
+			scene_effects[k] = rt.createSceneObjectEffect<ColorEffect>(glm::vec3(e.params[0], e.params[1], e.params[2]));
+			break;
+		case EffectRecord::REFLECTIVE:
+			scene_effects[k] = rt.createSceneObjectEffect<ReflectiveEffect>();
+			break;
+		default:
+			scene_effects[k] = rt.createSceneObjectEffect<FresnelEffect>(e.params[0], e.params[1]);
+			break;
+		}
+	}
+
+	for (uint32_t k=0; k<header->num_spheres; ++k) {
+		const SphereRecord& s = spheres[k];
+		glm::vec3 center(s.center[0], s.center[1], s.center[2]);
+		rt.createSceneObject<Sphere>(center, s.radius, scene_effects[s.effect]);
+	}
+
+	for (uint32_t k=0; k<header->num_cubemaps; ++k) {
+		std::string faces[6];
+		for (int f=0; f<6; ++f) {
+			faces[f] = strings + cubemaps[k].faces[f];
+			if (faces[f][0] != '/')
+				faces[f] = directory + faces[f];
+		}
+		rt.createSceneObject<CubeMap>(faces[0], faces[1], faces[2],
+				faces[3], faces[4], faces[5]);
+	}
+}
+
+void SceneLoader::compile(const std::string& filename, const std::string& source,
+		uint64_t source_hash, std::vector<char>& out) {
+	Header header;
+	std::memset(&header, 0, sizeof(Header));
+	std::memcpy(header.magic, "RTSC", 4);
+	header.version = cache_version;
+	header.source_hash = source_hash;
+	header.camera.width = 800;
+	header.camera.height = 600;
+	header.camera.num_rays = 100;
+	header.camera.focus_length = 7.0f;
+	header.camera.aperture_radius = 0.003f;
+
+	std::vector<EffectRecord> effects;
+	std::vector<SphereRecord> spheres;
+	std::vector<CubeMapRecord> cubemaps;
+	std::string strings;
+	std::map<std::string, uint32_t> effect_names;
+
+	std::istringstream lines(source);
+	std::string line;
+	for (int line_number=1; std::getline(lines, line); ++line_number) {
+		line = line.substr(0, line.find('#'));
+		std::istringstream in(line);
+		std::string keyword;
+		if (!(in >> keyword))
+			continue;
+
+		bool ok = true;
+		if (keyword == "camera") {
+			Camera& c = header.camera;
+			//Read the size as signed, so that negative values are not wrapped,
+			//and keep 3*width*height within the unsigned indices of the FrameBuffer
+			long width, height;
+			ok = static_cast<bool>(in >> width >> height >> c.num_rays >> c.focus_length >> c.aperture_radius);
+			ok = ok && width > 0 && height > 0 && width <= 16384 && height <= 16384;
+			c.width = ok ? width : 0;
+			c.height = ok ? height : 0;
+		}
+		else if (keyword == "effect") {
+			std::string name, type;
+			EffectRecord e;
+			std::memset(&e, 0, sizeof(EffectRecord));
+			ok = static_cast<bool>(in >> name >> type);
+			if (ok && type == "color") {
+				e.type = EffectRecord::COLOR;
+				ok = static_cast<bool>(in >> e.params[0] >> e.params[1] >> e.params[2]);
+			}
+			else if (ok && type == "reflective") {
+				e.type = EffectRecord::REFLECTIVE;
+			}
+			else if (ok && type == "fresnel") {
+				e.type = EffectRecord::FRESNEL;
+				ok = static_cast<bool>(in >> e.params[0] >> e.params[1]);
+			}
+			else {
+				ok = false;
+			}
+			if (ok) {
+				effect_names[name] = effects.size();
+				effects.push_back(e);
+			}
+		}
+		else if (keyword == "sphere") {
+			SphereRecord s;
+			std::string effect;
+			ok = static_cast<bool>(in >> s.center[0] >> s.center[1] >> s.center[2] >> s.radius >> effect);
+			if (ok && effect_names.count(effect) == 0) {
+				std::stringstream log;
+				log << filename << ":" << line_number << ": unknown effect " << effect;
+				throw std::runtime_error(log.str());
+			}
+			if (ok) {
+				s.effect = effect_names[effect];
+				spheres.push_back(s);
+			}
+		}
+		else if (keyword == "cubemap") {
+			CubeMapRecord c;
+			for (int f=0; f<6 && ok; ++f) {
+				std::string face;
+				ok = static_cast<bool>(in >> face);
+				c.faces[f] = strings.size();
+				strings.append(face.c_str(), face.size()+1);
+			}
+			if (ok)
+				cubemaps.push_back(c);
+		}
+		else {
+			ok = false;
+		}
+
+		std::string rest;
+		if (!ok || in >> rest) {
+			std::stringstream log;
+			log << filename << ":" << line_number << ": could not parse '" << line << "'";
+			throw std::runtime_error(log.str());
+		}
+	}
+
+	header.num_effects = effects.size();
+	header.num_spheres = spheres.size();
+	header.num_cubemaps = cubemaps.size();
+	header.strings_size = strings.size();
+
+	out.clear();
+	out.insert(out.end(), reinterpret_cast<const char*>(&header), reinterpret_cast<const char*>(&header + 1));
+	if (!effects.empty())
+		out.insert(out.end(), reinterpret_cast<const char*>(&effects[0]), reinterpret_cast<const char*>(&effects[0] + effects.size()));
+	if (!spheres.empty())
+		out.insert(out.end(), reinterpret_cast<const char*>(&spheres[0]), reinterpret_cast<const char*>(&spheres[0] + spheres.size()));
+	if (!cubemaps.empty())
+		out.insert(out.end(), reinterpret_cast<const char*>(&cubemaps[0]), reinterpret_cast<const char*>(&cubemaps[0] + cubemaps.size()));
+	out.insert(out.end(), strings.begin(), strings.end());
+}
+
+uint64_t SceneLoader::hash(const std::string& data) {
+	uint64_t h = 14695981039346656037ull;
+	for (size_t k=0; k<data.size(); ++k) {
+		h ^= static_cast<unsigned char>(data[k]);
+		h *= 1099511628211ull;
+	}
+	return h;
+}
+
+bool SceneLoader::mapCache(const std::string& cache_filename, uint64_t source_hash) {
+	int fd = open(cache_filename.c_str(), O_RDONLY);
+	if (fd < 0)
+		return false;
+
+	struct stat buffer;
+	if (fstat(fd, &buffer) != 0 || buffer.st_size < static_cast<off_t>(sizeof(Header))) {
+		close(fd);
+		return false;
+	}
+
+	size = buffer.st_size;
+	mapping = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (mapping == MAP_FAILED) {
+		mapping = NULL;
+		return false;
+	}
+	data = static_cast<const char*>(mapping);
+
+	//A cache is only valid for the exact scene file it was compiled from
+	const Header* header = reinterpret_cast<const Header*>(data);
+	size_t expected = sizeof(Header)
+		+ static_cast<size_t>(header->num_effects)*sizeof(EffectRecord)
+		+ static_cast<size_t>(header->num_spheres)*sizeof(SphereRecord)
+		+ static_cast<size_t>(header->num_cubemaps)*sizeof(CubeMapRecord)
+		+ header->strings_size;
+	if (std::memcmp(header->magic, "RTSC", 4) != 0 || header->version != cache_version
+			|| header->source_hash != source_hash || size != expected) {
+		unmapCache();
+		return false;
+	}
+
+	//Also reject caches with references out of range, e.g. if corrupted
+	const EffectRecord* effects = reinterpret_cast<const EffectRecord*>(header + 1);
+	const SphereRecord* spheres = reinterpret_cast<const SphereRecord*>(effects + header->num_effects);
+	const CubeMapRecord* cubemaps = reinterpret_cast<const CubeMapRecord*>(spheres + header->num_spheres);
+	const char* strings = reinterpret_cast<const char*>(cubemaps + header->num_cubemaps);
+	bool valid = header->strings_size == 0 || strings[header->strings_size-1] == '\0';
+	valid = valid && header->camera.width > 0 && header->camera.height > 0;
+	for (uint32_t k=0; k<header->num_spheres && valid; ++k)
+		valid = spheres[k].effect < header->num_effects;
+	for (uint32_t k=0; k<header->num_cubemaps && valid; ++k)
+		for (int f=0; f<6 && valid; ++f)
+			valid = cubemaps[k].faces[f] < header->strings_size;
+	if (!valid) {
+		unmapCache();
+		return false;
+	}
+	return true;
+}
+
+void SceneLoader::unmapCache() {
+	if (mapping != NULL)
+		munmap(mapping, size);
+	mapping = NULL;
+	data = NULL;
+	size = 0;
+}
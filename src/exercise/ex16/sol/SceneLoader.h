@@ -0,0 +1,94 @@
+#ifndef _SCENELOADER_H__
+#define _SCENELOADER_H__
+
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+#include "RayTracer.h"
+
+/**
+  * The SceneLoader reads scene description files, so that scenes can be
+  * changed without recompiling. A scene file is a text file with one
+  * statement per line ('#' starts a comment):
+  *
+  *   camera <width> <height> <num_rays> <focus_length> <aperture_radius>
+  *   effect <name> color <r> <g> <b>
+  *   effect <name> reflective
+  *   effect <name> fresnel <eta0> <eta1>
+  *   sphere <x> <y> <z> <radius> <effect name>
+  *   cubemap <posx> <negx> <posy> <negy> <posz> <negz>
+  *
+  * Parsing text is slow for large scenes, so the first load compiles the
+  * scene into a binary cache file, which later loads just memory-map. The
+  * cache stores a hash of the scene file it was compiled from, and is
+  * compiled again when the scene file has changed. Relative image file
+  * names are stored as written and resolved against the directory of the
+  * scene file when the scene is built, so the cache does not depend on the
+  * working directory.
+  */
+class SceneLoader {
+public:
+	/**
+	  * Camera settings of a scene
+	  */
+	struct Camera {
+		uint32_t width;
+		uint32_t height;
+		uint32_t num_rays;
+		float focus_length;
+		float aperture_radius;
+	};
+
+	/**
+	  * Loads the scene in filename, using (and if necessary rebuilding) the
+	  * binary cache cache_filename, by default filename + ".cache"
+	  */
+	SceneLoader(std::string filename, std::string cache_filename="");
+	~SceneLoader();
+
+	/**
+	  * Returns the camera settings of the scene
+	  */
+	const Camera& getCamera() const;
+
+	/**
+	  * Adds the effects and objects of the scene to rt
+	  */
+	void build(RayTracer& rt) const;
+
+	/**
+	  * Returns true if the scene was compiled from the text file, false if
+	  * an up to date cache was found
+	  */
+	inline bool wasCompiled() const { return compiled; }
+
+private:
+	struct Header;
+	struct EffectRecord;
+	struct SphereRecord;
+	struct CubeMapRecord;
+
+	/**
+	  * Parses the text scene file into the binary cache layout
+	  */
+	static void compile(const std::string& filename, const std::string& source,
+			uint64_t source_hash, std::vector<char>& out);
+
+	/**
+	  * FNV-1a hash of the scene file contents
+	  */
+	static uint64_t hash(const std::string& data);
+
+	bool mapCache(const std::string& cache_filename, uint64_t source_hash);
+	void unmapCache();
+
+	const char* data;           //< The compiled scene
+	size_t size;
+	void* mapping;              //< Memory mapped cache file, if any
+	std::vector<char> buffer;   //< Compiled scene, if the cache could not be mapped
+	bool compiled;
+	std::string directory;      //< Directory of the scene file, with a trailing '/'
+};
+
+#endif
@@ -17,6 +17,8 @@ class SceneObjectEffect;
   */
 class SceneObject {
 public:
+	virtual ~SceneObject() {}
+
 	/**
 	  * Computes the closest point of intersection
 	  * @param r The ray to perform intersection test against
@@ -34,6 +36,14 @@ public:
 	  */
 	virtual glm::vec3 rayTrace(Ray &ray, const float& t, RayTracerState& state) = 0;
 
+	/**
+	  * Computes the normal at the intersection point t*r. Objects without a
+	  * proper surface (e.g. the cube map) face the ray.
+	  */
+	virtual const glm::vec3 computeNormal(const Ray& r, const float& t) {
+		return -glm::normalize(r.getDirection());
+	}
+
 protected:
 	SceneObjectEffect* effect;
 	SceneObject() {};
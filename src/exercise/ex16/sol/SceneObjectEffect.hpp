@@ -9,6 +9,8 @@
   */
 class SceneObjectEffect {
 public:
+	virtual ~SceneObjectEffect() {}
+
 	/**
 	  * This function "shades" an intersection point between a scene object
 	  * and a ray. It can also fire new rays etc.
@@ -145,35 +145,17 @@ tgaInfo* tgaLoad(const char *filename){
 	return(info);
 }
 
-int tgaSave(const char *filename, tgaInfo* img) {
+int tgaSaveHeader(FILE *file, short int width, short int height, unsigned char pixelDepth) {
 
-	unsigned char cGarbage = 0, type,mode,aux;
+	unsigned char cGarbage = 0, type;
 	short int iGarbage = 0;
-	int i;
-	FILE *file;
 
-	unsigned char *imageData;
-
-	mode = img->pixelDepth / 8;
-	// total is the number of bytes to write
-	int total = img->height * img->width * mode;
-	// allocate memory for image pixels
-	imageData = (unsigned char *)malloc(sizeof(unsigned char) * total);
-	memcpy(imageData,img->imageData, sizeof(unsigned char) * total);		
-	
-	// open file and check for errors
-	file = fopen(filename, "wb");
-	if (file == NULL) {
-		return(TGA_ERROR_FILE_OPEN);
-	}
-	
 	// compute image type: 2 for RGB(A), 3 for greyscale
-	if ((img->pixelDepth == 24) || (img->pixelDepth == 32))
+	if ((pixelDepth == 24) || (pixelDepth == 32))
 		type = 2;
 	else
 		type = 3;
 
-	// write the header
 	fwrite(&cGarbage, sizeof(unsigned char), 1, file);
 	fwrite(&cGarbage, sizeof(unsigned char), 1, file);
 
@@ -185,12 +167,41 @@ int tgaSave(const char *filename, tgaInfo* img) {
 	fwrite(&iGarbage, sizeof(short int), 1, file);
 	fwrite(&iGarbage, sizeof(short int), 1, file);
 
-	fwrite(&img->width, sizeof(short int), 1, file);
-	fwrite(&img->height, sizeof(short int), 1, file);
-	fwrite(&img->pixelDepth, sizeof(unsigned char), 1, file);
+	fwrite(&width, sizeof(short int), 1, file);
+	fwrite(&height, sizeof(short int), 1, file);
+	fwrite(&pixelDepth, sizeof(unsigned char), 1, file);
 
 	fwrite(&cGarbage, sizeof(unsigned char), 1, file);
 
+	if (ferror(file))
+		return(TGA_ERROR_WRITING_FILE);
+	return(TGA_OK);
+}
+
+int tgaSave(const char *filename, tgaInfo* img) {
+
+	unsigned char mode,aux;
+	int i;
+	FILE *file;
+
+	unsigned char *imageData;
+
+	mode = img->pixelDepth / 8;
+	// total is the number of bytes to write
+	int total = img->height * img->width * mode;
+	// allocate memory for image pixels
+	imageData = (unsigned char *)malloc(sizeof(unsigned char) * total);
+	memcpy(imageData,img->imageData, sizeof(unsigned char) * total);		
+	
+	// open file and check for errors
+	file = fopen(filename, "wb");
+	if (file == NULL) {
+		return(TGA_ERROR_FILE_OPEN);
+	}
+	
+	// write the header
+	tgaSaveHeader(file, img->width, img->height, img->pixelDepth);
+
 	// convert the image data from RGB(a) to BGR(A)
 	if (mode >= 3)
 		for (i=0; i < img->width * img->height * mode ; i+= mode) {
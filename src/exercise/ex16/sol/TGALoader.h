@@ -1,6 +1,7 @@
 #ifndef TGA_LOADER_H
 #define TGA_LOADER_H
 
+#define TGA_ERROR_WRITING_FILE			-6
 #define	TGA_ERROR_FILE_OPEN				-5
 #define TGA_ERROR_READING_FILE			-4
 #define TGA_ERROR_INDEXED_COLOR			-3
@@ -22,6 +23,7 @@ typedef struct {
 tgaInfo* tgaCreate(short int width, short int height, unsigned char bpp, unsigned char* data);
 tgaInfo* tgaLoad(const char *filename);
 int tgaSave(const char *filename, tgaInfo* img);
+int tgaSaveHeader(FILE *file, short int width, short int height, unsigned char pixelDepth);
 void tgaDestroy(tgaInfo *info);
 
 #endif //TGA_LOADER_H
@@ -0,0 +1,91 @@
+#ifndef _TILE_HPP__
+#define _TILE_HPP__
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <cstring>
+#include <stdexcept>
+#include <stdint.h>
+
+/**
+  * A tile is a rectangular region of a larger frame that has been rendered
+  * on its own, e.g. by another process or on another machine. The tile file
+  * records where in the frame the tile belongs, so that the tiles can be
+  * merged into the final image afterwards (see tools/tilemerge.cpp).
+  *
+  * File layout (native byte order):
+  *   TileHeader
+  *   3 floats (r, g, b) for each of the width*height pixels, row by row,
+  *   starting with the bottom row, just like in the FrameBuffer
+  */
+struct TileHeader {
+	char magic[4];          //< "RTTL"
+	uint32_t version;       //< File format version
+	uint32_t frame_width;   //< Size of the whole frame in pixels
+	uint32_t frame_height;
+	uint32_t x;             //< Lower left pixel of the tile in the frame
+	uint32_t y;
+	uint32_t width;         //< Size of the tile in pixels
+	uint32_t height;
+
+	TileHeader() {
+		std::memcpy(magic, "RTTL", 4);
+		version = 1;
+		frame_width = frame_height = 0;
+		x = y = width = height = 0;
+	}
+
+	/**
+	  * Returns the byte offset of the first pixel of row j of the tile
+	  */
+	inline std::streamoff rowOffset(uint32_t j) const {
+		return sizeof(TileHeader) + static_cast<std::streamoff>(j)*width*3*sizeof(float);
+	}
+};
+
+/**
+  * Converts a color channel to a byte of an 8-bit image, clamping it to
+  * [0, 1] first. Used by RayTracer::save and tilemerge, so that a merged
+  * image is identical to one saved in a single pass.
+  */
+inline unsigned char colorToByte(float value) {
+	if (!(value > 0.0f)) return 0; //Also catches NaN
+	if (value >= 1.0f) return 255;
+	return static_cast<unsigned char>(value*255.0f);
+}
+
+/**
+  * Writes a tile file
+  * @param data The colors of the tile, as stored in the FrameBuffer
+  */
+inline void writeTile(const std::string& filename, const TileHeader& header, const std::vector<float>& data) {
+	if (data.size() != static_cast<size_t>(header.width)*header.height*3)
+		throw std::runtime_error("Tile data does not match tile size: " + filename);
+
+	std::ofstream out(filename.c_str(), std::ios::out | std::ios::binary);
+	out.write(reinterpret_cast<const char*>(&header), sizeof(TileHeader));
+	if (!data.empty())
+		out.write(reinterpret_cast<const char*>(&data[0]), data.size()*sizeof(float));
+	if (!out.good())
+		throw std::runtime_error("Error writing tile " + filename);
+}
+
+/**
+  * Reads and checks the header of a tile file, leaving in positioned at
+  * the first pixel
+  */
+inline TileHeader readTileHeader(std::istream& in, const std::string& filename) {
+	TileHeader header;
+	in.read(reinterpret_cast<char*>(&header), sizeof(TileHeader));
+	if (!in.good() || std::memcmp(header.magic, "RTTL", 4) != 0)
+		throw std::runtime_error("Not a tile file: " + filename);
+	if (header.version != 1)
+		throw std::runtime_error("Unsupported tile file version: " + filename);
+	if (header.x > header.frame_width || header.width > header.frame_width - header.x
+			|| header.y > header.frame_height || header.height > header.frame_height - header.y)
+		throw std::runtime_error("Tile lies outside its frame: " + filename);
+	return header;
+}
+
+#endif
@@ -1,54 +1,151 @@
 #include <iostream>
 #include <string>
+#include <cstdlib>
+#include <chrono>
+
+#include <sstream>
+#include <stdexcept>
 
 #include "RayTracer.h"
-#include "Sphere.hpp"
-#include "CubeMap.hpp"
+#include "SceneLoader.h"
+
+/**
+ * Returns the seconds elapsed since start
+ */
+static double secondsSince(std::chrono::steady_clock::time_point start) {
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
 
 /**
  * Simple program that starts our game manager
+ *
+ * Usage: ex16_raytracer [-f scenefile] [-n num_rays] [-s sobol|halton|random] [-d] [-r reference_rays]
+ *                       [-c x y width height | -b band bands] [-t tilefile]
+ *   -f  scene description file to render (default default.scene), see SceneLoader.h
+ *   -n  number of aperture samples per pixel (each is 4 subpixel rays),
+ *       overrides the camera of the scene
+ *   -s  sample sequence for pixel and lens positions (default sobol)
+ *   -d  denoise the image before saving it
+ *   -r  first render a reference with this many samples, and report the
+ *       time and quality (PSNR) of the noisy and the denoised image
+ *   -c  only render the given crop window of the frame
+ *   -b  split the frame into bands of rows, and only render band number
+ *       band (counting from 0), e.g. one band per batch job
+ *   -t  save the rendered region as a tile file instead of an image. Merge
+ *       the tiles of all jobs with tools/tilemerge
  */
 int main(int argc, char *argv[]) {
+	int num_rays = 0;
+	int reference_rays = 0;
+	bool denoise = false;
+	Sampler::Sequence sequence = Sampler::SOBOL;
+	std::string scene_filename = "default.scene";
+	int crop[4] = { -1, -1, -1, -1 };
+	int band = -1, bands = 0;
+	std::string tile_filename;
+
+	for (int k=1; k<argc; ++k) {
+		std::string arg = argv[k];
+		if (arg == "-f" && k+1 < argc) scene_filename = argv[++k];
+		else if (arg == "-n" && k+1 < argc) num_rays = std::atoi(argv[++k]);
+		else if (arg == "-r" && k+1 < argc) reference_rays = std::atoi(argv[++k]);
+		else if (arg == "-d") denoise = true;
+		else if (arg == "-s" && k+1 < argc && std::string(argv[k+1]) == "sobol") { sequence = Sampler::SOBOL; ++k; }
+		else if (arg == "-s" && k+1 < argc && std::string(argv[k+1]) == "halton") { sequence = Sampler::HALTON; ++k; }
+		else if (arg == "-s" && k+1 < argc && std::string(argv[k+1]) == "random") { sequence = Sampler::RANDOM; ++k; }
+		else if (arg == "-c" && k+4 < argc) for (int c=0; c<4; ++c) crop[c] = std::atoi(argv[++k]);
+		else if (arg == "-b" && k+2 < argc) { band = std::atoi(argv[++k]); bands = std::atoi(argv[++k]); }
+		else if (arg == "-t" && k+1 < argc) tile_filename = argv[++k];
+		else {
+			std::cout << "Usage: " << argv[0] << " [-f scenefile] [-n num_rays] [-s sobol|halton|random] [-d] [-r reference_rays]"
+				<< " [-c x y width height | -b band bands] [-t tilefile]" << std::endl;
+			return -1;
+		}
+	}
+
+	if (denoise && !tile_filename.empty()) {
+		//The filter would need the pixels of the neighbouring tiles
+		std::cout << "Tiles can not be denoised separately, denoise the merged image instead" << std::endl;
+		return -1;
+	}
+
 	try {
-		RayTracer* rt = new RayTracer(800, 600, 100, 7.0f, 0.003f);
-
-		// materials
-		const float eta_air = 1.000293f;
-		const float eta_carbondioxide = 1.00045f;
-		const float eta_water = 1.3330f;
-		const float eta_ethanol = 1.361f;
-		const float eta_pyrex = 1.470f;
-		const float eta_diamond = 2.419f;
-
-		SceneObjectEffect* color = new ColorEffect(glm::vec3(0.0, 1.0, 0.0));
-		SceneObjectEffect* reflective = new ReflectiveEffect();
-		SceneObjectEffect* fresnel = new FresnelEffect(eta_air, eta_diamond);
-		
-		SceneObject* s1 = new Sphere(glm::vec3(-3.0f, 0.0f, 6.0f), 2.0f, reflective);
-		rt->addSceneObject(s1);
-		SceneObject* s2 = new Sphere(glm::vec3(3.0f, 0.0f, 3.0f), 2.0f, fresnel);
-		rt->addSceneObject(s2);
-		SceneObject* s3 = new Sphere(glm::vec3(0.0f, 3.0f, 2.0f), 2.0f, fresnel);
-		rt->addSceneObject(s3);
-
-		SceneObject* s5 = new CubeMap(
-			"cubemap/posx.tga", 
-			"cubemap/negx.tga", 
-			"cubemap/posy.tga", 
-			"cubemap/negy.tga", 
-			"cubemap/posz.tga", 
-			"cubemap/negz.tga");
-		rt->addSceneObject(s5);
+		std::chrono::steady_clock::time_point load_start = std::chrono::steady_clock::now();
+		SceneLoader scene(scene_filename);
+		const SceneLoader::Camera& camera = scene.getCamera();
+		const unsigned int width = camera.width;
+		const unsigned int height = camera.height;
+		if (num_rays <= 0) num_rays = camera.num_rays;
+
+		RayTracer* rt = new RayTracer(width, height, num_rays, camera.focus_length, camera.aperture_radius);
+		rt->setSampler(Sampler(sequence));
+		scene.build(*rt);
+		std::cout << "Scene " << (scene.wasCompiled() ? "compiled" : "loaded from cache")
+			<< " in " << secondsSince(load_start) << " s" << std::endl;
 
+		if (crop[0] < 0) {
+			crop[0] = crop[1] = 0;
+			crop[2] = width;
+			crop[3] = height;
+		}
+		if (bands > 0) {
+			if (band < 0 || band >= bands || static_cast<unsigned int>(bands) > height) {
+				std::stringstream log;
+				log << "Band " << band << " of " << bands << " does not exist";
+				throw std::runtime_error(log.str());
+			}
+			crop[1] = band*height/bands;
+			crop[3] = (band+1)*height/bands - crop[1];
+		}
+		rt->setRegion(crop[0], crop[1], crop[2], crop[3]);
+
+		std::vector<float> reference;
+		double reference_time = 0.0;
+		if (reference_rays > 0) {
+			std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+			rt->setNumRays(reference_rays);
+			rt->render();
+			reference_time = secondsSince(start);
+			reference = rt->getFrameBuffer().getData();
+			rt->setNumRays(num_rays);
+			std::cout << "Reference rendered" << std::endl;
+		}
+
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
 		rt->render();
+		double render_time = secondsSince(start);
 		std::cout << "Image rendered" << std::endl;
+
+		std::vector<float> noisy = rt->getFrameBuffer().getData();
+		double denoise_time = 0.0;
+		if (denoise || reference_rays > 0) {
+			start = std::chrono::steady_clock::now();
+			Denoiser denoiser;
+			rt->denoise(denoiser);
+			denoise_time = secondsSince(start);
+			std::cout << "Image denoised" << std::endl;
+		}
+
+		if (reference_rays > 0) {
+			const std::vector<float>& denoised = rt->getFrameBuffer().getData();
+			std::cout << "reference: " << reference_rays << " rays, " << reference_time << " s" << std::endl;
+			std::cout << "noisy:     " << num_rays << " rays, " << render_time << " s, "
+				<< Denoiser::psnr(noisy, reference) << " dB" << std::endl;
+			std::cout << "denoised:  " << num_rays << " rays, " << render_time + denoise_time << " s ("
+				<< denoise_time << " s filtering), " << Denoiser::psnr(denoised, reference) << " dB" << std::endl;
+			if (!denoise) rt->getFrameBuffer().setData(noisy);
+		}
 		
-		rt->save("test");
-		std::cout << "Image saved" << std::endl;
+		if (!tile_filename.empty()) {
+			rt->saveTile(tile_filename);
+			std::cout << "Tile saved" << std::endl;
+		}
+		else {
+			rt->save("test");
+			std::cout << "Image saved" << std::endl;
+		}
 
 		delete rt;
-		delete color;
-		delete reflective;
 	} catch (std::exception &e) {
 		std::string err = e.what();
 		std::cout << err.c_str() << std::endl;
@@ -0,0 +1,144 @@
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <stdexcept>
+#include <sstream>
+
+#include "../Tile.hpp"
+#include "../TGALoader.h"
+
+/**
+ * Merges tiles rendered with ex16_raytracer -t into one TGA image.
+ *
+ * Usage: tilemerge output.tga tile0 tile1 ...
+ *
+ * The image is written one row at a time, reading only that row from the
+ * tiles covering it, so memory use does not depend on the size of the frame
+ * or the number of tiles. Every pixel of the frame must be covered by exactly
+ * one tile.
+ *
+ * Build from this directory with
+ *   g++ -O2 -I.. tilemerge.cpp ../TGALoader.cpp -o tilemerge
+ */
+
+struct TileFile {
+	std::string filename;
+	TileHeader header;
+	std::ifstream* in;
+};
+
+static bool lowerRowFirst(const TileFile& a, const TileFile& b) {
+	return a.header.y < b.header.y;
+}
+
+int main(int argc, char *argv[]) {
+	if (argc < 3) {
+		std::cout << "Usage: " << argv[0] << " output.tga tile0 tile1 ..." << std::endl;
+		return -1;
+	}
+
+	std::vector<TileFile> tiles;
+	FILE* file = NULL;
+
+	try {
+		//Read all the headers, and check that the tiles fit together
+		for (int k=2; k<argc; ++k) {
+			TileFile tile;
+			tile.filename = argv[k];
+			tile.in = NULL;
+			std::ifstream in(tile.filename.c_str(), std::ios::in | std::ios::binary);
+			if (!in.good())
+				throw std::runtime_error("Error reading from " + tile.filename);
+			tile.header = readTileHeader(in, tile.filename);
+
+			if (!tiles.empty() && (tile.header.frame_width != tiles[0].header.frame_width
+					|| tile.header.frame_height != tiles[0].header.frame_height))
+				throw std::runtime_error("Tile belongs to a frame of another size: " + tile.filename);
+			tiles.push_back(tile);
+		}
+		std::sort(tiles.begin(), tiles.end(), lowerRowFirst);
+
+		const unsigned int width = tiles[0].header.frame_width;
+		const unsigned int height = tiles[0].header.frame_height;
+		if (width > 32767 || height > 32767)
+			throw std::runtime_error("Frame is too large for a TGA image");
+
+		file = fopen(argv[1], "wb");
+		if (file == NULL || tgaSaveHeader(file, width, height, 24) != TGA_OK)
+			throw std::runtime_error(std::string("Error writing to ") + argv[1]);
+
+		std::vector<float> colors;
+		std::vector<unsigned char> row(3*width);
+		std::vector<bool> covered(width);
+		size_t first_open = 0;
+
+		//TGA images are stored from the bottom row and up, like our tiles
+		for (unsigned int y=0; y<height; ++y) {
+			std::fill(covered.begin(), covered.end(), false);
+
+			for (size_t t=first_open; t<tiles.size() && tiles[t].header.y <= y; ++t) {
+				TileFile& tile = tiles[t];
+				const TileHeader& h = tile.header;
+				if (y >= h.y + h.height) continue;
+
+				//Only the tiles covering this row are open
+				if (tile.in == NULL) {
+					tile.in = new std::ifstream(tile.filename.c_str(), std::ios::in | std::ios::binary);
+				}
+
+				colors.resize(3*h.width);
+				tile.in->seekg(h.rowOffset(y - h.y));
+				tile.in->read(reinterpret_cast<char*>(&colors[0]), colors.size()*sizeof(float));
+				if (!tile.in->good())
+					throw std::runtime_error("Error reading from " + tile.filename);
+
+				for (unsigned int i=0; i<h.width; ++i) {
+					if (covered[h.x+i]) {
+						std::stringstream log;
+						log << "Tiles overlap at pixel (" << h.x+i << ", " << y << "): " << tile.filename;
+						throw std::runtime_error(log.str());
+					}
+					covered[h.x+i] = true;
+
+					//Same conversion as RayTracer::save, in BGR order
+					for (int c=0; c<3; ++c)
+						row[3*(h.x+i)+2-c] = colorToByte(colors[3*i+c]);
+				}
+
+				if (y+1 == h.y + h.height) {
+					delete tile.in;
+					tile.in = NULL;
+				}
+			}
+
+			//Tiles ending below the next row are done
+			while (first_open < tiles.size() && tiles[first_open].header.y + tiles[first_open].header.height <= y+1
+					&& tiles[first_open].in == NULL)
+				++first_open;
+
+			for (unsigned int i=0; i<width; ++i) {
+				if (!covered[i]) {
+					std::stringstream log;
+					log << "No tile covers pixel (" << i << ", " << y << ")";
+					throw std::runtime_error(log.str());
+				}
+			}
+
+			if (fwrite(&row[0], sizeof(unsigned char), row.size(), file) != row.size())
+				throw std::runtime_error(std::string("Error writing to ") + argv[1]);
+		}
+
+		fclose(file);
+		std::cout << "Merged " << tiles.size() << " tiles into " << argv[1] << std::endl;
+	} catch (std::exception &e) {
+		for (size_t t=0; t<tiles.size(); ++t)
+			delete tiles[t].in;
+		if (file != NULL)
+			fclose(file);
+		std::cout << e.what() << std::endl;
+		return -1;
+	}
+	return 0;
+}
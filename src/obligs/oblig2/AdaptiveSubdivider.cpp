@@ -0,0 +1,297 @@
+/* AdaptiveSubdivider.cpp
+ *
+ * Distributed under the GNU GPL.
+ */
+
+#include "AdaptiveSubdivider.hpp"
+
+#include <cmath>
+#include <vector>
+#include <algorithm>
+#include <unordered_map>
+#include <glm/glm.hpp>
+
+using std::vector;
+
+namespace GfxUtil {
+
+static const uint32_t NONE = CompactTriMesh::NONE;
+
+/** Key of the edge between nodes a and b. */
+static uint64_t edgeKey(uint64_t a, uint64_t b) {
+  return a < b ? (a << 32) | b : (b << 32) | a;
+}
+
+AdaptiveSubdivider::AdaptiveSubdivider(const CompactTriMesh& mesh, int max_level)
+    : m_mesh(mesh), m_levels(mesh.getNumTriangles(), 0),
+      m_green(mesh.getNumTriangles(), NONE), m_max_level(max_level) {
+}
+
+void AdaptiveSubdivider::mergeGreenTriangles(vector<std::pair<uint64_t, uint32_t> >& split_edges,
+                                             vector<bool>& selected) {
+  // A green pair (a, b, m), (a, m, c) is always stored as two consecutive
+  // triangles, and is merged into (a, b, c), with m on half-edge b->c
+  const vector<uint32_t>& indices = m_mesh.getIndices();
+  vector<uint32_t> merged_indices;
+  vector<uint8_t> merged_levels;
+  vector<bool> merged_selected;
+  merged_indices.reserve(indices.size());
+  merged_levels.reserve(m_levels.size());
+  merged_selected.reserve(m_levels.size());
+  split_edges.clear();
+
+  for(uint32_t t=0; t<m_levels.size(); t++) {
+    if(m_green[t] == NONE) {
+      merged_indices.insert(merged_indices.end(), &indices[3*t], &indices[3*t+3]);
+      merged_selected.push_back(selected[t]);
+    } else {
+      const uint32_t a = indices[3*t+0];
+      const uint32_t b = indices[3*t+1];
+      const uint32_t m = indices[3*t+2];
+      const uint32_t c = indices[3*(t+1)+2];
+      split_edges.push_back(std::make_pair(merged_indices.size()+1, m));
+      merged_indices.push_back(a);
+      merged_indices.push_back(b);
+      merged_indices.push_back(c);
+      merged_selected.push_back(selected[t] || selected[t+1]);
+      t++;
+    }
+    merged_levels.push_back(m_levels[t]);
+  }
+
+  if(!split_edges.empty()) {
+    m_mesh = CompactTriMesh(m_mesh.getPositions(), merged_indices);
+  }
+  m_levels.swap(merged_levels);
+  m_green.assign(m_levels.size(), NONE);
+  selected.swap(merged_selected);
+}
+
+size_t AdaptiveSubdivider::refine(const vector<bool>& selection) {
+  vector<bool> selected(selection);
+  selected.resize(m_levels.size(), false);
+  vector<std::pair<uint64_t, uint32_t> > split_edges;
+  mergeGreenTriangles(split_edges, selected);
+
+  const CompactTriMesh& mesh = m_mesh;
+  const long Nv = mesh.getNumNodes();
+  const long Nt = mesh.getNumTriangles();
+  const vector<glm::vec3>& positions = mesh.getPositions();
+
+  // The split edges and their new nodes. After merging, the nodes of the
+  // merged green triangles hang on the edges of their parents, and the
+  // nodes around them are part of the transition.
+  std::unordered_map<uint64_t, uint32_t> midpoints;
+  vector<uint8_t> transition(Nv, 0);
+  for(size_t i=0; i<split_edges.size(); i++) {
+    const uint32_t he = split_edges[i].first;
+    midpoints[mesh.edgeKey(he)] = split_edges[i].second;
+    transition[mesh.getSourceNode(he)] = 1;
+    transition[mesh.getDestinationNode(he)] = 1;
+    transition[split_edges[i].second] = 1;
+  }
+
+  vector<uint32_t> edges, first_halfedges;
+  mesh.numberEdges(edges, first_halfedges);
+  StencilTable stencils;
+  mesh.buildLoopStencils(first_halfedges, stencils);
+
+  // Split the selected triangles 1-to-4, and then every triangle with two
+  // or more split edges, or with a split edge that is split again, until no
+  // such triangles are left. Triangles created here are appended, and are
+  // checked in the same sweep.
+  vector<uint32_t> indices(mesh.getIndices());
+  vector<uint8_t> levels(m_levels);
+  vector<uint8_t> red(Nt, 0);
+  vector<uint8_t> dead(Nt, 0);
+  vector<glm::vec3> points(positions);
+  for(long t=0; t<Nt; t++) {
+    red[t] = selected[t] && m_levels[t] < m_max_level;
+  }
+  size_t num_red = 0;
+  bool changed = true;
+  while(changed) {
+    changed = false;
+    for(size_t t=0; t<levels.size(); t++) {
+      if(dead[t]) {
+        continue;
+      }
+      uint32_t v[3], m[3];
+      int num_split = 0;
+      for(uint32_t k=0; k<3; k++) {
+        v[k] = indices[3*t+k];
+      }
+      for(uint32_t k=0; k<3; k++) {
+        const uint32_t a = v[k], b = v[(k+1)%3];
+        const std::unordered_map<uint64_t, uint32_t>::const_iterator it = midpoints.find(edgeKey(a, b));
+        m[k] = it == midpoints.end() ? NONE : it->second;
+        if(m[k] != NONE) {
+          num_split += (midpoints.count(edgeKey(a, m[k])) || midpoints.count(edgeKey(m[k], b))) ? 2 : 1;
+        }
+      }
+      if(!red[t] && num_split < 2) {
+        continue;
+      }
+
+      // New nodes on edges of the merged mesh get Loop's edge rule, nodes
+      // inserted on other edges to close the transition get the midpoint
+      for(uint32_t k=0; k<3; k++) {
+        if(m[k] != NONE) {
+          continue;
+        }
+        const uint32_t a = v[k], b = v[(k+1)%3];
+        m[k] = points.size();
+        midpoints[edgeKey(a, b)] = m[k];
+        const uint32_t he = 3*t+k;
+        if(long(t) < Nt && !transition[a] && !transition[b]) {
+          points.push_back(stencils.apply(positions, Nv + edges[he]));
+        } else {
+          points.push_back(0.5f*(points[a] + points[b]));
+        }
+      }
+      for(uint32_t k=0; k<3; k++) {
+        const uint32_t tri[3] = { v[k], m[k], m[(k+2)%3] };
+        indices.insert(indices.end(), tri, tri+3);
+      }
+      indices.insert(indices.end(), m, m+3);
+      levels.insert(levels.end(), 4, levels[t]+1);
+      red.insert(red.end(), 4, 0);
+      dead.insert(dead.end(), 4, 0);
+      dead[t] = 1;
+      num_red++;
+      changed = true;
+    }
+  }
+
+  // Old nodes where every triangle is split 1-to-4 get Loop's vertex rule
+#pragma omp parallel for schedule(dynamic, 1024)
+  for(long v=0; v<Nv; v++) {
+    const uint32_t first = mesh.getLeadingHalfEdge(v);
+    bool refined = first != NONE && !transition[v];
+    if(refined) {
+      uint32_t he = first;
+      do {
+        refined = refined && dead[CompactTriMesh::getTriangle(he)];
+        he = mesh.getVtxRingNext(he);
+      } while(refined && he != NONE && he != first);
+    }
+    if(refined) {
+      points[v] = stencils.apply(positions, v);
+    }
+  }
+
+  // Close the transition by splitting the triangles with one split edge
+  // 1-to-2 (green), and collect the triangles of the refined mesh
+  vector<uint32_t> refined_indices;
+  vector<uint8_t> refined_levels;
+  vector<uint32_t> refined_green;
+  refined_indices.reserve(indices.size());
+  refined_levels.reserve(levels.size());
+  refined_green.reserve(levels.size());
+  for(size_t t=0; t<levels.size(); t++) {
+    if(dead[t]) {
+      continue;
+    }
+    const uint32_t* v = &indices[3*t];
+    uint32_t k = 0, m = NONE;
+    for(uint32_t i=0; i<3 && m == NONE; i++) {
+      const std::unordered_map<uint64_t, uint32_t>::const_iterator it = midpoints.find(edgeKey(v[i], v[(i+1)%3]));
+      if(it != midpoints.end()) {
+        k = i;
+        m = it->second;
+      }
+    }
+    if(m == NONE) {
+      refined_indices.insert(refined_indices.end(), v, v+3);
+      refined_levels.push_back(levels[t]);
+      refined_green.push_back(NONE);
+    } else {
+      // (a, b, m) and (a, m, c) for the split edge b->c
+      const uint32_t tri[6] = { v[(k+2)%3], v[k], m, v[(k+2)%3], m, v[(k+1)%3] };
+      refined_indices.insert(refined_indices.end(), tri, tri+6);
+      refined_levels.insert(refined_levels.end(), 2, levels[t]);
+      refined_green.push_back(refined_green.size()+1);
+      refined_green.push_back(refined_green.size()-1);
+    }
+  }
+
+  m_mesh = CompactTriMesh(points, refined_indices);
+  m_levels.swap(refined_levels);
+  m_green.swap(refined_green);
+  return num_red;
+}
+
+void AdaptiveSubdivider::selectByCurvature(const CompactTriMesh& mesh, float angle,
+                                           vector<bool>& selected) {
+  const long Nt = mesh.getNumTriangles();
+  const vector<glm::vec3>& p = mesh.getPositions();
+  const vector<uint32_t>& indices = mesh.getIndices();
+  vector<glm::vec3> normals(Nt);
+#pragma omp parallel for
+  for(long t=0; t<Nt; t++) {
+    const glm::vec3 N = glm::cross(p[indices[3*t+1]] - p[indices[3*t]],
+                                   p[indices[3*t+2]] - p[indices[3*t]]);
+    const float length = glm::length(N);
+    normals[t] = length > 0.0f ? N/length : N;
+  }
+
+  const float min_cos = std::cos(angle);
+  vector<uint8_t> result(Nt);
+#pragma omp parallel for
+  for(long t=0; t<Nt; t++) {
+    result[t] = 0;
+    for(uint32_t k=0; k<3; k++) {
+      const uint32_t twin = mesh.getTwin(3*t+k);
+      if(twin != NONE && glm::dot(normals[t], normals[CompactTriMesh::getTriangle(twin)]) < min_cos) {
+        result[t] = 1;
+      }
+    }
+  }
+  selected.assign(result.begin(), result.end());
+}
+
+void AdaptiveSubdivider::selectByScreenSize(const CompactTriMesh& mesh, const glm::mat4x4& mvp,
+                                            int width, int height, float pixels,
+                                            vector<bool>& selected) {
+  const long Nv = mesh.getNumNodes();
+  const long Nt = mesh.getNumTriangles();
+  const vector<glm::vec3>& p = mesh.getPositions();
+  const vector<uint32_t>& indices = mesh.getIndices();
+
+  // Window coordinates of the nodes, w < 0 marks nodes behind the camera
+  vector<glm::vec3> window(Nv);
+#pragma omp parallel for
+  for(long v=0; v<Nv; v++) {
+    const glm::vec4 clip = mvp * glm::vec4(p[v], 1.0f);
+    if(clip.w <= 0.0f) {
+      window[v] = glm::vec3(0.0f, 0.0f, -1.0f);
+    } else {
+      window[v] = glm::vec3(0.5f*width*(clip.x/clip.w + 1.0f),
+                            0.5f*height*(clip.y/clip.w + 1.0f), clip.w);
+    }
+  }
+
+  vector<uint8_t> result(Nt);
+#pragma omp parallel for
+  for(long t=0; t<Nt; t++) {
+    const glm::vec3& a = window[indices[3*t+0]];
+    const glm::vec3& b = window[indices[3*t+1]];
+    const glm::vec3& c = window[indices[3*t+2]];
+    result[t] = 0;
+    if(a.z < 0.0f || b.z < 0.0f || c.z < 0.0f) {
+      continue;
+    }
+    // Skip triangles entirely outside the window
+    if(std::max(a.x, std::max(b.x, c.x)) < 0.0f || std::min(a.x, std::min(b.x, c.x)) > width ||
+       std::max(a.y, std::max(b.y, c.y)) < 0.0f || std::min(a.y, std::min(b.y, c.y)) > height) {
+      continue;
+    }
+    const float ab = (a.x-b.x)*(a.x-b.x) + (a.y-b.y)*(a.y-b.y);
+    const float bc = (b.x-c.x)*(b.x-c.x) + (b.y-c.y)*(b.y-c.y);
+    const float ca = (c.x-a.x)*(c.x-a.x) + (c.y-a.y)*(c.y-a.y);
+    result[t] = std::max(ab, std::max(bc, ca)) > pixels*pixels;
+  }
+  selected.assign(result.begin(), result.end());
+}
+
+}  // GfxUtil
@@ -0,0 +1,85 @@
+/* AdaptiveSubdivider.hpp
+ *
+ * Distributed under the GNU GPL.
+ */
+
+#ifndef GFXUTIL_ADAPTIVESUBDIVIDER_H
+#define GFXUTIL_ADAPTIVESUBDIVIDER_H
+
+#include <vector>
+#include <stdint.h>
+#include <glm/glm.hpp>
+
+#include "CompactTriMesh.hpp"
+
+namespace GfxUtil {
+
+/** Adaptive Loop-subdivision using red-green refinement.
+ *
+ *  Each refinement step splits only the selected triangles 1-to-4 (red),
+ *  and keeps the mesh conforming by splitting triangles with one split edge
+ *  1-to-2 (green), and triangles with more split edges 1-to-4 as well. Green
+ *  triangles are merged back into their parent before the next step, so
+ *  that repeated steps do not produce slivers. The new nodes get Loop's edge
+ *  rule, and old nodes get Loop's vertex rule where all their triangles are
+ *  split 1-to-4, so the refined regions converge to the limit surface while
+ *  the rest of the mesh is left as it is.
+ *
+ *  Typical use:
+ *
+ *    AdaptiveSubdivider subdivider(mesh, 5);
+ *    for(int i=0; i<5; i++) {
+ *      std::vector<bool> selected;
+ *      AdaptiveSubdivider::selectByCurvature(subdivider.getMesh(), 0.1f, selected);
+ *      subdivider.refine(selected);
+ *    }
+ */
+class AdaptiveSubdivider {
+ public:
+  /** Constructor.
+   *  \param mesh The mesh to refine.
+   *  \param max_level Triangles are not refined beyond this level. */
+  AdaptiveSubdivider(const CompactTriMesh& mesh, int max_level = 8);
+
+  /** Returns the current, conforming mesh. */
+  const CompactTriMesh& getMesh() const { return m_mesh; }
+
+  /** Returns the refinement level of each triangle of the current mesh. */
+  const std::vector<uint8_t>& getLevels() const { return m_levels; }
+
+  /** Refines the mesh one step.
+   *  \param selected Which triangles of the current mesh to split 1-to-4.
+   *  \return The number of triangles that were split 1-to-4. */
+  size_t refine(const std::vector<bool>& selected);
+
+  /** Selects the triangles where the angle between the normal of the
+   *  triangle and the normal of a neighbouring triangle exceeds angle
+   *  (in radians), i.e., where the surface is curved or has a feature. */
+  static void selectByCurvature(const CompactTriMesh& mesh, float angle,
+                                std::vector<bool>& selected);
+
+  /** Selects the visible triangles with an edge longer than pixels on
+   *  screen, e.g. using the matrices from SimpleViewer.
+   *  \param mvp The projection matrix times the model-view matrix.
+   *  \param width, height The size of the window in pixels. */
+  static void selectByScreenSize(const CompactTriMesh& mesh, const glm::mat4x4& mvp,
+                                 int width, int height, float pixels,
+                                 std::vector<bool>& selected);
+
+ protected:
+  /** Merges all green triangle pairs back into their parents.
+   *  \param split_edges Set to the half-edge of the split edge of each
+   *                     merged parent, and the node on that edge.
+   *  \param selected Updated to select the parents of selected triangles. */
+  void mergeGreenTriangles(std::vector<std::pair<uint64_t, uint32_t> >& split_edges,
+                           std::vector<bool>& selected);
+
+  CompactTriMesh        m_mesh;        /// The current mesh.
+  std::vector<uint8_t>  m_levels;      /// Refinement level of each triangle.
+  std::vector<uint32_t> m_green;       /// The other half of each green triangle, or NONE.
+  int                   m_max_level;   /// Maximum refinement level.
+};
+
+}  // GfxUtil
+
+#endif
@@ -0,0 +1,538 @@
+/* CompactTriMesh.cpp
+ *
+ * Distributed under the GNU GPL.
+ */
+
+#include "CompactTriMesh.hpp"
+#include "ParallelScan.hpp"
+#include "MeshFile.hpp"
+#include "CompressedMeshFile.hpp"
+#include "TextMeshParser.hpp"
+
+#include <cmath>
+#include <stdexcept>
+#include <fstream>
+#include <vector>
+#include <algorithm>
+#include <map>
+#include <glm/glm.hpp>
+
+using std::runtime_error;
+using std::string;
+using std::vector;
+
+namespace GfxUtil {
+
+const uint32_t CompactTriMesh::NONE;
+
+CompactTriMesh::CompactTriMesh() {
+}
+
+CompactTriMesh::CompactTriMesh(const string& filename) {
+  readMesh(filename);
+}
+
+CompactTriMesh::CompactTriMesh(const vector<glm::vec3>& points, const vector<int>& indices) {
+  buildTriangulation(points, indices);
+}
+
+CompactTriMesh::CompactTriMesh(const vector<glm::vec3>& points, const vector<uint32_t>& indices) {
+  buildTriangulation(points, indices);
+}
+
+void CompactTriMesh::readMesh(const string& filename) {
+  if(MeshFile::isMeshFile(filename)) {
+    readMeshFile(filename);
+    return;
+  }
+  if(CompressedMeshFile::isCompressedMeshFile(filename)) {
+    readCompressedMeshFile(filename);
+    return;
+  }
+
+  vector<glm::vec3> points;
+  vector<uint32_t> indices;
+  parseTextMesh(filename, points, indices);
+  buildTriangulation(points, indices);
+}
+
+void CompactTriMesh::readMeshFile(const string& filename) {
+  const MeshFile file(filename);
+  const long Nv = file.getNumNodes();
+  const long Nhe = 3*file.getNumTriangles();
+  if(!file.hasConnectivity()) {
+    buildTriangulation(vector<glm::vec3>(file.getPositions(), file.getPositions() + Nv),
+                       vector<uint32_t>(file.getIndices(), file.getIndices() + Nhe));
+    return;
+  }
+  m_positions.assign(file.getPositions(), file.getPositions() + Nv);
+  m_sources.assign(file.getIndices(), file.getIndices() + Nhe);
+  m_twins.assign(file.getTwins(), file.getTwins() + Nhe);
+  m_leading.assign(file.getLeadingHalfEdges(), file.getLeadingHalfEdges() + Nv);
+
+  // The stored connectivity is used as it is, once it is checked
+  const MeshFile::Header& header = file.getHeader();
+  const long Np = header.m_problem_halfedges_;
+  const uint32_t* problems = file.getProblemHalfEdges();
+  checkConnectivity(filename, problems, Np);
+
+  m_report.m_inner_edges_ = header.m_inner_edges_;
+  m_report.m_boundary_edges_ = header.m_boundary_edges_;
+  m_report.m_nonmanifold_edges_ = header.m_nonmanifold_edges_;
+  m_report.m_misoriented_edges_ = header.m_misoriented_edges_;
+  m_report.m_problem_halfedges_.assign(problems, problems + Np);
+
+  calcBBox();
+  if(file.hasNormals()) {
+    m_normals.assign(file.getNormals(), file.getNormals() + Nv);
+  } else {
+    computeNormals();
+  }
+}
+
+void CompactTriMesh::readCompressedMeshFile(const string& filename) {
+  CompressedMeshFile::read(filename, m_positions, m_sources, m_twins, m_report);
+  const vector<uint32_t>& problems = m_report.m_problem_halfedges_;
+  m_leading.clear();
+  checkConnectivity(filename, problems.empty() ? NULL : &problems[0], problems.size());
+  findLeadingHalfEdges();
+  calcBBox();
+  computeNormals();
+}
+
+void CompactTriMesh::checkConnectivity(const string& filename, const uint32_t* problems,
+                                       size_t Np) const {
+  const long Nhe = m_sources.size();
+  const long Nv = m_positions.size();
+  const long Nl = m_leading.size();
+  long invalid = Nhe % 3 != 0 || (Nl != 0 && Nl != Nv);
+#pragma omp parallel for reduction(+:invalid)
+  for(long he=0; he<Nhe; he++) {
+    invalid += m_sources[he] >= Nv;
+  }
+  if(invalid > 0) {
+    throw runtime_error("CompactTriMesh: invalid indices in " + filename);
+  }
+  // The sources are valid now, so the twins can be compared by their nodes
+#pragma omp parallel for reduction(+:invalid)
+  for(long he=0; he<Nhe; he++) {
+    const uint32_t twin = m_twins[he];
+    invalid += twin != NONE && (twin >= Nhe || m_twins[twin] != he ||
+                                m_sources[twin] != getDestinationNode(he));
+  }
+#pragma omp parallel for reduction(+:invalid)
+  for(long v=0; v<Nl; v++) {
+    invalid += m_leading[v] != NONE && (m_leading[v] >= Nhe || m_sources[m_leading[v]] != v);
+  }
+#pragma omp parallel for reduction(+:invalid)
+  for(long i=0; i<long(Np); i++) {
+    invalid += problems[i] >= Nhe;
+  }
+  if(invalid > 0) {
+    throw runtime_error("CompactTriMesh: invalid indices in " + filename);
+  }
+}
+
+void CompactTriMesh::writeMesh(const string& filename) const {
+  if(MeshFile::isMeshFile(filename)) {
+    MeshFile::write(filename, *this);
+    return;
+  }
+  if(CompressedMeshFile::isCompressedMeshFile(filename)) {
+    CompressedMeshFile::write(filename, *this);
+    return;
+  }
+
+  std::ofstream out(filename.c_str(), std::ios::out);
+  if(!out.good()) {
+    throw runtime_error("Error writing to " + filename);
+  }
+  out.precision(9);
+  out << getNumNodes() << " " << getNumTriangles() << "\n";
+  for(size_t i=0; i<m_positions.size(); i++) {
+    out << m_positions[i].x << " " << m_positions[i].y << " " << m_positions[i].z << "\n";
+  }
+  for(size_t i=0; i<m_sources.size(); i+=3) {
+    out << m_sources[i] << " " << m_sources[i+1] << " " << m_sources[i+2] << "\n";
+  }
+  if(!out.good()) {
+    throw runtime_error("Error writing to " + filename);
+  }
+}
+
+template <class Index>
+void CompactTriMesh::buildTriangulation(const vector<glm::vec3>& points, const vector<Index>& indices) {
+  if(indices.size() % 3 != 0 || indices.size() >= NONE) {
+    throw runtime_error("CompactTriMesh: invalid number of triangle indices");
+  }
+  for(size_t i=0; i<indices.size(); i++) {
+    if(indices[i] < Index(0) || size_t(indices[i]) >= points.size()) {
+      throw runtime_error("CompactTriMesh: triangle index out of range");
+    }
+  }
+
+  m_positions = points;
+  m_sources.assign(indices.begin(), indices.end());
+
+  buildConnectivity();
+
+  calcBBox();
+  computeNormals();
+}
+
+void CompactTriMesh::calcBBox() {
+  if(m_positions.size() == 0) {
+    return;
+  }
+  m_bbox_min = m_bbox_max = m_positions[0];
+  for(size_t j=1; j<m_positions.size(); j++) {
+    const glm::vec3& p = m_positions[j];
+
+    for(size_t i=0; i<3; i++) {
+      m_bbox_min[i] = p[i] < m_bbox_min[i] ? p[i] : m_bbox_min[i];
+      m_bbox_max[i] = p[i] > m_bbox_max[i] ? p[i] : m_bbox_max[i];
+    }
+  }
+}
+
+void CompactTriMesh::buildConnectivity() {
+  const long Nhe = m_sources.size();
+  const long Nv = m_positions.size();
+
+  // Counting sort of the half-edges by their smallest node index. Each
+  // bucket holds the other node index and the half-edge.
+  vector<uint32_t> offsets(Nv+1, 0);
+#pragma omp parallel for
+  for(long he=0; he<Nhe; he++) {
+    uint32_t a = std::min(getSourceNode(he), getDestinationNode(he));
+#pragma omp atomic
+    offsets[a+1]++;
+  }
+  for(long v=0; v<Nv; v++) {
+    offsets[v+1] += offsets[v];
+  }
+
+  vector<uint32_t> fill(offsets.begin(), offsets.end()-1);
+  vector<std::pair<uint32_t, uint32_t> > buckets(Nhe);
+#pragma omp parallel for
+  for(long he=0; he<Nhe; he++) {
+    uint32_t a = getSourceNode(he);
+    uint32_t b = getDestinationNode(he);
+    uint32_t slot;
+#pragma omp atomic capture
+    slot = fill[std::min(a, b)]++;
+    buckets[slot] = std::make_pair(std::max(a, b), uint32_t(he));
+  }
+
+  // Within a bucket, the half-edges of an edge have the same other node.
+  // Only edges with exactly two oppositely oriented half-edges are inner
+  // edges, boundary and non-manifold edges get no twins.
+  m_twins.assign(Nhe, NONE);
+  size_t inner = 0, boundary = 0, nonmanifold = 0, misoriented = 0;
+  vector<uint32_t> problems;
+#pragma omp parallel reduction(+:inner,boundary,nonmanifold,misoriented)
+  {
+    vector<uint32_t> local_problems;
+#pragma omp for schedule(dynamic, 1024)
+    for(long v=0; v<Nv; v++) {
+      // Sorting makes the result independent of the fill order
+      std::sort(buckets.begin()+offsets[v], buckets.begin()+offsets[v+1]);
+      for(uint32_t i=offsets[v]; i<offsets[v+1]; ) {
+        uint32_t j = i+1;
+        while(j < offsets[v+1] && buckets[j].first == buckets[i].first) {
+          j++;
+        }
+        uint32_t he0 = buckets[i].second;
+        if(j-i == 1) {
+          boundary++;
+        } else if(j-i == 2) {
+          uint32_t he1 = buckets[i+1].second;
+          if(getSourceNode(he0) == getDestinationNode(he1)) {
+            m_twins[he0] = he1;
+            m_twins[he1] = he0;
+            inner++;
+          } else {
+            local_problems.push_back(he0);
+            misoriented++;
+          }
+        } else {
+          local_problems.push_back(he0);
+          nonmanifold++;
+        }
+        i = j;
+      }
+    }
+#pragma omp critical
+    problems.insert(problems.end(), local_problems.begin(), local_problems.end());
+  }
+  std::sort(problems.begin(), problems.end());
+
+  m_report.m_inner_edges_ = inner;
+  m_report.m_boundary_edges_ = boundary;
+  m_report.m_nonmanifold_edges_ = nonmanifold;
+  m_report.m_misoriented_edges_ = misoriented;
+  m_report.m_problem_halfedges_.swap(problems);
+
+  findLeadingHalfEdges();
+}
+
+void CompactTriMesh::findLeadingHalfEdges() {
+  const long Nhe = m_sources.size();
+  const long Nv = m_positions.size();
+
+  // Use the first half-edge from each node, rewound to the first half-edge
+  // in anti-clockwise order for boundary nodes
+  m_leading.assign(Nv, NONE);
+  for(long he=Nhe-1; he>=0; he--) {
+    m_leading[m_sources[he]] = he;
+  }
+#pragma omp parallel for
+  for(long v=0; v<Nv; v++) {
+    uint32_t he = m_leading[v];
+    if(he == NONE) {
+      continue;
+    }
+    uint32_t prev = getVtxRingPrev(he);
+    while(prev != NONE && prev != m_leading[v]) {
+      he = prev;
+      prev = getVtxRingPrev(he);
+    }
+    m_leading[v] = he;
+  }
+}
+
+size_t CompactTriMesh::getValence(uint32_t v) const {
+  const uint32_t first = m_leading[v];
+  if(first == NONE) {
+    return 0;
+  }
+  size_t valence = 0;
+  uint32_t he = first;
+  do {
+    valence++;
+    he = getVtxRingNext(he);
+  } while(he != NONE && he != first);
+
+  // The last edge of a boundary node has no half-edge leaving the node
+  return he == NONE ? valence+1 : valence;
+}
+
+void CompactTriMesh::computeNormals(NormalWeighting weighting) {
+  const long Nv = m_positions.size();
+  const long Nt = getNumTriangles();
+  const long batch_size = 1024;
+  const glm::vec3* p = Nv == 0 ? NULL : &m_positions[0];
+  const uint32_t* sources = Nt == 0 ? NULL : &m_sources[0];
+
+  // Triangle normals, of length twice the area for area weights and of
+  // unit length otherwise, and the angles at the corners for angle weights
+  vector<float> nx(Nt), ny(Nt), nz(Nt);
+  vector<float> angles(weighting == ANGLE_WEIGHTS ? 3*Nt : 0);
+  const bool normalize = weighting != AREA_WEIGHTS;
+#pragma omp parallel for
+  for(long b=0; b<Nt; b+=batch_size) {
+    const long end = std::min(Nt, b+batch_size);
+#pragma omp simd
+    for(long t=b; t<end; t++) {
+      const glm::vec3 p0 = p[sources[3*t+0]];
+      const glm::vec3 e1 = p[sources[3*t+1]] - p0;
+      const glm::vec3 e2 = p[sources[3*t+2]] - p0;
+      const float x = e1.y*e2.z - e1.z*e2.y;
+      const float y = e1.z*e2.x - e1.x*e2.z;
+      const float z = e1.x*e2.y - e1.y*e2.x;
+      const float length = std::sqrt(x*x + y*y + z*z);
+      const float scale = !normalize ? 1.0f : (length > 0.0f ? 1.0f/length : 0.0f);
+      nx[t] = scale*x;
+      ny[t] = scale*y;
+      nz[t] = scale*z;
+    }
+    if(weighting == ANGLE_WEIGHTS) {
+      for(long t=b; t<end; t++) {
+        for(uint32_t k=0; k<3; k++) {
+          const glm::vec3& q = p[sources[3*t+k]];
+          const glm::vec3 a = p[sources[3*t+(k+1)%3]] - q;
+          const glm::vec3 c = p[sources[3*t+(k+2)%3]] - q;
+          angles[3*t+k] = std::atan2(glm::length(glm::cross(a, c)), glm::dot(a, c));
+        }
+      }
+    }
+  }
+
+  // Gather around each node from its leading half-edge. Corners that are
+  // not reached that way, at nodes where several fans of triangles meet,
+  // are added afterwards.
+  m_normals.resize(Nv);
+  vector<uint8_t> reached(3*Nt, 0);
+#pragma omp parallel for schedule(dynamic, 1024)
+  for(long v=0; v<Nv; v++) {
+    glm::vec3 N(0.0f);
+    const uint32_t first = m_leading[v];
+    if(first != NONE) {
+      uint32_t he = first;
+      do {
+        const uint32_t t = getTriangle(he);
+        const float w = weighting == ANGLE_WEIGHTS ? angles[he] : 1.0f;
+        N += w*glm::vec3(nx[t], ny[t], nz[t]);
+        reached[he] = 1;
+        he = getVtxRingNext(he);
+      } while(he != NONE && he != first);
+    }
+    m_normals[v] = N;
+  }
+  for(long he=0; he<3*Nt; he++) {
+    if(!reached[he]) {
+      const uint32_t t = getTriangle(he);
+      const float w = weighting == ANGLE_WEIGHTS ? angles[he] : 1.0f;
+      m_normals[m_sources[he]] += w*glm::vec3(nx[t], ny[t], nz[t]);
+    }
+  }
+
+#pragma omp parallel for
+  for(long v=0; v<Nv; v++) {
+    const float length = glm::length(m_normals[v]);
+    if(length > 0.0f) {
+      m_normals[v] /= length;
+    }
+  }
+}
+
+size_t CompactTriMesh::numberEdges(vector<uint32_t>& edges, vector<uint32_t>& first_halfedges) const {
+  // An edge is numbered by its first half-edge. Half-edges without twins
+  // are boundary edges of their own, except on non-manifold and misoriented
+  // edges, where all the half-edges of the edge share the first one.
+  const long Nhe = m_sources.size();
+  vector<uint32_t> first(Nhe);
+#pragma omp parallel for
+  for(long he=0; he<Nhe; he++) {
+    first[he] = m_twins[he] == NONE ? he : std::min(uint32_t(he), m_twins[he]);
+  }
+  if(!m_report.m_problem_halfedges_.empty()) {
+    std::map<uint64_t, uint32_t> problems;
+    for(size_t i=0; i<m_report.m_problem_halfedges_.size(); i++) {
+      problems[edgeKey(m_report.m_problem_halfedges_[i])] = NONE;
+    }
+    for(long he=0; he<Nhe; he++) {
+      if(m_twins[he] == NONE) {
+        std::map<uint64_t, uint32_t>::iterator it = problems.find(edgeKey(he));
+        if(it != problems.end()) {
+          if(it->second == NONE) {
+            it->second = he;
+          }
+          first[he] = it->second;
+        }
+      }
+    }
+  }
+
+  edges.resize(Nhe);
+#pragma omp parallel for
+  for(long he=0; he<Nhe; he++) {
+    edges[he] = first[he] == uint32_t(he) ? 1 : 0;
+  }
+  size_t num_edges = exclusiveScan(edges);
+  first_halfedges.resize(num_edges);
+#pragma omp parallel for
+  for(long he=0; he<Nhe; he++) {
+    if(first[he] == uint32_t(he)) {
+      first_halfedges[edges[he]] = he;
+    }
+  }
+#pragma omp parallel for
+  for(long he=0; he<Nhe; he++) {
+    if(first[he] != uint32_t(he)) {
+      edges[he] = edges[first[he]];
+    }
+  }
+  return num_edges;
+}
+
+CompactTriMesh* CompactTriMesh::extractTriangles(const vector<uint32_t>& triangles) const {
+  const long Nt = triangles.size();
+  CompactTriMesh* mesh = new CompactTriMesh();
+  vector<uint32_t> nodes(m_positions.size(), NONE);
+  vector<uint32_t> halfedges(m_sources.size(), NONE);
+  mesh->m_sources.resize(3*Nt);
+  for(long t=0; t<Nt; t++) {
+    for(uint32_t k=0; k<3; k++) {
+      const uint32_t v = m_sources[3*triangles[t]+k];
+      if(nodes[v] == NONE) {
+        nodes[v] = mesh->m_positions.size();
+        mesh->m_positions.push_back(m_positions[v]);
+      }
+      mesh->m_sources[3*t+k] = nodes[v];
+      halfedges[3*triangles[t]+k] = 3*t+k;
+    }
+  }
+  const long Nv = mesh->m_positions.size();
+
+  mesh->m_twins.resize(3*Nt);
+#pragma omp parallel for
+  for(long he=0; he<3*Nt; he++) {
+    const uint32_t twin = m_twins[3*triangles[he/3] + he%3];
+    mesh->m_twins[he] = twin == NONE ? NONE : halfedges[twin];
+  }
+
+  // Nodes that lost their leading half-edge take the first one left. Fans
+  // that were cut open are rewound to the first half-edge in anti-clockwise
+  // order, closed fans keep their leading half-edge.
+  mesh->m_leading.assign(Nv, NONE);
+  vector<uint8_t> lost(Nv, 0);
+  for(size_t v=0; v<nodes.size(); v++) {
+    if(nodes[v] != NONE) {
+      mesh->m_leading[nodes[v]] = halfedges[m_leading[v]];
+      lost[nodes[v]] = mesh->m_leading[nodes[v]] == NONE;
+    }
+  }
+  for(long he=3*Nt-1; he>=0; he--) {
+    if(lost[mesh->m_sources[he]]) {
+      mesh->m_leading[mesh->m_sources[he]] = he;
+    }
+  }
+#pragma omp parallel for
+  for(long v=0; v<Nv; v++) {
+    uint32_t he = mesh->m_leading[v];
+    uint32_t prev = mesh->getVtxRingPrev(he);
+    while(prev != NONE && prev != mesh->m_leading[v]) {
+      he = prev;
+      prev = mesh->getVtxRingPrev(he);
+    }
+    if(prev == NONE) {
+      mesh->m_leading[v] = he;
+    }
+  }
+
+  // One half-edge left of each non-manifold or misoriented edge
+  ConnectivityReport& report = mesh->m_report;
+  report.m_inner_edges_ = report.m_boundary_edges_ = 0;
+  report.m_nonmanifold_edges_ = report.m_misoriented_edges_ = 0;
+  if(!m_report.m_problem_halfedges_.empty()) {
+    std::map<uint64_t, bool> problems;
+    for(size_t i=0; i<m_report.m_problem_halfedges_.size(); i++) {
+      problems[edgeKey(m_report.m_problem_halfedges_[i])] = false;
+    }
+    for(long he=0; he<3*Nt; he++) {
+      const uint32_t old = 3*triangles[he/3] + he%3;
+      if(m_twins[old] == NONE) {
+        std::map<uint64_t, bool>::iterator it = problems.find(edgeKey(old));
+        if(it != problems.end() && !it->second) {
+          it->second = true;
+          report.m_problem_halfedges_.push_back(he);
+        }
+      }
+    }
+  }
+
+  mesh->calcBBox();
+  mesh->computeNormals();
+  return mesh;
+}
+
+size_t CompactTriMesh::getMemoryUsage() const {
+  return m_positions.size()*sizeof(glm::vec3)
+      + m_normals.size()*sizeof(glm::vec3)
+      + m_leading.size()*sizeof(uint32_t)
+      + m_sources.size()*sizeof(uint32_t)
+      + m_twins.size()*sizeof(uint32_t);
+}
+
+}  // GfxUtil
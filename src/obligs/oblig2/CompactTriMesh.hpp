@@ -0,0 +1,286 @@
+/* CompactTriMesh.hpp
+ *
+ * Distributed under the GNU GPL.
+ */
+
+#ifndef GFXUTIL_COMPACTTRIMESH_H
+#define GFXUTIL_COMPACTTRIMESH_H
+
+#include <vector>
+#include <string>
+#include <stdint.h>
+#include <glm/glm.hpp>
+
+#include "StencilTable.hpp"
+
+namespace GfxUtil {
+
+/** Triangulation data structure using index-based half-edges.
+ *
+ *  This is a compact variant of TriMesh for large meshes. Instead of one
+ *  heap allocated object per node, triangle and half-edge linked together by
+ *  pointers, everything is stored in a few contiguous arrays indexed by
+ *  32-bit integers:
+ *
+ *  - The half-edges of triangle t are 3*t, 3*t+1 and 3*t+2, so the triangle,
+ *    next and previous half-edge are computed from the index alone.
+ *  - The source nodes of the half-edges are stored in triangle order, and
+ *    are thus also the index buffer of the mesh.
+ *  - Twins are stored in a separate array, with NONE on the boundary.
+ *
+ *  Nodes are identified by their index, and half-edges are traversed with
+ *  the same functions as in TriMesh, e.g.
+ *
+ *    uint32_t he = mesh.getLeadingHalfEdge(v);
+ *    do {
+ *      uint32_t neighbour = mesh.getDestinationNode(he);
+ *      he = mesh.getVtxRingNext(he);
+ *    } while(he != CompactTriMesh::NONE && he != mesh.getLeadingHalfEdge(v));
+ */
+class CompactTriMesh {
+ public:
+  /** Index of a missing half-edge, e.g. the twin of a boundary half-edge. */
+  static const uint32_t NONE = 0xffffffffu;
+
+  /** The kinds of edges found when building the connectivity. */
+  struct ConnectivityReport {
+    size_t m_inner_edges_;        ///< Edges shared by two consistently oriented triangles.
+    size_t m_boundary_edges_;     ///< Edges of a single triangle.
+    size_t m_nonmanifold_edges_;  ///< Edges shared by more than two triangles.
+    size_t m_misoriented_edges_;  ///< Edges shared by two triangles of opposite orientation.
+    std::vector<uint32_t> m_problem_halfedges_;  ///< One half-edge of each non-manifold or misoriented edge.
+  };
+
+  /** Default constructor. */
+  CompactTriMesh();
+
+  /** Constructor reading from a *.msh-file. */
+  CompactTriMesh(const std::string& filename);
+
+  /** Constructor from a list of points and triangle indices. */
+  CompactTriMesh(const std::vector<glm::vec3>& points, const std::vector<int>& indices);
+
+  /** Constructor from a list of points and triangle indices. */
+  CompactTriMesh(const std::vector<glm::vec3>& points, const std::vector<uint32_t>& indices);
+
+  /** Reads a mesh from a .msh-file or an .obj-file (see parseTextMesh),
+   *  from a binary .bmsh-file (see MeshFile) or from a compressed .cmsh-file
+   *  (see CompressedMeshFile). Call this if you used the default
+   *  constructor. */
+  void readMesh(const std::string& filename);
+
+  /** Writes the mesh to a .msh-file, to a .bmsh-file with its
+   *  connectivity, so that reading it back skips buildConnectivity(), or to
+   *  a .cmsh-file with 16-bit positions. */
+  void writeMesh(const std::string& filename) const;
+
+  /** Returns the number of nodes. */
+  size_t getNumNodes() const { return m_positions.size(); }
+
+  /** Returns the number of triangles. */
+  size_t getNumTriangles() const { return m_sources.size()/3; }
+
+  /** Returns the number of half-edges, three per triangle. */
+  size_t getNumHalfEdges() const { return m_sources.size(); }
+
+  /** Returns the minimum x,y,z-values of the vertices. */
+  const glm::vec3& getBBoxMin() const { return m_bbox_min; }
+
+  /** Returns the maximum x,y,z-values of the vertices. */
+  const glm::vec3& getBBoxMax() const { return m_bbox_max; }
+
+  /** Returns the position of node v. */
+  const glm::vec3& getPosition(uint32_t v) const { return m_positions[v]; }
+
+  /** Returns the shading normal of node v. */
+  const glm::vec3& getNormal(uint32_t v) const { return m_normals[v]; }
+
+  /** Returns the positions of all nodes. */
+  const std::vector<glm::vec3>& getPositions() const { return m_positions; }
+
+  /** Returns the shading normals of all nodes. */
+  const std::vector<glm::vec3>& getNormals() const { return m_normals; }
+
+  /** Returns the triangle indices, three per triangle. */
+  const std::vector<uint32_t>& getIndices() const { return m_sources; }
+
+  /** Returns the twin of each half-edge. */
+  const std::vector<uint32_t>& getTwins() const { return m_twins; }
+
+  /** Returns the leading half-edge of each node. */
+  const std::vector<uint32_t>& getLeadingHalfEdges() const { return m_leading; }
+
+  /** Returns the triangle of half-edge he. */
+  static uint32_t getTriangle(uint32_t he) { return he/3; }
+
+  /** Returns the next half-edge in the triangle loop. */
+  static uint32_t getNext(uint32_t he) { return (he%3 == 2) ? he-2 : he+1; }
+
+  /** Returns the previous half-edge in the triangle loop. */
+  static uint32_t getPrev(uint32_t he) { return (he%3 == 0) ? he+2 : he-1; }
+
+  /** Returns the twin half-edge in the neighbouring triangle, or NONE. */
+  uint32_t getTwin(uint32_t he) const { return m_twins[he]; }
+
+  /** Returns true if half-edge is part of a boundary edge. */
+  bool isBoundary(uint32_t he) const { return m_twins[he] == NONE; }
+
+  /** Returns the source node of half-edge he. */
+  uint32_t getSourceNode(uint32_t he) const { return m_sources[he]; }
+
+  /** Returns the destination node of half-edge he. */
+  uint32_t getDestinationNode(uint32_t he) const { return m_sources[getNext(he)]; }
+
+  /** Returns the next half-edge from the same node in a counter-clockwise
+   *  order, or NONE at the boundary. */
+  uint32_t getVtxRingNext(uint32_t he) const { return m_twins[getPrev(he)]; }
+
+  /** Returns the next half-edge from the same node in a clockwise order,
+   *  or NONE at the boundary. */
+  uint32_t getVtxRingPrev(uint32_t he) const {
+    uint32_t twin = m_twins[he];
+    return twin == NONE ? NONE : getNext(twin);
+  }
+
+  /** Returns one half-edge from node v, if node is on boundary, it returns
+   *  the first half-edge in anti-clockwise order. NONE for unused nodes. */
+  uint32_t getLeadingHalfEdge(uint32_t v) const { return m_leading[v]; }
+
+  /** Returns true if node v is on boundary. */
+  bool isBoundaryNode(uint32_t v) const {
+    return m_leading[v] != NONE && getVtxRingPrev(m_leading[v]) == NONE;
+  }
+
+  /** Returns the number of edges connected to node v. */
+  size_t getValence(uint32_t v) const;
+
+  /** How the normals of the triangles around a node are weighted. */
+  enum NormalWeighting {
+    UNIFORM_WEIGHTS,  ///< Each triangle counts the same.
+    AREA_WEIGHTS,     ///< Weighted by the area of the triangle.
+    ANGLE_WEIGHTS     ///< Weighted by the angle of the triangle at the node.
+  };
+
+  /** Finds suitable normal vectors for the vertices.
+   *
+   *  The triangle normals are computed in parallel batches, stored as
+   *  separate x, y and z arrays so that the batches vectorize. Each node
+   *  then gathers the normals of the triangles in its 1-ring, so no two
+   *  threads write to the same node.
+   */
+  void computeNormals(NormalWeighting weighting = AREA_WEIGHTS);
+
+  /** Returns a key identifying the edge of half-edge he, the same for
+   *  all half-edges of the edge. */
+  uint64_t edgeKey(uint32_t he) const {
+    uint64_t a = getSourceNode(he);
+    uint64_t b = getDestinationNode(he);
+    return a < b ? (a << 32) | b : (b << 32) | a;
+  }
+
+  /** Numbers the edges of the mesh, in the order of their first half-edge.
+   *  All half-edges of a non-manifold or misoriented edge get the same edge.
+   *  \param edges Set to the edge of each half-edge.
+   *  \param first_halfedges Set to the first half-edge of each edge.
+   *  \return The number of edges. */
+  size_t numberEdges(std::vector<uint32_t>& edges,
+                     std::vector<uint32_t>& first_halfedges) const;
+
+  /** Returns a new mesh of some of the triangles of this mesh.
+   *
+   *  The connectivity is copied rather than built again, so a node whose
+   *  triangles are all kept has the same ring, leading half-edge and
+   *  subdivision stencil as in this mesh, even where several fans meet.
+   *  Twins outside the triangles become NONE, and the problem half-edges
+   *  are kept for the non-manifold and misoriented edges left, but the
+   *  edge counts of the connectivity report are not.
+   *  \param triangles The triangles to keep, which become triangles 0 and
+   *                   on in this order. The nodes are numbered in the order
+   *                   they are first used. */
+  CompactTriMesh* extractTriangles(const std::vector<uint32_t>& triangles) const;
+
+  /** Refines the mesh one step using Loop-subdivision.
+   *
+   *  The topology of the refined mesh, including twins and leading
+   *  half-edges, is derived directly from the half-edges of this mesh, and
+   *  the positions are computed with the stencils of buildLoopStencils(),
+   *  all in parallel. Triangle t is split into the triangles 4*t to 4*t+3,
+   *  the nodes of this mesh keep their indices, and the node inserted on
+   *  edge e gets index getNumNodes()+e.
+   */
+  CompactTriMesh* subdivideLoop() const;
+
+  /** Builds the Loop-subdivision stencils of this mesh, which give the
+   *  node positions of subdivideLoop() from the node positions of this mesh.
+   *  \param first_halfedges The first half-edge of each edge, from numberEdges(). */
+  void buildLoopStencils(const std::vector<uint32_t>& first_halfedges,
+                         StencilTable& stencils) const;
+
+  /** Refines the mesh one step using sqrt(3)-subdivision (Kobbelt,
+   *  "sqrt(3)-subdivision", SIGGRAPH 2000), in place.
+   *
+   *  A node is inserted at the centroid of each triangle, the triangle is
+   *  split in three, and the old inner edges are flipped, all in one
+   *  parallel pass over the half-edge arrays, without building a new mesh
+   *  or its connectivity. Half-edge he of this mesh becomes triangle he,
+   *  the nodes keep their indices, and the node inserted in triangle t gets
+   *  index getNumNodes()+t. Boundary edges are not flipped, and boundary
+   *  nodes are not moved.
+   */
+  void subdivideSqrt3();
+
+  /** Returns the number of bytes used by the mesh arrays. */
+  size_t getMemoryUsage() const;
+
+  /** Returns the kinds of edges found when the connectivity was built. */
+  const ConnectivityReport& getConnectivityReport() const { return m_report; }
+
+ protected:
+  /** Builds the data structure from an indexed point set. */
+  template <class Index>
+  void buildTriangulation(const std::vector<glm::vec3>& points,
+                          const std::vector<Index>& indices);
+
+  /** Reads a binary .bmsh-file, reusing its connectivity if present. */
+  void readMeshFile(const std::string& filename);
+
+  /** Reads a compressed .cmsh-file, with the twins found by the decoder. */
+  void readCompressedMeshFile(const std::string& filename);
+
+  /** Checks connectivity read from filename, so that a damaged file cannot
+   *  make traversals run out of the arrays or around forever: the sources
+   *  must be nodes, the twins mutual and of opposite orientation, and the
+   *  leading half-edges, if any, leave their nodes. Throws
+   *  std::runtime_error otherwise. */
+  void checkConnectivity(const std::string& filename, const uint32_t* problems, size_t Np) const;
+
+  /** Calculates bounding-box. */
+  void calcBBox();
+
+  /** Finds twin half-edges and the leading half-edges of the nodes.
+   *
+   *  The half-edges are bucketed by their smallest node index with a
+   *  counting sort, and the twins are matched within each bucket. This takes
+   *  linear time, runs in parallel with OpenMP, and gives the same result
+   *  no matter where the arrays are allocated or how many threads are used.
+   */
+  void buildConnectivity();
+
+  /** Finds the leading half-edges of the nodes from the twins. */
+  void findLeadingHalfEdges();
+
+  glm::vec3              m_bbox_min;   /// Minimum values of bounding box.
+  glm::vec3              m_bbox_max;   /// Maximum values of bounding box.
+
+  std::vector<glm::vec3> m_positions;  /// Position of each node.
+  std::vector<glm::vec3> m_normals;    /// Shading normal of each node.
+  std::vector<uint32_t>  m_leading;    /// Leading half-edge of each node.
+  std::vector<uint32_t>  m_sources;    /// Source node of each half-edge.
+  std::vector<uint32_t>  m_twins;      /// Twin of each half-edge, or NONE.
+
+  ConnectivityReport     m_report;     /// Edge kinds found by buildConnectivity.
+};
+
+}  // GfxUtil
+
+#endif
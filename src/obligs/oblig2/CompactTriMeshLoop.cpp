@@ -0,0 +1,274 @@
+/* CompactTriMeshLoop.cpp
+ *
+ * Distributed under the GNU GPL.
+ */
+
+#include "CompactTriMesh.hpp"
+#include "ParallelScan.hpp"
+
+#include <cmath>
+#include <stdexcept>
+#include <vector>
+#include <algorithm>
+#include <glm/glm.hpp>
+
+using std::vector;
+
+namespace GfxUtil {
+
+namespace {
+
+/** cos(x) by its Taylor series from the given term on, for |x| <= pi. */
+constexpr double taylorCos(double x, double term, int k) {
+  return k > 20 ? 0.0 : term + taylorCos(x, -term*x*x/((2*k+1)*(2*k+2)), k+1);
+}
+
+constexpr double loopBetaOf(double c, int n) {
+  return (0.625 - c*c)/n;
+}
+
+/** Loop's weight of each neighbour of an inner node with valence n, at
+ *  compile time. */
+constexpr float loopBetaConstant(int n) {
+  return float(loopBetaOf(0.375 + 0.25*taylorCos(2.0*M_PI/n, 1.0, 0), n));
+}
+
+/** The weights of the valences up to max_table_valence, so the stencils
+ *  of most nodes are built without evaluating cos. */
+const size_t max_table_valence = 12;
+constexpr float loop_betas[max_table_valence+1] = {
+  0.0f, 0.0f, 0.0f, loopBetaConstant(3), loopBetaConstant(4), loopBetaConstant(5),
+  loopBetaConstant(6), loopBetaConstant(7), loopBetaConstant(8), loopBetaConstant(9),
+  loopBetaConstant(10), loopBetaConstant(11), loopBetaConstant(12)
+};
+static_assert(loop_betas[3] > 0.1874999f && loop_betas[3] < 0.1875001f, "beta(3) is 3/16");
+static_assert(loop_betas[6] > 0.0624999f && loop_betas[6] < 0.0625001f, "beta(6) is 1/16");
+
+/** Loop's weight of each neighbour of an inner node with valence n. */
+float loopBeta(size_t n) {
+  if(n >= 3 && n <= max_table_valence) {
+    return loop_betas[n];
+  }
+  const float c = 0.375f + 0.25f*std::cos(2.0f*float(M_PI)/n);
+  return (0.625f - c*c)/n;
+}
+
+/** Returns the weighted sum of the coarse values of a stencil with N
+ *  entries and weights known at compile time, without reading the weights
+ *  of the table. */
+template <uint32_t N>
+glm::vec3 applyRegularStencil(const uint32_t* indices, const float (&weights)[N],
+                              const vector<glm::vec3>& coarse) {
+  glm::vec3 value = weights[0]*coarse[indices[0]];
+  for(uint32_t k=1; k<N; k++) {
+    value += weights[k]*coarse[indices[k]];
+  }
+  return value;
+}
+
+/** Applies the Loop-subdivision stencils of buildLoopStencils() to the
+ *  positions. After the first level most nodes are regular, inner nodes of
+ *  valence 6 and nodes on inner edges, and their stencils are applied with
+ *  constant weights, the rest with the weights of the table. The time goes
+ *  to the scattered reads of the coarse positions, so gathering the regular
+ *  nodes into batches of separate x, y and z arrays for SIMD was measured
+ *  to be slower, and is not done. */
+void applyLoopStencils(const StencilTable& stencils, long Nv, const vector<glm::vec3>& coarse,
+                       vector<glm::vec3>& refined) {
+  const long N = stencils.getNumStencils();
+  const uint32_t* offsets = &stencils.m_offsets_[0];
+  const uint32_t* indices = stencils.m_indices_.empty() ? NULL : &stencils.m_indices_[0];
+  constexpr float beta = loop_betas[6];
+  constexpr float vertex_weights[7] = { 1.0f - 6*beta, beta, beta, beta, beta, beta, beta };
+  constexpr float edge_weights[4] = { 0.375f, 0.375f, 0.125f, 0.125f };
+  refined.resize(N);
+#pragma omp parallel for schedule(dynamic, 4096)
+  for(long i=0; i<N; i++) {
+    const uint32_t size = offsets[i+1] - offsets[i];
+    if(i < Nv && size == 7) {
+      refined[i] = applyRegularStencil(indices + offsets[i], vertex_weights, coarse);
+    } else if(i >= Nv && size == 4) {
+      refined[i] = applyRegularStencil(indices + offsets[i], edge_weights, coarse);
+    } else {
+      refined[i] = stencils.apply(coarse, i);
+    }
+  }
+}
+
+}  // namespace
+
+CompactTriMesh* CompactTriMesh::subdivideLoop() const {
+  const long Nv = getNumNodes();
+  const long Nt = getNumTriangles();
+
+  vector<uint32_t> edges, first_halfedges;
+  const size_t Ne = numberEdges(edges, first_halfedges);
+  if(Nv + Ne >= NONE || 12*size_t(Nt) >= NONE) {
+    throw std::runtime_error("CompactTriMesh: refined mesh is too large for 32-bit indices");
+  }
+
+  CompactTriMesh* mesh = new CompactTriMesh();
+  mesh->m_sources.resize(12*Nt);
+  mesh->m_twins.resize(12*Nt);
+  mesh->m_leading.resize(Nv + Ne);
+
+  // Triangle t = (v0, v1, v2) with the new nodes m0, m1, m2 on the edges of
+  // the half-edges 3*t, 3*t+1 and 3*t+2 is split into the corner triangles
+  // 4*t+k = (vk, mk, m(k-1)) and the center triangle 4*t+3 = (m0, m1, m2).
+  // Half-edge 3*t+k is split into the half-edges 3*(4*t+k) and
+  // 3*(4*t+k+1)+2, and the twins of these are the opposite halves of the
+  // twin of 3*t+k.
+#pragma omp parallel for
+  for(long t=0; t<Nt; t++) {
+    uint32_t* sources = &mesh->m_sources[12*t];
+    uint32_t* twins = &mesh->m_twins[12*t];
+    for(uint32_t k=0; k<3; k++) {
+      const uint32_t he = 3*t+k;
+      const uint32_t k1 = (k+1)%3;
+      const uint32_t k2 = (k+2)%3;
+      const uint32_t m = Nv + edges[he];
+
+      sources[3*k+0] = m_sources[he];
+      sources[3*k+1] = m;
+      sources[3*k+2] = Nv + edges[3*t+k2];
+      sources[9+k] = m;
+
+      // Inner edges between the corner triangles and the center triangle
+      twins[3*k+1] = 3*(4*t+3)+k2;
+      twins[9+k2] = 3*(4*t+k)+1;
+
+      // The halves of the edges of the parent triangle
+      const uint32_t twin = m_twins[he];
+      if(twin == NONE) {
+        twins[3*k+0] = NONE;
+        twins[3*k1+2] = NONE;
+      } else {
+        const uint32_t s = getTriangle(twin);
+        const uint32_t l = twin%3;
+        twins[3*k+0] = 3*(4*s+(l+1)%3)+2;
+        twins[3*k1+2] = 3*(4*s+l);
+      }
+
+      // The first half-edge of the edge also gives the leading half-edge of
+      // the new node, which on the boundary is the half towards the next
+      // node, the only one without a twin
+      if(first_halfedges[edges[he]] == he) {
+        mesh->m_leading[m] = 3*(4*t+k1)+2;
+      }
+    }
+  }
+
+  // The leading half-edges of the old nodes are the first halves of their
+  // old leading half-edges
+#pragma omp parallel for
+  for(long v=0; v<Nv; v++) {
+    const uint32_t he = m_leading[v];
+    mesh->m_leading[v] = he == NONE ? NONE : 3*(4*getTriangle(he)+he%3);
+  }
+
+  // Non-manifold and misoriented edges are split in two edges of the same
+  // kind, and are treated as boundaries (creases) by the stencils
+  ConnectivityReport& report = mesh->m_report;
+  report.m_inner_edges_ = 2*m_report.m_inner_edges_ + 3*Nt;
+  report.m_boundary_edges_ = 2*m_report.m_boundary_edges_;
+  report.m_nonmanifold_edges_ = 2*m_report.m_nonmanifold_edges_;
+  report.m_misoriented_edges_ = 2*m_report.m_misoriented_edges_;
+  for(size_t i=0; i<m_report.m_problem_halfedges_.size(); i++) {
+    const uint32_t he = m_report.m_problem_halfedges_[i];
+    report.m_problem_halfedges_.push_back(3*(4*getTriangle(he)+he%3));
+    report.m_problem_halfedges_.push_back(3*(4*getTriangle(he)+(he+1)%3)+2);
+  }
+
+  StencilTable stencils;
+  buildLoopStencils(first_halfedges, stencils);
+  applyLoopStencils(stencils, Nv, m_positions, mesh->m_positions);
+
+  mesh->calcBBox();
+  mesh->computeNormals();
+  return mesh;
+}
+
+void CompactTriMesh::buildLoopStencils(const vector<uint32_t>& first_halfedges,
+                                       StencilTable& stencils) const {
+  const long Nv = getNumNodes();
+  const long Ne = first_halfedges.size();
+
+  // Count the entries of each stencil: the node itself and its neighbours
+  // for old nodes (only the two boundary neighbours on the boundary), and
+  // the two end nodes and the two opposite nodes for new nodes (only the
+  // end nodes on the boundary)
+  vector<uint32_t>& offsets = stencils.m_offsets_;
+  offsets.assign(Nv + Ne + 1, 0);
+#pragma omp parallel for
+  for(long v=0; v<Nv; v++) {
+    if(m_leading[v] == NONE) {
+      offsets[v] = 1;
+    } else if(isBoundaryNode(v)) {
+      offsets[v] = 3;
+    } else {
+      offsets[v] = 1 + getValence(v);
+    }
+  }
+#pragma omp parallel for
+  for(long e=0; e<Ne; e++) {
+    offsets[Nv + e] = m_twins[first_halfedges[e]] == NONE ? 2 : 4;
+  }
+  const uint32_t Nentries = exclusiveScan(offsets);
+  stencils.m_indices_.resize(Nentries);
+  stencils.m_weights_.resize(Nentries);
+  uint32_t* indices = &stencils.m_indices_[0];
+  float* weights = &stencils.m_weights_[0];
+
+  // Old nodes
+#pragma omp parallel for schedule(dynamic, 1024)
+  for(long v=0; v<Nv; v++) {
+    uint32_t j = offsets[v];
+    const uint32_t first = m_leading[v];
+    indices[j] = v;
+    if(first == NONE) {
+      weights[j] = 1.0f;
+    } else if(isBoundaryNode(v)) {
+      // The neighbours along the boundary are the destination of the first
+      // half-edge, and the source of the half-edge before the last one
+      uint32_t last = first;
+      for(uint32_t he = getVtxRingNext(first); he != NONE; he = getVtxRingNext(he)) {
+        last = he;
+      }
+      weights[j] = 0.75f;
+      indices[j+1] = getDestinationNode(first);
+      weights[j+1] = 0.125f;
+      indices[j+2] = getSourceNode(getPrev(last));
+      weights[j+2] = 0.125f;
+    } else {
+      const size_t n = offsets[v+1] - offsets[v] - 1;
+      const float beta = loopBeta(n);
+      weights[j++] = 1.0f - n*beta;
+      uint32_t he = first;
+      do {
+        indices[j] = getDestinationNode(he);
+        weights[j++] = beta;
+        he = getVtxRingNext(he);
+      } while(he != first);
+    }
+  }
+
+  // New nodes
+#pragma omp parallel for
+  for(long e=0; e<Ne; e++) {
+    const uint32_t he = first_halfedges[e];
+    const uint32_t twin = m_twins[he];
+    const uint32_t j = offsets[Nv + e];
+    indices[j+0] = getSourceNode(he);
+    indices[j+1] = getDestinationNode(he);
+    if(twin == NONE) {
+      weights[j+0] = weights[j+1] = 0.5f;
+    } else {
+      weights[j+0] = weights[j+1] = 0.375f;
+      indices[j+2] = getSourceNode(getPrev(he));
+      indices[j+3] = getSourceNode(getPrev(twin));
+      weights[j+2] = weights[j+3] = 0.125f;
+    }
+  }
+}
+
+}  // GfxUtil
@@ -0,0 +1,151 @@
+/* CompactTriMeshSqrt3.cpp
+ *
+ * Distributed under the GNU GPL.
+ */
+
+#include "CompactTriMesh.hpp"
+
+#include <cmath>
+#include <stdexcept>
+#include <vector>
+#include <glm/glm.hpp>
+
+using std::vector;
+
+namespace GfxUtil {
+
+namespace {
+
+/** Kobbelt's smoothing weight of an inner node with valence n. */
+float sqrt3Alpha(size_t n) {
+  return (4.0f - 2.0f*std::cos(2.0f*float(M_PI)/n))/9.0f;
+}
+
+/** Splits triangle t into the triangles 3*t to 3*t+2 and flips its inner
+ *  edges, see CompactTriMesh::subdivideSqrt3(). Only the half-edges of t
+ *  are read, and they are read before the new half-edges are written. */
+void splitSqrt3Triangle(uint32_t t, uint32_t Nv, uint32_t* sources, uint32_t* twins) {
+  const uint32_t NONE = CompactTriMesh::NONE;
+  uint32_t old_sources[3], old_twins[3];
+  for(uint32_t k=0; k<3; k++) {
+    old_sources[k] = sources[3*t+k];
+    old_twins[k] = twins[3*t+k];
+  }
+  for(uint32_t k=0; k<3; k++) {
+    const uint32_t he = 3*t+k;
+    const uint32_t twin = old_twins[k];
+    const uint32_t prev = CompactTriMesh::getPrev(he);
+    const uint32_t prev_twin = old_twins[(k+2)%3];
+    uint32_t* s = &sources[3*he];
+    uint32_t* w = &twins[3*he];
+
+    if(twin == NONE) {
+      // (a, b, c_t), kept
+      s[0] = old_sources[k];
+      s[1] = old_sources[(k+1)%3];
+      w[0] = NONE;
+      w[1] = 3*CompactTriMesh::getNext(he)+2;
+    } else {
+      // (a, c_s, c_t), flipped
+      s[0] = old_sources[k];
+      s[1] = Nv + CompactTriMesh::getTriangle(twin);
+      w[0] = 3*CompactTriMesh::getNext(twin)+2;
+      w[1] = 3*twin+1;
+    }
+    s[2] = Nv + t;
+    w[2] = prev_twin == NONE ? 3*prev+1 : 3*prev_twin;
+  }
+}
+
+}  // namespace
+
+void CompactTriMesh::subdivideSqrt3() {
+  const long Nv = getNumNodes();
+  const long Nt = getNumTriangles();
+  if(Nv + Nt >= NONE || 9*size_t(Nt) >= NONE) {
+    throw std::runtime_error("CompactTriMesh: refined mesh is too large for 32-bit indices");
+  }
+
+  // Insert a node at the centroid of each triangle
+  m_positions.resize(Nv + Nt);
+#pragma omp parallel for
+  for(long t=0; t<Nt; t++) {
+    m_positions[Nv+t] = (m_positions[m_sources[3*t]] + m_positions[m_sources[3*t+1]] +
+                         m_positions[m_sources[3*t+2]])/3.0f;
+  }
+
+  // Half-edge he = (a, b) of triangle t, with the centroid c_t, gives
+  // triangle he of the refined mesh. Inner edges are flipped, so if the twin
+  // of he is in triangle s, the triangle is (a, c_s, c_t), the other half of
+  // the quadrilateral (a, c_s, b, c_t) being given by the twin. Boundary,
+  // non-manifold and misoriented edges are kept, and give (a, b, c_t).
+  //
+  // Every twin of the refined mesh follows from the half-edges of a single
+  // triangle, so each triangle is split and flipped independently of the
+  // others. The half-edges of triangle t are read from 3*t to 3*t+2, and
+  // written to 9*t to 9*t+8 of the same arrays, so the triangles are
+  // processed from the back, in rounds where the half-edges written do not
+  // overlap the ones still to be read.
+  m_sources.resize(9*Nt);
+  m_twins.resize(9*Nt);
+  uint32_t* sources = m_sources.empty() ? NULL : &m_sources[0];
+  uint32_t* twins = m_twins.empty() ? NULL : &m_twins[0];
+  long end = Nt;
+  while(end > 1) {
+    const long begin = (end+2)/3;
+#pragma omp parallel for
+    for(long t=begin; t<end; t++) {
+      splitSqrt3Triangle(t, Nv, sources, twins);
+    }
+    end = begin;
+  }
+  if(Nt > 0) {
+    splitSqrt3Triangle(0, Nv, sources, twins);
+  }
+
+  // Each node keeps the half-edge of the triangle given by its leading
+  // half-edge, which on the boundary is still the first one, and the new
+  // nodes start at their triangle
+  m_leading.resize(Nv + Nt);
+#pragma omp parallel for
+  for(long v=0; v<Nv; v++) {
+    m_leading[v] = m_leading[v] == NONE ? NONE : 3*m_leading[v];
+  }
+#pragma omp parallel for
+  for(long t=0; t<Nt; t++) {
+    m_leading[Nv+t] = 9*t+2;
+  }
+
+  // Smooth the inner old nodes. Their neighbours are now the centroids of
+  // the n triangles around them, which sum to (n*p + 2*sum p_i)/3, so the
+  // sum of the old neighbours p_i is found without a copy of the positions.
+  // Boundary nodes are kept.
+#pragma omp parallel for schedule(dynamic, 1024)
+  for(long v=0; v<Nv; v++) {
+    const uint32_t first = m_leading[v];
+    if(first == NONE || isBoundaryNode(v)) {
+      continue;
+    }
+    glm::vec3 centroids(0.0f);
+    size_t n = 0;
+    uint32_t he = first;
+    do {
+      centroids += m_positions[getDestinationNode(he)];
+      n++;
+      he = getVtxRingNext(he);
+    } while(he != first);
+    const float alpha = sqrt3Alpha(n);
+    m_positions[v] = (1.0f - 1.5f*alpha)*m_positions[v] + (1.5f*alpha/n)*centroids;
+  }
+
+  // Every triangle adds three inner edges, the other edges are kept
+  m_report.m_inner_edges_ += 3*Nt;
+  for(size_t i=0; i<m_report.m_problem_halfedges_.size(); i++) {
+    m_report.m_problem_halfedges_[i] *= 3;
+  }
+
+  calcBBox();
+  computeNormals();
+}
+
+}  // GfxUtil
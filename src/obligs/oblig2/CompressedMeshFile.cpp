@@ -0,0 +1,1009 @@
+/* CompressedMeshFile.cpp
+ *
+ * Distributed under the GNU GPL.
+ */
+
+#include "CompressedMeshFile.hpp"
+
+#include <stdexcept>
+#include <fstream>
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <glm/glm.hpp>
+
+using std::runtime_error;
+using std::string;
+using std::vector;
+
+namespace GfxUtil {
+
+namespace {
+
+const uint32_t compressed_mesh_file_version = 1;
+const uint32_t NONE = CompactTriMesh::NONE;
+
+/** Rice codes with a longer prefix are followed by the value in 32 bits. */
+const uint32_t rice_escape = 24;
+
+/** Zero bytes after the code, more than one triangle can read. */
+const size_t code_padding = 64;
+
+/** How the third node of a triangle relates to the border. */
+enum TraversalCode { CODE_C, CODE_L, CODE_R, CODE_E, CODE_S, CODE_M };
+
+uint32_t next(uint32_t he) { return CompactTriMesh::getNext(he); }
+
+uint32_t prev(uint32_t he) { return CompactTriMesh::getPrev(he); }
+
+/** Appends bits to a byte array, the first bit in the lowest bit. */
+class BitWriter {
+ public:
+  BitWriter() : m_buffer(0), m_count(0) {}
+
+  /** Writes the lowest count bits of bits, count <= 32. */
+  void write(uint32_t bits, uint32_t count) {
+    m_buffer |= uint64_t(bits & (count == 32 ? 0xffffffffu : (1u << count) - 1)) << m_count;
+    m_count += count;
+    while(m_count >= 8) {
+      m_bytes.push_back(uint8_t(m_buffer));
+      m_buffer >>= 8;
+      m_count -= 8;
+    }
+  }
+
+  /** Writes count one bits and a zero bit. */
+  void writeUnary(uint32_t count) {
+    for(; count >= 16; count -= 16) {
+      write(0xffff, 16);
+    }
+    write((1u << count) - 1, count+1);
+  }
+
+  /** Writes a value >= 1 with an Elias gamma code. */
+  void writeGamma(uint32_t value) {
+    uint32_t n = 0;
+    while((value >> n) > 1) {
+      n++;
+    }
+    writeUnary(n);
+    write(value, n);
+  }
+
+  /** Writes the last bits, and returns the bytes. */
+  vector<uint8_t>& finish() {
+    if(m_count > 0) {
+      m_bytes.push_back(uint8_t(m_buffer));
+      m_buffer = 0;
+      m_count = 0;
+    }
+    return m_bytes;
+  }
+
+ protected:
+  vector<uint8_t> m_bytes;   /// The bytes written.
+  uint64_t        m_buffer;  /// Bits not yet written.
+  uint32_t        m_count;   /// Number of bits in m_buffer.
+};
+
+/** Reads the bits of a BitWriter. The array must be followed by
+ *  code_padding zero bytes, so that 64 bits can be loaded without checking
+ *  the size each time, as long as isValid() is checked once per triangle. */
+class BitReader {
+ public:
+  BitReader(const uint8_t* bytes, size_t size) : m_bytes(bytes), m_size(8*uint64_t(size)), m_pos(0) {}
+
+  /** Returns the next 57 or more bits, without reading them. */
+  uint64_t peek() const {
+    uint64_t word;
+    std::memcpy(&word, m_bytes + (m_pos >> 3), 8);
+    return word >> (m_pos & 7);
+  }
+
+  void skip(uint32_t count) { m_pos += count; }
+
+  /** Reads count bits, count <= 32. */
+  uint32_t read(uint32_t count) {
+    const uint32_t bits = uint32_t(peek()) & (count == 32 ? 0xffffffffu : (1u << count) - 1);
+    m_pos += count;
+    return bits;
+  }
+
+  /** Reads the number of one bits before a zero bit, up to max. */
+  uint32_t readUnary(uint32_t max) {
+    const uint64_t ones = ~peek();
+    const uint32_t count = ones == 0 ? 64 : __builtin_ctzll(ones);
+    if(count >= max) {
+      m_pos += max;
+      return max;
+    }
+    m_pos += count+1;
+    return count;
+  }
+
+  uint32_t readGamma() {
+    const uint32_t n = readUnary(32);
+    if(n >= 32) {
+      throw runtime_error("CompressedMeshFile: invalid code");
+    }
+    return (1u << n) | read(n);
+  }
+
+  /** Returns true if no more bits were read than written. */
+  bool isValid() const { return m_pos <= m_size; }
+
+ protected:
+  const uint8_t* m_bytes;  /// The bytes.
+  uint64_t       m_size;   /// Number of bits.
+  uint64_t       m_pos;    /// Next bit to read.
+};
+
+/** Adaptive Rice code, with the parameter following the mean of the
+ *  values coded so far. */
+class RiceCoder {
+ public:
+  RiceCoder() : m_sum(4), m_count(1) {}
+
+  void write(BitWriter& bits, uint32_t value) {
+    const uint32_t k = parameter();
+    const uint32_t q = value >> k;
+    if(q < rice_escape) {
+      bits.writeUnary(q);
+      bits.write(value, k);
+    } else {
+      bits.write((1u << rice_escape) - 1, rice_escape);
+      bits.write(value, 32);
+    }
+    update(value);
+  }
+
+  uint32_t read(BitReader& bits) {
+    const uint32_t k = parameter();
+    const uint32_t q = bits.readUnary(rice_escape);
+    const uint32_t value = q < rice_escape ? (q << k) | bits.read(k) : bits.read(32);
+    update(value);
+    return value;
+  }
+
+ protected:
+  uint32_t parameter() const {
+    uint32_t k = 0;
+    while((uint64_t(m_count) << k) < m_sum && k < 24) {
+      k++;
+    }
+    return k;
+  }
+
+  void update(uint32_t value) {
+    m_sum += value;
+    if(++m_count == 32) {
+      m_sum >>= 1;
+      m_count >>= 1;
+    }
+  }
+
+  uint64_t m_sum;    /// Sum of the recent values.
+  uint32_t m_count;  /// Number of the recent values.
+};
+
+/** Maps a residual to an unsigned value, small for small residuals. */
+uint32_t zigzag(int32_t value) { return (uint32_t(value) << 1) ^ uint32_t(value >> 31); }
+
+int32_t unzigzag(uint32_t value) { return int32_t(value >> 1) ^ -int32_t(value & 1); }
+
+/** Predicts the quantized position of the third node of the triangle
+ *  across the edge from a to b, with c the third node of the triangle on
+ *  this side. Nodes of holes are NONE, and are left out of the prediction.
+ *  \param last The prediction if a and b are both NONE. */
+void predictPosition(const vector<int32_t>& q, uint32_t a, uint32_t b, uint32_t c,
+                     const int32_t* last, int32_t* prediction) {
+  // Computed with wraparound, as the positions of a damaged file may be
+  // anything; for valid positions the sums are small and the result is the
+  // same
+  for(uint32_t i=0; i<3; i++) {
+    if(a != NONE && b != NONE) {
+      const uint32_t qa = q[3*a+i];
+      const uint32_t qb = q[3*b+i];
+      prediction[i] = c != NONE ? int32_t(qa + qb - uint32_t(q[3*c+i])) : int32_t((qa + qb) >> 1);
+    } else if(a != NONE || b != NONE) {
+      prediction[i] = q[3*(a != NONE ? a : b)+i];
+    } else {
+      prediction[i] = last[i];
+    }
+  }
+}
+
+/** The part of a file after the header, in the order of the file. */
+struct FileBlocks {
+  vector<uint32_t> m_exceptions_;  ///< Fan and node, NONE for holes, of each exception.
+  vector<uint32_t> m_twin_pairs_;  ///< Pairs of twin half-edges of degenerate triangles.
+  vector<uint32_t> m_problems_;    ///< Problem half-edges of the connectivity report.
+};
+
+/** Codes a mesh, see CompressedMeshFile.
+ *
+ *  The holes are closed by triangles Nt to Nt+Nh-1, one for each boundary
+ *  half-edge, so that every half-edge has a twin. The border of the visited
+ *  region is a set of loops of half-edges of visited triangles with
+ *  unvisited twins, linked in order. The current loop is traversed, the
+ *  others wait on a stack.
+ */
+class Encoder {
+ public:
+  Encoder(const CompactTriMesh& mesh, uint32_t position_bits, CompressedMeshFile::Header& header,
+          FileBlocks& blocks);
+
+  /** Codes the mesh and returns the code. */
+  vector<uint8_t>& encode();
+
+ protected:
+  /** Starts a new component at triangle t. */
+  void startComponent(uint32_t t);
+
+  /** Codes the triangle across the gate. */
+  void step();
+
+  /** Marks triangle t visited, and numbers it, entered by half-edge he. */
+  void visit(uint32_t t, uint32_t he);
+
+  /** Codes the node of half-edge he, seen for the first time in its fan. */
+  void addFan(uint32_t he, const int32_t* prediction);
+
+  /** Returns a half-edge of the border from the node of e2, found by
+   *  rotating around it from the triangle of e1 and e2, or NONE if no
+   *  triangle around it is visited. */
+  uint32_t findBorder(uint32_t e1, uint32_t e2) const;
+
+  /** Continues with the loop on top of the stack. */
+  void popLoop();
+
+  void link(uint32_t a, uint32_t b) {
+    m_next[a] = b;
+    m_prev[b] = a;
+  }
+
+  const CompactTriMesh&        m_mesh;        /// The mesh.
+  CompressedMeshFile::Header&  m_header;      /// Counts of the file.
+  FileBlocks&                  m_blocks;      /// Lists of the file.
+  uint32_t                     m_bits;        /// Bits per coordinate.
+  vector<int32_t>              m_quantized;   /// Quantized x,y,z of each node.
+  vector<uint32_t>             m_sources;     /// Source of each half-edge, NONE in holes.
+  vector<uint32_t>             m_twins;       /// Twin of each half-edge, holes included.
+  vector<uint8_t>              m_visited;     /// Visited triangles.
+  vector<uint32_t>             m_decoded;     /// Half-edge in the decoded mesh.
+  vector<uint32_t>             m_nodes;       /// Node in the decoded mesh.
+  vector<uint32_t>             m_next;        /// Next half-edge of the border.
+  vector<uint32_t>             m_prev;        /// Previous half-edge of the border.
+  vector<uint32_t>             m_loops;       /// Loop of each half-edge of the border.
+  vector<std::pair<uint32_t, uint32_t> > m_stack;  /// Gate and loop of waiting loops.
+  uint32_t                     m_gate;        /// Gate of the current loop, or NONE.
+  uint32_t                     m_loop;        /// The current loop.
+  uint32_t                     m_num_loops;   /// Loops created.
+  uint32_t                     m_num_triangles;  /// Real triangles visited.
+  uint32_t                     m_num_nodes;   /// Nodes numbered.
+  uint64_t                     m_num_fans;    /// Fans seen.
+  int32_t                      m_last[3];     /// Last new position.
+  RiceCoder                    m_coders[3];   /// Residuals of x, y and z.
+  BitWriter                    m_code;        /// The code.
+};
+
+Encoder::Encoder(const CompactTriMesh& mesh, uint32_t position_bits,
+                 CompressedMeshFile::Header& header, FileBlocks& blocks)
+    : m_mesh(mesh), m_header(header), m_blocks(blocks), m_bits(position_bits), m_gate(NONE),
+      m_loop(0), m_num_loops(0), m_num_triangles(0), m_num_nodes(0), m_num_fans(0) {
+  const long Nv = mesh.getNumNodes();
+  const long Nt = mesh.getNumTriangles();
+  m_last[0] = m_last[1] = m_last[2] = 0;
+
+  // Quantize on a grid with the same step along each axis
+  const glm::vec3 origin = mesh.getBBoxMin();
+  const glm::vec3 extent = mesh.getBBoxMax() - origin;
+  const float size = std::max(extent.x, std::max(extent.y, extent.z));
+  const int32_t max_value = (1 << position_bits) - 1;
+  const float step = size > 0.0f ? size/max_value : 1.0f;
+  m_quantized.resize(3*Nv);
+#pragma omp parallel for
+  for(long v=0; v<Nv; v++) {
+    for(uint32_t i=0; i<3; i++) {
+      const float value = std::floor((mesh.getPosition(v)[i] - origin[i])/step + 0.5f);
+      m_quantized[3*v+i] = std::min(max_value, std::max(0, int32_t(value)));
+    }
+  }
+  for(uint32_t i=0; i<3; i++) {
+    header.m_origin_[i] = origin[i];
+  }
+  header.m_step_ = step;
+
+  // Degenerate triangles may be twins of themselves, and are cut loose
+  m_twins.assign(mesh.getTwins().begin(), mesh.getTwins().end());
+  for(long t=0; t<Nt; t++) {
+    const uint32_t a = mesh.getSourceNode(3*t);
+    const uint32_t b = mesh.getSourceNode(3*t+1);
+    const uint32_t c = mesh.getSourceNode(3*t+2);
+    if(a != b && b != c && c != a) {
+      continue;
+    }
+    for(uint32_t k=0; k<3; k++) {
+      const uint32_t twin = m_twins[3*t+k];
+      if(twin != NONE) {
+        blocks.m_twin_pairs_.push_back(3*t+k);
+        blocks.m_twin_pairs_.push_back(twin);
+        m_twins[3*t+k] = NONE;
+        m_twins[twin] = NONE;
+      }
+    }
+  }
+
+  // Close the holes: boundary half-edge he = (a, b) gets the triangle
+  // (b, a, hole), whose last half-edge is the twin of the first half-edge
+  // from the hole of the next boundary half-edge around b
+  const uint32_t Nhe = 3*Nt;
+  vector<uint32_t> holes(Nhe, NONE);
+  uint32_t Nh = 0;
+  for(uint32_t he=0; he<Nhe; he++) {
+    if(m_twins[he] == NONE) {
+      holes[he] = Nt + Nh++;
+    }
+  }
+  m_sources.assign(mesh.getIndices().begin(), mesh.getIndices().end());
+  m_sources.resize(3*(Nt+Nh), NONE);
+  m_twins.resize(3*(Nt+Nh), NONE);
+  for(uint32_t he=0; he<Nhe; he++) {
+    if(holes[he] == NONE) {
+      continue;
+    }
+    const uint32_t h = 3*holes[he];
+    uint32_t out = next(he);
+    while(m_twins[out] != NONE && m_twins[out] < Nhe) {
+      out = next(m_twins[out]);
+    }
+    m_sources[h] = mesh.getDestinationNode(he);
+    m_sources[h+1] = mesh.getSourceNode(he);
+    m_twins[he] = h;
+    m_twins[h] = he;
+    m_twins[h+2] = 3*holes[out]+1;
+    m_twins[3*holes[out]+1] = h+2;
+  }
+  header.m_hole_triangles_ = Nh;
+
+  m_visited.assign(Nt+Nh, 0);
+  m_decoded.assign(Nhe, NONE);
+  m_nodes.assign(Nv, NONE);
+  m_next.assign(3*(Nt+Nh), NONE);
+  m_prev.assign(3*(Nt+Nh), NONE);
+  m_loops.assign(3*(Nt+Nh), NONE);
+}
+
+vector<uint8_t>& Encoder::encode() {
+  const uint32_t Nt = m_mesh.getNumTriangles();
+  const uint32_t Nv = m_mesh.getNumNodes();
+  for(uint32_t t=0; t<Nt; t++) {
+    if(m_visited[t]) {
+      continue;
+    }
+    startComponent(t);
+    while(m_gate != NONE) {
+      step();
+    }
+  }
+
+  // Nodes without triangles follow, with their positions as they are
+  for(uint32_t v=0; v<Nv; v++) {
+    if(m_nodes[v] == NONE) {
+      m_nodes[v] = m_num_nodes++;
+      for(uint32_t i=0; i<3; i++) {
+        m_code.write(m_quantized[3*v+i], m_bits);
+      }
+    }
+  }
+  m_header.m_fans_ = m_num_fans;
+  m_header.m_exceptions_ = m_blocks.m_exceptions_.size()/2;
+
+  for(size_t i=0; i<m_blocks.m_twin_pairs_.size(); i++) {
+    m_blocks.m_twin_pairs_[i] = m_decoded[m_blocks.m_twin_pairs_[i]];
+  }
+
+  // The problem half-edges are the first of their edges in the new order,
+  // as buildConnectivity() would have found them
+  const vector<uint32_t>& problems = m_mesh.getConnectivityReport().m_problem_halfedges_;
+  if(!problems.empty()) {
+    vector<uint32_t> edges, first_halfedges;
+    const size_t Ne = m_mesh.numberEdges(edges, first_halfedges);
+    vector<uint32_t> first(Ne, NONE);
+    for(size_t he=0; he<edges.size(); he++) {
+      first[edges[he]] = std::min(first[edges[he]], m_decoded[he]);
+    }
+    for(size_t i=0; i<problems.size(); i++) {
+      m_blocks.m_problems_.push_back(first[edges[problems[i]]]);
+    }
+    std::sort(m_blocks.m_problems_.begin(), m_blocks.m_problems_.end());
+  }
+  return m_code.finish();
+}
+
+void Encoder::startComponent(uint32_t t) {
+  visit(t, 3*t);
+  for(uint32_t k=0; k<3; k++) {
+    addFan(3*t+k, m_last);
+    m_loops[3*t+k] = m_num_loops;
+  }
+  link(3*t, 3*t+1);
+  link(3*t+1, 3*t+2);
+  link(3*t+2, 3*t);
+  m_gate = 3*t;
+  m_loop = m_num_loops++;
+}
+
+void Encoder::step() {
+  // The triangle across the gate g = (v0, v1) is (v1, v0, w), with the
+  // half-edges h, e1 = (v0, w) and e2 = (w, v1)
+  const uint32_t g = m_gate;
+  const uint32_t h = m_twins[g];
+  const uint32_t e1 = next(h);
+  const uint32_t e2 = prev(h);
+  const uint32_t before = m_prev[g];
+  const uint32_t after = m_next[g];
+  visit(h/3, h);
+  m_loops[e1] = m_loops[e2] = m_loop;
+
+  const bool left = m_twins[e1] == before;
+  const bool right = m_twins[e2] == after;
+  if(left && right) {
+    m_code.write(11, 4);
+    popLoop();
+  } else if(left) {
+    m_code.write(3, 4);
+    link(m_prev[before], e2);
+    link(e2, after);
+    m_gate = e2;
+  } else if(right) {
+    m_code.write(1, 2);
+    link(before, e1);
+    link(e1, m_next[after]);
+    m_gate = e1;
+  } else {
+    const uint32_t out = findBorder(e1, e2);
+    if(out == NONE) {
+      m_code.write(0, 1);
+      int32_t prediction[3];
+      predictPosition(m_quantized, m_sources[g], m_sources[next(g)], m_sources[prev(g)],
+                      m_last, prediction);
+      addFan(e2, prediction);
+      link(before, e1);
+      link(e1, e2);
+      link(e2, after);
+      m_gate = e2;
+      return;
+    }
+
+    if(m_loops[out] == m_loop) {
+      // Split into the loops e2 ... in and e1, out ... before, the second
+      // waits. The shorter side is walked, and gets a new loop.
+      uint32_t forward = after, backward = before, distance = 1;
+      while(forward != out && backward != out) {
+        forward = m_next[forward];
+        backward = m_prev[backward];
+        distance++;
+      }
+      m_code.write(7, 4);
+      m_code.write(forward == out, 1);
+      m_code.writeGamma(distance);
+      const uint32_t loop = m_num_loops++;
+      if(forward == out) {
+        for(uint32_t he=after; he!=out; he=m_next[he]) {
+          m_loops[he] = loop;
+        }
+        m_loops[e2] = loop;
+        m_stack.push_back(std::make_pair(e1, m_loop));
+        m_loop = loop;
+      } else {
+        for(uint32_t he=out; he!=g; he=m_next[he]) {
+          m_loops[he] = loop;
+        }
+        m_loops[e1] = loop;
+        m_stack.push_back(std::make_pair(e1, loop));
+      }
+    } else {
+      // Merge the loop of out into this one, e1, out ... in, e2 ... before
+      size_t i = 0;
+      while(m_stack[i].second != m_loops[out]) {
+        i++;
+      }
+      uint32_t forward = m_stack[i].first, backward = forward, distance = 1;
+      while(forward != out && backward != out) {
+        forward = m_next[forward];
+        backward = m_prev[backward];
+        distance++;
+      }
+      m_code.write(15, 4);
+      m_code.writeGamma(m_stack.size()-i);
+      m_code.write(forward == out, 1);
+      m_code.writeGamma(distance);
+      uint32_t he = out;
+      do {
+        m_loops[he] = m_loop;
+        he = m_next[he];
+      } while(he != out);
+      m_stack.erase(m_stack.begin()+i);
+    }
+    const uint32_t in = m_prev[out];
+    link(before, e1);
+    link(e1, out);
+    link(in, e2);
+    link(e2, after);
+    m_gate = e2;
+  }
+}
+
+void Encoder::visit(uint32_t t, uint32_t he) {
+  m_visited[t] = 1;
+  if(t < m_mesh.getNumTriangles()) {
+    const uint32_t first = 3*m_num_triangles++;
+    m_decoded[he] = first;
+    m_decoded[next(he)] = first+1;
+    m_decoded[prev(he)] = first+2;
+  }
+}
+
+void Encoder::addFan(uint32_t he, const int32_t* prediction) {
+  const uint32_t v = m_sources[he];
+  if(v == NONE || m_nodes[v] != NONE) {
+    m_blocks.m_exceptions_.push_back(m_num_fans);
+    m_blocks.m_exceptions_.push_back(v == NONE ? NONE : m_nodes[v]);
+  } else {
+    m_nodes[v] = m_num_nodes++;
+    for(uint32_t i=0; i<3; i++) {
+      m_coders[i].write(m_code, zigzag(int32_t(uint32_t(m_quantized[3*v+i]) - uint32_t(prediction[i]))));
+      m_last[i] = m_quantized[3*v+i];
+    }
+  }
+  m_num_fans++;
+}
+
+uint32_t Encoder::findBorder(uint32_t e1, uint32_t e2) const {
+  uint32_t he = m_twins[e1];
+  while(he != e2) {
+    if(m_visited[he/3]) {
+      return he;
+    }
+    he = m_twins[prev(he)];
+  }
+  return NONE;
+}
+
+void Encoder::popLoop() {
+  if(m_stack.empty()) {
+    m_gate = NONE;
+    return;
+  }
+  m_gate = m_stack.back().first;
+  m_loop = m_stack.back().second;
+  m_stack.pop_back();
+}
+
+/** Decodes the traversal of an Encoder. The triangles are numbered in the
+ *  order they are decoded, holes included, and the triangle decoded across
+ *  gate g = (v0, v1) is (v1, v0, w), so its half-edges are found the same
+ *  way as in the Encoder. */
+class Decoder {
+ public:
+  Decoder(const CompressedMeshFile::Header& header, const FileBlocks& blocks,
+          const uint8_t* code, vector<glm::vec3>& positions, vector<uint32_t>& indices,
+          vector<uint32_t>& twins);
+
+  /** Decodes the mesh, throws std::runtime_error if the code is invalid. */
+  void decode();
+
+ protected:
+  /** Starts a new component. */
+  void startComponent();
+
+  /** Decodes the triangle across the gate. */
+  void step();
+
+  /** Returns the next triangle. */
+  uint32_t addTriangle();
+
+  /** Sets the nodes of triangle t, and numbers it if it is not a hole. */
+  void setNodes(uint32_t t, uint32_t a, uint32_t b, uint32_t c);
+
+  /** Returns the node of the next fan. */
+  uint32_t addFan(const int32_t* prediction);
+
+  /** Makes a and b twins, if both are in real triangles. */
+  void pair(uint32_t a, uint32_t b) {
+    const uint32_t ta = m_triangles[a/3];
+    const uint32_t tb = m_triangles[b/3];
+    if(ta != NONE && tb != NONE) {
+      m_twins[3*ta+a%3] = 3*tb+b%3;
+      m_twins[3*tb+b%3] = 3*ta+a%3;
+    }
+  }
+
+  void link(uint32_t a, uint32_t b) {
+    m_next[a] = b;
+    m_prev[b] = a;
+  }
+
+  void fail() const { throw runtime_error("CompressedMeshFile: invalid code"); }
+
+  const CompressedMeshFile::Header&  m_header;     /// Counts of the file.
+  const FileBlocks&        m_blocks;       /// Lists of the file.
+  vector<glm::vec3>&       m_positions;    /// The decoded positions.
+  vector<uint32_t>&        m_indices;      /// The decoded triangles.
+  vector<uint32_t>&        m_twins;        /// The decoded twins.
+  BitReader                m_code;         /// The code.
+  vector<int32_t>          m_quantized;    /// Quantized x,y,z of each node.
+  vector<uint32_t>         m_sources;      /// Source of each half-edge, NONE in holes.
+  vector<uint32_t>         m_triangles;    /// Real triangle of each triangle, or NONE.
+  vector<uint32_t>         m_next;         /// Next half-edge of the border.
+  vector<uint32_t>         m_prev;         /// Previous half-edge of the border.
+  vector<uint32_t>         m_stack;        /// Gates of waiting loops.
+  uint32_t                 m_gate;         /// Gate of the current loop, or NONE.
+  uint32_t                 m_num_all;      /// Triangles decoded, holes included.
+  uint32_t                 m_num_triangles;  /// Real triangles decoded.
+  uint32_t                 m_num_nodes;    /// Nodes decoded.
+  uint64_t                 m_num_fans;     /// Fans decoded.
+  size_t                   m_exception;    /// Next exception.
+  int32_t                  m_last[3];      /// Last new position.
+  RiceCoder                m_coders[3];    /// Residuals of x, y and z.
+};
+
+Decoder::Decoder(const CompressedMeshFile::Header& header, const FileBlocks& blocks,
+                 const uint8_t* code, vector<glm::vec3>& positions, vector<uint32_t>& indices,
+                 vector<uint32_t>& twins)
+    : m_header(header), m_blocks(blocks), m_positions(positions), m_indices(indices),
+      m_twins(twins), m_code(code, header.m_code_bytes_), m_gate(NONE), m_num_all(0),
+      m_num_triangles(0), m_num_nodes(0), m_num_fans(0), m_exception(0) {
+  const size_t Nv = header.m_nodes_;
+  const size_t Nt = header.m_triangles_;
+  const size_t Nall = Nt + header.m_hole_triangles_;
+  m_last[0] = m_last[1] = m_last[2] = 0;
+  m_quantized.resize(3*Nv);
+  m_sources.resize(3*Nall);
+  m_triangles.resize(Nall);
+  m_next.resize(3*Nall);
+  m_prev.resize(3*Nall);
+  m_indices.resize(3*Nt);
+  m_twins.assign(3*Nt, NONE);
+}
+
+void Decoder::decode() {
+  const long Nv = m_header.m_nodes_;
+  const uint32_t Nt = m_header.m_triangles_;
+  while(m_num_triangles < Nt) {
+    startComponent();
+    while(m_gate != NONE) {
+      step();
+    }
+  }
+  if(m_num_all != m_sources.size()/3 || m_num_fans != m_header.m_fans_ ||
+     m_exception != m_blocks.m_exceptions_.size()) {
+    fail();
+  }
+
+  const uint32_t bits = m_header.m_position_bits_;
+  for(; m_num_nodes<Nv; m_num_nodes++) {
+    if(!m_code.isValid()) {
+      fail();
+    }
+    for(uint32_t i=0; i<3; i++) {
+      m_quantized[3*m_num_nodes+i] = m_code.read(bits);
+    }
+  }
+  if(!m_code.isValid()) {
+    fail();
+  }
+
+  const glm::vec3 origin(m_header.m_origin_[0], m_header.m_origin_[1], m_header.m_origin_[2]);
+  const float step = m_header.m_step_;
+  m_positions.resize(Nv);
+#pragma omp parallel for
+  for(long v=0; v<Nv; v++) {
+    m_positions[v] = origin + step*glm::vec3(float(m_quantized[3*v]), float(m_quantized[3*v+1]),
+                                             float(m_quantized[3*v+2]));
+  }
+
+  const vector<uint32_t>& pairs = m_blocks.m_twin_pairs_;
+  for(size_t i=0; i<pairs.size(); i+=2) {
+    if(pairs[i] >= 3*Nt || pairs[i+1] >= 3*Nt) {
+      fail();
+    }
+    m_twins[pairs[i]] = pairs[i+1];
+    m_twins[pairs[i+1]] = pairs[i];
+  }
+}
+
+void Decoder::startComponent() {
+  const uint32_t t = addTriangle();
+  const uint32_t a = addFan(m_last);
+  const uint32_t b = addFan(m_last);
+  const uint32_t c = addFan(m_last);
+  setNodes(t, a, b, c);
+  if(m_triangles[t] == NONE) {
+    fail();
+  }
+  link(3*t, 3*t+1);
+  link(3*t+1, 3*t+2);
+  link(3*t+2, 3*t);
+  m_gate = 3*t;
+}
+
+void Decoder::step() {
+  const uint32_t g = m_gate;
+  const uint32_t before = m_prev[g];
+  const uint32_t after = m_next[g];
+  const uint32_t t = addTriangle();
+  const uint32_t h = 3*t;
+  const uint32_t e1 = h+1;
+  const uint32_t e2 = h+2;
+  const uint32_t v0 = m_sources[g];
+  const uint32_t v1 = m_sources[next(g)];
+
+  // C 0, R 10, L 1100, E 1101, S 1110 and M 1111, in the order read
+  static const TraversalCode codes[4] = { CODE_L, CODE_S, CODE_E, CODE_M };
+  const uint32_t word = uint32_t(m_code.peek());
+  TraversalCode code;
+  if(!(word & 1)) {
+    code = CODE_C;
+    m_code.skip(1);
+  } else if(!(word & 2)) {
+    code = CODE_R;
+    m_code.skip(2);
+  } else {
+    code = codes[(word >> 2) & 3];
+    m_code.skip(4);
+  }
+
+  switch(code) {
+    case CODE_C: {
+      int32_t prediction[3];
+      predictPosition(m_quantized, v0, v1, m_sources[prev(g)], m_last, prediction);
+      setNodes(t, v1, v0, addFan(prediction));
+      pair(g, h);
+      link(before, e1);
+      link(e1, e2);
+      link(e2, after);
+      m_gate = e2;
+      break;
+    }
+    case CODE_L:
+      setNodes(t, v1, v0, m_sources[before]);
+      pair(g, h);
+      pair(e1, before);
+      link(m_prev[before], e2);
+      link(e2, after);
+      m_gate = e2;
+      break;
+    case CODE_R:
+      setNodes(t, v1, v0, m_sources[m_next[after]]);
+      pair(g, h);
+      pair(e2, after);
+      link(before, e1);
+      link(e1, m_next[after]);
+      m_gate = e1;
+      break;
+    case CODE_E:
+      setNodes(t, v1, v0, m_sources[before]);
+      pair(g, h);
+      pair(e1, before);
+      pair(e2, after);
+      if(m_stack.empty()) {
+        m_gate = NONE;
+      } else {
+        m_gate = m_stack.back();
+        m_stack.pop_back();
+      }
+      break;
+    case CODE_S:
+    case CODE_M: {
+      uint32_t out = g;
+      if(code == CODE_M) {
+        const uint32_t depth = m_code.readGamma();
+        if(depth > m_stack.size()) {
+          fail();
+        }
+        out = m_stack[m_stack.size()-depth];
+        m_stack.erase(m_stack.end()-depth);
+      }
+      const bool forward = m_code.read(1);
+      const uint32_t distance = m_code.readGamma();
+      for(uint32_t i=1; i<distance; i++) {
+        out = forward ? m_next[out] : m_prev[out];
+      }
+      if(code == CODE_S) {
+        out = forward ? m_next[out] : m_prev[out];
+        if(out == g || out == after) {
+          fail();
+        }
+      }
+      setNodes(t, v1, v0, m_sources[out]);
+      pair(g, h);
+      const uint32_t in = m_prev[out];
+      link(before, e1);
+      link(e1, out);
+      link(in, e2);
+      link(e2, after);
+      if(code == CODE_S) {
+        m_stack.push_back(e1);
+      }
+      m_gate = e2;
+      break;
+    }
+  }
+}
+
+uint32_t Decoder::addTriangle() {
+  if(m_num_all >= m_triangles.size() || !m_code.isValid()) {
+    fail();
+  }
+  return m_num_all++;
+}
+
+void Decoder::setNodes(uint32_t t, uint32_t a, uint32_t b, uint32_t c) {
+  m_sources[3*t] = a;
+  m_sources[3*t+1] = b;
+  m_sources[3*t+2] = c;
+  if(a == NONE || b == NONE || c == NONE) {
+    m_triangles[t] = NONE;
+    return;
+  }
+  if(m_num_triangles >= m_header.m_triangles_) {
+    fail();
+  }
+  m_triangles[t] = m_num_triangles;
+  m_indices[3*m_num_triangles] = a;
+  m_indices[3*m_num_triangles+1] = b;
+  m_indices[3*m_num_triangles+2] = c;
+  m_num_triangles++;
+}
+
+uint32_t Decoder::addFan(const int32_t* prediction) {
+  const vector<uint32_t>& exceptions = m_blocks.m_exceptions_;
+  const uint64_t fan = m_num_fans++;
+  if(m_exception < exceptions.size() && exceptions[m_exception] == fan) {
+    const uint32_t v = exceptions[m_exception+1];
+    m_exception += 2;
+    if(v != NONE && v >= m_num_nodes) {
+      fail();
+    }
+    return v;
+  }
+  if(m_num_nodes >= m_header.m_nodes_) {
+    fail();
+  }
+  const uint32_t v = m_num_nodes++;
+  for(uint32_t i=0; i<3; i++) {
+    m_quantized[3*v+i] = int32_t(uint32_t(prediction[i]) + uint32_t(unzigzag(m_coders[i].read(m_code))));
+    m_last[i] = m_quantized[3*v+i];
+  }
+  return v;
+}
+
+}  // namespace
+
+bool CompressedMeshFile::isCompressedMeshFile(const string& filename) {
+  const string extension = ".cmsh";
+  return filename.size() >= extension.size() &&
+         filename.compare(filename.size() - extension.size(), extension.size(), extension) == 0;
+}
+
+void CompressedMeshFile::write(const string& filename, const CompactTriMesh& mesh,
+                               uint32_t position_bits) {
+  if(position_bits < 8 || position_bits > 24) {
+    throw runtime_error("CompressedMeshFile: position bits must be from 8 to 24");
+  }
+  Header header;
+  std::memset(&header, 0, sizeof(Header));
+  FileBlocks blocks;
+  Encoder encoder(mesh, position_bits, header, blocks);
+  const vector<uint8_t>& code = encoder.encode();
+
+  const CompactTriMesh::ConnectivityReport& report = mesh.getConnectivityReport();
+  std::memcpy(header.m_magic_, "CMSH", 4);
+  header.m_version_ = compressed_mesh_file_version;
+  header.m_position_bits_ = position_bits;
+  header.m_nodes_ = mesh.getNumNodes();
+  header.m_triangles_ = mesh.getNumTriangles();
+  header.m_twin_pairs_ = blocks.m_twin_pairs_.size()/2;
+  header.m_inner_edges_ = report.m_inner_edges_;
+  header.m_boundary_edges_ = report.m_boundary_edges_;
+  header.m_nonmanifold_edges_ = report.m_nonmanifold_edges_;
+  header.m_misoriented_edges_ = report.m_misoriented_edges_;
+  header.m_problem_halfedges_ = blocks.m_problems_.size();
+  header.m_code_bytes_ = code.size();
+
+  std::ofstream out(filename.c_str(), std::ios::out | std::ios::binary);
+  if(!out.good()) {
+    throw runtime_error("Error writing to " + filename);
+  }
+  out.write(reinterpret_cast<const char*>(&header), sizeof(Header));
+  const vector<uint32_t>* lists[3] = {
+    &blocks.m_exceptions_, &blocks.m_twin_pairs_, &blocks.m_problems_
+  };
+  for(uint32_t i=0; i<3; i++) {
+    if(!lists[i]->empty()) {
+      out.write(reinterpret_cast<const char*>(&(*lists[i])[0]), 4*lists[i]->size());
+    }
+  }
+  if(!code.empty()) {
+    out.write(reinterpret_cast<const char*>(&code[0]), code.size());
+  }
+  if(!out.good()) {
+    throw runtime_error("Error writing to " + filename);
+  }
+}
+
+void CompressedMeshFile::read(const string& filename, vector<glm::vec3>& positions,
+                              vector<uint32_t>& indices, vector<uint32_t>& twins,
+                              CompactTriMesh::ConnectivityReport& report) {
+  std::ifstream in(filename.c_str(), std::ios::in | std::ios::binary);
+  if(!in.good()) {
+    throw runtime_error("Error reading from " + filename);
+  }
+  in.seekg(0, std::ios::end);
+  const uint64_t size = in.tellg();
+  in.seekg(0, std::ios::beg);
+  Header header;
+  if(size < sizeof(Header) || !in.read(reinterpret_cast<char*>(&header), sizeof(Header))) {
+    throw runtime_error("Not a compressed mesh file: " + filename);
+  }
+
+  // The lists must fit in the file, and the counts must fit in the code
+  // before anything is allocated: every node and every triangle, holes
+  // included, takes at least one bit of the code, or one exception
+  const uint64_t Nv = header.m_nodes_;
+  const uint64_t Nt = header.m_triangles_;
+  const uint64_t Nh = header.m_hole_triangles_;
+  const uint64_t max_count = 8*header.m_code_bytes_ + header.m_exceptions_;
+  bool valid = std::memcmp(header.m_magic_, "CMSH", 4) == 0 &&
+               header.m_version_ == compressed_mesh_file_version &&
+               header.m_position_bits_ >= 8 && header.m_position_bits_ <= 24 &&
+               header.m_exceptions_ <= size && header.m_twin_pairs_ <= size &&
+               header.m_problem_halfedges_ <= size && header.m_code_bytes_ <= size;
+  if(valid) {
+    const uint64_t expected = sizeof(Header) + 8*header.m_exceptions_ + 8*header.m_twin_pairs_ +
+                              4*header.m_problem_halfedges_ + header.m_code_bytes_;
+    valid = expected == size && Nv <= max_count && Nt <= max_count && Nh <= max_count &&
+            Nv < NONE && 3*(Nt + Nh) < NONE && header.m_exceptions_ <= header.m_fans_ &&
+            header.m_fans_ <= 3*(Nt + Nh);
+  }
+  if(!valid) {
+    throw runtime_error("Not a valid compressed mesh file: " + filename);
+  }
+
+  FileBlocks blocks;
+  blocks.m_exceptions_.resize(2*header.m_exceptions_);
+  blocks.m_twin_pairs_.resize(2*header.m_twin_pairs_);
+  blocks.m_problems_.resize(header.m_problem_halfedges_);
+  vector<uint32_t>* lists[3] = {
+    &blocks.m_exceptions_, &blocks.m_twin_pairs_, &blocks.m_problems_
+  };
+  for(uint32_t i=0; i<3; i++) {
+    if(!lists[i]->empty()) {
+      in.read(reinterpret_cast<char*>(&(*lists[i])[0]), 4*lists[i]->size());
+    }
+  }
+  vector<uint8_t> code(header.m_code_bytes_ + code_padding, 0);
+  in.read(reinterpret_cast<char*>(&code[0]), header.m_code_bytes_);
+  if(!in.good()) {
+    throw runtime_error("Error reading from " + filename);
+  }
+
+  Decoder decoder(header, blocks, &code[0], positions, indices, twins);
+  decoder.decode();
+
+  report.m_inner_edges_ = header.m_inner_edges_;
+  report.m_boundary_edges_ = header.m_boundary_edges_;
+  report.m_nonmanifold_edges_ = header.m_nonmanifold_edges_;
+  report.m_misoriented_edges_ = header.m_misoriented_edges_;
+  report.m_problem_halfedges_.swap(blocks.m_problems_);
+  for(size_t i=0; i<report.m_problem_halfedges_.size(); i++) {
+    if(report.m_problem_halfedges_[i] >= 3*Nt) {
+      throw runtime_error("Not a valid compressed mesh file: " + filename);
+    }
+  }
+}
+
+}  // GfxUtil
@@ -0,0 +1,91 @@
+/* CompressedMeshFile.hpp
+ *
+ * Distributed under the GNU GPL.
+ */
+
+#ifndef GFXUTIL_COMPRESSEDMESHFILE_H
+#define GFXUTIL_COMPRESSEDMESHFILE_H
+
+#include <vector>
+#include <string>
+#include <stdint.h>
+#include <glm/glm.hpp>
+
+#include "CompactTriMesh.hpp"
+
+namespace GfxUtil {
+
+/** Compressed mesh file (*.cmsh), with the connectivity coded by a
+ *  traversal of the half-edges and the positions quantized and predicted.
+ *
+ *  The connectivity is coded in the manner of Edgebreaker (Rossignac,
+ *  "Edgebreaker: Connectivity compression for triangle meshes", 1999) and
+ *  the Cut-Border Machine (Gumhold and Strasser, 1998): the triangles are
+ *  visited across the edges of the border of the visited region, and each
+ *  triangle is coded by how its third node relates to that border,
+ *
+ *  - C: a new node,
+ *  - L, R: the node before or after the gate edge on the border,
+ *  - E: both, closing a border of three edges,
+ *  - S: another node of the same border, which is split in two,
+ *  - M: a node of another border, which are merged (handles),
+ *
+ *  which takes about two bits per triangle. Holes are closed by a fan of
+ *  triangles around an extra node while coding and dropped when decoding,
+ *  and nodes where several fans of triangles meet, and degenerate
+ *  triangles, are kept in small exception lists, so any CompactTriMesh is
+ *  stored with the same triangles and the same twins.
+ *
+ *  The positions are quantized on a uniform grid over the bounding box, and
+ *  each new node is predicted by completing the parallelogram of the
+ *  triangle across the gate edge. The residuals are stored with adaptive
+ *  Rice codes.
+ *
+ *  The nodes and triangles are numbered in the order of the traversal, so
+ *  a mesh read back is the stored mesh with its nodes and triangles
+ *  reordered, and its positions rounded to the grid. The decoder finds the
+ *  twins as it goes, so reading a file skips buildConnectivity().
+ */
+class CompressedMeshFile {
+ public:
+  /** The header at the start of the file. */
+  struct Header {
+    char     m_magic_[4];           ///< "CMSH".
+    uint32_t m_version_;            ///< Version of the format.
+    uint32_t m_position_bits_;      ///< Bits per quantized coordinate.
+    uint32_t m_reserved_;           ///< Zero.
+    uint64_t m_nodes_;              ///< Number of nodes, Nv.
+    uint64_t m_triangles_;          ///< Number of triangles, Nt.
+    uint64_t m_hole_triangles_;     ///< Number of triangles closing the holes.
+    uint64_t m_fans_;               ///< Number of fans of triangles around nodes.
+    uint64_t m_exceptions_;         ///< Number of fans of holes, or of nodes seen before.
+    uint64_t m_twin_pairs_;         ///< Number of twins of degenerate triangles.
+    uint64_t m_inner_edges_;        ///< Connectivity report, see CompactTriMesh.
+    uint64_t m_boundary_edges_;
+    uint64_t m_nonmanifold_edges_;
+    uint64_t m_misoriented_edges_;
+    uint64_t m_problem_halfedges_;  ///< Number of problem half-edges.
+    uint64_t m_code_bytes_;         ///< Size of the coded traversal and positions.
+    float    m_origin_[3];          ///< Position of quantized coordinate 0.
+    float    m_step_;               ///< Distance between quantized coordinates.
+  };
+
+  /** Returns true if the filename has the extension of compressed mesh files. */
+  static bool isCompressedMeshFile(const std::string& filename);
+
+  /** Compresses a mesh to a file, throws std::runtime_error on failure.
+   *  \param position_bits Bits per coordinate, from 8 to 24. */
+  static void write(const std::string& filename, const CompactTriMesh& mesh,
+                    uint32_t position_bits = 16);
+
+  /** Reads a file, throws std::runtime_error if it is not a valid file.
+   *  \param twins Set to the twin of each half-edge, as buildConnectivity().
+   *  \param report Set to the connectivity report of the stored mesh. */
+  static void read(const std::string& filename, std::vector<glm::vec3>& positions,
+                   std::vector<uint32_t>& indices, std::vector<uint32_t>& twins,
+                   CompactTriMesh::ConnectivityReport& report);
+};
+
+}  // GfxUtil
+
+#endif
@@ -0,0 +1,116 @@
+/* LockFreeQueue.hpp
+ *
+ * Distributed under the GNU GPL.
+ */
+
+#ifndef GFXUTIL_LOCKFREEQUEUE_H
+#define GFXUTIL_LOCKFREEQUEUE_H
+
+#include <vector>
+#include <atomic>
+#include <stdint.h>
+
+namespace GfxUtil {
+
+/** Bounded queue that any number of threads can push to and pop from
+ *  without locks, e.g. to hand results from worker threads to the render
+ *  thread, which must never wait for a worker.
+ *
+ *  This is Dmitry Vyukov's bounded MPMC queue: each cell has a sequence
+ *  number that tells whether it is ready to be written or read in the
+ *  current round, so a thread claims a cell with one compare-and-swap on
+ *  the head or tail, and publishes it with a release store to the cell.
+ */
+template <class T>
+class LockFreeQueue {
+ public:
+  /** Constructor.
+   *  \param capacity Number of values the queue can hold, rounded up to a
+   *                  power of two. */
+  LockFreeQueue(size_t capacity)
+      : m_cells(roundUp(capacity)), m_mask(roundUp(capacity)-1), m_push_position(0),
+        m_pop_position(0) {
+    for(size_t i=0; i<m_cells.size(); i++) {
+      m_cells[i].m_sequence_.store(i, std::memory_order_relaxed);
+    }
+  }
+
+  /** Adds a value, returns false if the queue is full. */
+  bool push(const T& value) {
+    size_t position = m_push_position.load(std::memory_order_relaxed);
+    Cell* cell;
+    while(true) {
+      cell = &m_cells[position & m_mask];
+      const size_t sequence = cell->m_sequence_.load(std::memory_order_acquire);
+      const intptr_t difference = intptr_t(sequence) - intptr_t(position);
+      if(difference == 0) {
+        if(m_push_position.compare_exchange_weak(position, position+1,
+                                                 std::memory_order_relaxed)) {
+          break;
+        }
+      } else if(difference < 0) {
+        return false;
+      } else {
+        position = m_push_position.load(std::memory_order_relaxed);
+      }
+    }
+    cell->m_value_ = value;
+    cell->m_sequence_.store(position+1, std::memory_order_release);
+    return true;
+  }
+
+  /** Removes the oldest value, returns false if the queue is empty. */
+  bool pop(T& value) {
+    size_t position = m_pop_position.load(std::memory_order_relaxed);
+    Cell* cell;
+    while(true) {
+      cell = &m_cells[position & m_mask];
+      const size_t sequence = cell->m_sequence_.load(std::memory_order_acquire);
+      const intptr_t difference = intptr_t(sequence) - intptr_t(position+1);
+      if(difference == 0) {
+        if(m_pop_position.compare_exchange_weak(position, position+1,
+                                                std::memory_order_relaxed)) {
+          break;
+        }
+      } else if(difference < 0) {
+        return false;
+      } else {
+        position = m_pop_position.load(std::memory_order_relaxed);
+      }
+    }
+    value = cell->m_value_;
+    cell->m_sequence_.store(position + m_mask + 1, std::memory_order_release);
+    return true;
+  }
+
+ protected:
+  /** A value and the round it belongs to. */
+  struct Cell {
+    std::atomic<size_t> m_sequence_;  ///< Position it may be pushed at, plus one once pushed.
+    T                   m_value_;     ///< The value.
+  };
+
+  /** Returns the smallest power of two not less than n. */
+  static size_t roundUp(size_t n) {
+    size_t size = 1;
+    while(size < n) {
+      size *= 2;
+    }
+    return size;
+  }
+
+  std::vector<Cell>   m_cells;          /// The ring of cells.
+  size_t              m_mask;           /// Number of cells minus one.
+  char                m_padding0[64];   /// Keeps the positions in separate cache lines.
+  std::atomic<size_t> m_push_position;  /// Next position to push to.
+  char                m_padding1[64];   /// Keeps the positions in separate cache lines.
+  std::atomic<size_t> m_pop_position;   /// Next position to pop from.
+
+ private:
+  LockFreeQueue(const LockFreeQueue&);
+  LockFreeQueue& operator=(const LockFreeQueue&);
+};
+
+}  // GfxUtil
+
+#endif
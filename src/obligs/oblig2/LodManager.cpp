@@ -0,0 +1,191 @@
+/* LodManager.cpp
+ *
+ * Distributed under the GNU GPL.
+ */
+
+#include "LodManager.hpp"
+#include "MeshOptimizer.hpp"
+
+#include <cmath>
+#include <vector>
+#include <thread>
+#include <functional>
+#include <algorithm>
+#include <glm/glm.hpp>
+
+using std::vector;
+
+namespace GfxUtil {
+
+LodManager::LodManager(CompactTriMesh* mesh, int finer_levels, size_t min_triangles,
+                       size_t num_threads)
+    : m_base(0), m_selected(0), m_current(-1), m_budget(2000000), m_pixels_per_triangle(8.0f),
+      m_upload_bytes(4 << 20), m_bbox_min(mesh->getBBoxMin()), m_bbox_max(mesh->getBBoxMax()),
+      m_decimator(NULL), m_workers(NULL), m_built(64) {
+  const size_t triangles = mesh->getNumTriangles();
+  while((triangles >> 2*(m_base+1)) >= min_triangles) {
+    m_base++;
+  }
+  m_levels.resize(m_base + 1 + finer_levels);
+  for(int level=0; level<int(m_levels.size()); level++) {
+    m_levels[level].m_mesh_ = NULL;
+    m_levels[level].m_renderer_ = NULL;
+    m_levels[level].m_building_ = false;
+    m_levels[level].m_uploaded_ = false;
+    m_levels[level].m_triangles_ = level < m_base ? triangles >> 2*(m_base-level)
+                                                  : triangles << 2*(level-m_base);
+  }
+  m_selected = m_base;
+
+  // The neighbours of the base mesh are built from it right away, but it is
+  // prepared for drawing by the workers like the other levels
+  m_levels[m_base].m_mesh_ = mesh;
+  m_levels[m_base].m_building_ = true;
+  m_workers = new WorkerPool(num_threads);
+  m_workers->submit(std::bind(&LodManager::buildLevel, this, m_base, mesh, triangles));
+}
+
+LodManager::~LodManager() {
+  delete m_workers;
+
+  BuiltLevel* built;
+  while(m_built.pop(built)) {
+    if(built->m_level_ != m_base) {
+      delete built->m_mesh_;
+    }
+    delete built;
+  }
+  for(size_t level=0; level<m_levels.size(); level++) {
+    delete m_levels[level].m_mesh_;
+    delete m_levels[level].m_renderer_;
+  }
+  delete m_decimator;
+}
+
+void LodManager::update(const glm::mat4x4& projection, const glm::mat4x4& model_view,
+                        int width, int height) {
+  receiveLevels();
+
+  // Radius of the bounding sphere on screen, in pixels, from its distance
+  // to the camera, or directly for an orthographic projection
+  const glm::vec3 center = 0.5f*(m_bbox_min + m_bbox_max);
+  const float scale = glm::length(glm::vec3(model_view[0][0], model_view[0][1], model_view[0][2]));
+  const float radius = 0.5f*scale*glm::length(m_bbox_max - m_bbox_min);
+  const float distance = -(model_view*glm::vec4(center, 1.0f)).z;
+  float area = float(width)*float(height);
+  if(projection[2][3] == 0.0f || distance > radius) {
+    const float perspective = projection[2][3] == 0.0f ? 1.0f : distance;
+    const float pixels = 0.5f*height*projection[1][1]*radius/perspective;
+    area = std::min(area, float(M_PI)*pixels*pixels);
+  }
+
+  // The triangles facing away are culled, so about half of the triangles
+  // cover the area
+  const float wanted = std::min(2.0f*area/m_pixels_per_triangle, float(m_budget));
+  m_selected = 0;
+  while(m_selected+1 < int(m_levels.size()) && m_levels[m_selected+1].m_triangles_ <= wanted) {
+    m_selected++;
+  }
+  requestLevel(m_selected);
+
+  // Upload the built level closest to the selected one, a part per frame
+  const int step = m_selected > m_base ? -1 : 1;
+  int level = m_selected;
+  while(level != m_base && m_levels[level].m_mesh_ == NULL) {
+    level += step;
+  }
+  Level& upload = m_levels[level];
+  if(upload.m_mesh_ != NULL && !upload.m_building_ && !upload.m_uploaded_) {
+    if(upload.m_renderer_ == NULL) {
+      upload.m_renderer_ = new MeshRenderer();
+      upload.m_renderer_->beginUpload(upload.m_vertices_, upload.m_indices_);
+    }
+    if(upload.m_renderer_->continueUpload(m_upload_bytes)) {
+      upload.m_uploaded_ = true;
+      vector<PackedVertex>().swap(upload.m_vertices_);
+      vector<uint32_t>().swap(upload.m_indices_);
+    }
+  }
+
+  // Draw the uploaded level closest to the selected one
+  level = m_selected;
+  while(level != m_base && !m_levels[level].m_uploaded_) {
+    level += step;
+  }
+  if(m_levels[level].m_uploaded_) {
+    m_current = level;
+  }
+}
+
+void LodManager::render() const {
+  if(m_current >= 0) {
+    m_levels[m_current].m_renderer_->render();
+  }
+}
+
+void LodManager::requestLevel(int level) {
+  const int step = level > m_base ? 1 : -1;
+  for(int next=m_base; next != level; ) {
+    next += step;
+    Level& missing = m_levels[next];
+    if(missing.m_mesh_ != NULL) {
+      continue;
+    }
+    if(!missing.m_building_) {
+      missing.m_building_ = true;
+      m_workers->submit(std::bind(&LodManager::buildLevel, this, next,
+                                  m_levels[next-step].m_mesh_, missing.m_triangles_));
+    }
+    return;
+  }
+}
+
+void LodManager::buildLevel(int level, const CompactTriMesh* neighbour, size_t triangles) {
+  BuiltLevel* built = new BuiltLevel;
+  built->m_level_ = level;
+  if(level == m_base) {
+    built->m_mesh_ = const_cast<CompactTriMesh*>(neighbour);
+  } else if(level > m_base) {
+    built->m_mesh_ = neighbour->subdivideLoop();
+  } else {
+    // The coarser levels are requested in order, each after the previous
+    // one is received, so one decimator goes down the whole chain
+    if(m_decimator == NULL) {
+      m_decimator = new MeshDecimator(*neighbour);
+    }
+    m_decimator->decimate(triangles);
+    built->m_mesh_ = m_decimator->extractMesh();
+  }
+
+  const CompactTriMesh& mesh = *built->m_mesh_;
+  built->m_indices_ = mesh.getIndices();
+  vector<uint32_t> clusters;
+  optimizeVertexCache(built->m_indices_, mesh.getNumNodes(), 16, &clusters);
+  optimizeOverdraw(built->m_indices_, mesh.getPositions(), clusters);
+  built->m_vertices_.resize(mesh.getNumNodes());
+  if(mesh.getNumNodes() > 0) {
+    packVertices(&mesh.getPositions()[0], &mesh.getNormals()[0], sizeof(glm::vec3),
+                 mesh.getNumNodes(), &built->m_vertices_[0]);
+  }
+
+  // There is room for every level in the queue, this only waits if the
+  // render thread is very late
+  while(!m_built.push(built)) {
+    std::this_thread::yield();
+  }
+}
+
+void LodManager::receiveLevels() {
+  BuiltLevel* built;
+  while(m_built.pop(built)) {
+    Level& level = m_levels[built->m_level_];
+    level.m_mesh_ = built->m_mesh_;
+    level.m_vertices_.swap(built->m_vertices_);
+    level.m_indices_.swap(built->m_indices_);
+    level.m_triangles_ = level.m_mesh_->getNumTriangles();
+    level.m_building_ = false;
+    delete built;
+  }
+}
+
+}  // GfxUtil
@@ -0,0 +1,170 @@
+/* LodManager.hpp
+ *
+ * Distributed under the GNU GPL.
+ */
+
+#ifndef GFXUTIL_LODMANAGER_H
+#define GFXUTIL_LODMANAGER_H
+
+#include <vector>
+#include <stdint.h>
+#include <glm/glm.hpp>
+
+#include "CompactTriMesh.hpp"
+#include "MeshDecimator.hpp"
+#include "MeshRenderer.hpp"
+#include "PackedVertexBuffer.hpp"
+#include "WorkerPool.hpp"
+#include "LockFreeQueue.hpp"
+
+namespace GfxUtil {
+
+/** Discrete levels of detail of a mesh, selected per frame.
+ *
+ *  The levels are the base mesh, coarser meshes decimated to a quarter of
+ *  the triangles per level, and finer meshes refined by Loop-subdivision,
+ *  so each level has about four times the triangles of the one below.
+ *
+ *  Every frame, update() estimates how many triangles the mesh needs from
+ *  its size on screen, and selects the finest level below that and below
+ *  the triangle budget. The render thread never waits for a level:
+ *
+ *  - Missing levels are built by a WorkerPool, one level at a time from
+ *    the base mesh outwards, so the coarser and finer levels are built in
+ *    parallel. The workers also reorder the triangles for the vertex cache
+ *    and pack the vertices.
+ *  - Built levels are handed back through a LockFreeQueue, which update()
+ *    polls.
+ *  - The closest built level is uploaded a few megabytes per frame, so a
+ *    large level does not stall a frame.
+ *  - Until the selected level is uploaded, the closest uploaded level is
+ *    drawn.
+ *
+ *  Typical use, in the display callback:
+ *
+ *    lod.update(viewer.getProjectionMatrix(), model_view_matrix, width, height);
+ *    lod.render();
+ *    if(lod.isBuilding()) {
+ *      // Redraw soon to continue the upload, or pick up the level
+ *    }
+ */
+class LodManager {
+ public:
+  /** Constructor, takes ownership of the mesh and starts the workers.
+   *  \param finer_levels Number of subdivided levels above the base mesh.
+   *  \param min_triangles Decimated levels are added down to this number of
+   *                       triangles.
+   *  \param num_threads Number of workers, 0 for one less than the cores. */
+  LodManager(CompactTriMesh* mesh, int finer_levels = 6, size_t min_triangles = 256,
+             size_t num_threads = 0);
+
+  /** Destructor, stops the workers and deletes the levels. */
+  ~LodManager();
+
+  /** Receives the levels built since the last call, selects the level to
+   *  draw, requests it if it is not built, and continues uploading. Call
+   *  on the render thread.
+   *  \param projection, model_view The matrices the mesh is drawn with,
+   *                                e.g. from SimpleViewer.
+   *  \param width, height The size of the window in pixels. */
+  void update(const glm::mat4x4& projection, const glm::mat4x4& model_view,
+              int width, int height);
+
+  /** Draws the level chosen by update(). */
+  void render() const;
+
+  /** Returns true until the selected level is built and uploaded. */
+  bool isBuilding() const { return m_current != m_selected; }
+
+  /** Sets the largest number of triangles to draw. */
+  void setTriangleBudget(size_t triangles) { m_budget = triangles; }
+
+  /** Returns the largest number of triangles to draw. */
+  size_t getTriangleBudget() const { return m_budget; }
+
+  /** Sets how many pixels a triangle should cover on screen, larger values
+   *  select coarser levels. */
+  void setPixelsPerTriangle(float pixels) { m_pixels_per_triangle = pixels; }
+
+  /** Returns how many pixels a triangle should cover on screen. */
+  float getPixelsPerTriangle() const { return m_pixels_per_triangle; }
+
+  /** Sets how many bytes update() uploads at most. */
+  void setUploadBytesPerFrame(size_t bytes) { m_upload_bytes = bytes; }
+
+  /** Returns the number of levels, built or not. */
+  int getNumLevels() const { return m_levels.size(); }
+
+  /** Returns the level of the base mesh. */
+  int getBaseLevel() const { return m_base; }
+
+  /** Returns the level drawn by render(), or -1 before anything is uploaded. */
+  int getCurrentLevel() const { return m_current; }
+
+  /** Returns the level selected by update(). */
+  int getSelectedLevel() const { return m_selected; }
+
+  /** Returns the number of triangles of a level, estimated if it is not
+   *  built yet. */
+  size_t getNumTriangles(int level) const { return m_levels[level].m_triangles_; }
+
+  /** Returns the minimum x,y,z-values of the base mesh. */
+  const glm::vec3& getBBoxMin() const { return m_bbox_min; }
+
+  /** Returns the maximum x,y,z-values of the base mesh. */
+  const glm::vec3& getBBoxMax() const { return m_bbox_max; }
+
+ protected:
+  /** A level of detail, only used on the render thread. */
+  struct Level {
+    CompactTriMesh*           m_mesh_;       ///< The mesh, NULL until built.
+    std::vector<PackedVertex> m_vertices_;   ///< The vertices to upload.
+    std::vector<uint32_t>     m_indices_;    ///< Indices reordered for the vertex cache.
+    size_t                    m_triangles_;  ///< Number of triangles, estimated until built.
+    bool                      m_building_;   ///< True while a worker builds the level.
+    bool                      m_uploaded_;   ///< True when the upload is done.
+    MeshRenderer*             m_renderer_;   ///< The buffers, NULL until the upload starts.
+  };
+
+  /** A level built by a worker, on its way to the render thread. */
+  struct BuiltLevel {
+    int                       m_level_;     ///< Which level.
+    CompactTriMesh*           m_mesh_;      ///< The mesh.
+    std::vector<PackedVertex> m_vertices_;  ///< The packed vertices.
+    std::vector<uint32_t>     m_indices_;   ///< Indices reordered for the vertex cache.
+  };
+
+  /** Starts building the next missing level from the base mesh towards
+   *  level, unless it is being built already. */
+  void requestLevel(int level);
+
+  /** Builds a level from the next level towards the base mesh, and queues
+   *  it for the render thread. Runs on a worker.
+   *  \param triangles The number of triangles of a decimated level. */
+  void buildLevel(int level, const CompactTriMesh* neighbour, size_t triangles);
+
+  /** Moves the built levels from the queue into m_levels. */
+  void receiveLevels();
+
+  std::vector<Level>       m_levels;     /// The levels, coarsest first.
+  int                      m_base;       /// Level of the base mesh.
+  int                      m_selected;   /// Level selected by update().
+  int                      m_current;    /// Level drawn by render(), or -1.
+  size_t                   m_budget;     /// Largest number of triangles to draw.
+  float                    m_pixels_per_triangle;  /// Screen area per triangle.
+  size_t                   m_upload_bytes;         /// Bytes to upload per update().
+  glm::vec3                m_bbox_min;   /// Minimum values of bounding box.
+  glm::vec3                m_bbox_max;   /// Maximum values of bounding box.
+
+  MeshDecimator*           m_decimator;  /// Builds the coarser levels, one after the other.
+  WorkerPool*              m_workers;    /// Builds the levels.
+  LockFreeQueue<BuiltLevel*> m_built;    /// Built levels not received yet.
+
+ private:
+  LodManager(const LodManager&);
+  LodManager& operator=(const LodManager&);
+};
+
+}  // GfxUtil
+
+#endif
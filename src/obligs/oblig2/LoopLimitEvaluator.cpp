@@ -0,0 +1,417 @@
+/* LoopLimitEvaluator.cpp
+ *
+ * Distributed under the GNU GPL.
+ */
+
+#include "LoopLimitEvaluator.hpp"
+#include "StencilTable.hpp"
+
+#include <cmath>
+#include <vector>
+#include <stdexcept>
+#include <glm/glm.hpp>
+
+using std::vector;
+
+namespace GfxUtil {
+
+namespace {
+
+const uint32_t NONE = CompactTriMesh::NONE;
+
+/** Nodes of higher valence are interpolated instead of evaluated. */
+const uint32_t MAX_VALENCE = 64;
+
+/** Number of tabulated levels around an extraordinary node, points closer
+ *  to the node than 2^-MAX_LEVELS get the limit position of the node. */
+const int MAX_LEVELS = 32;
+
+/** A term c u^a v^b w^c of a box spline basis function, times 12. */
+struct BoxSplineTerm {
+  int   m_basis_;
+  float m_coefficient_;
+  int   m_a_, m_b_, m_c_;
+};
+
+/** The 12 basis functions of the regular patch, from the appendix of Stam's
+ *  paper, numbered like the nodes returned by gatherPatch(). The first
+ *  three nodes are the corners of the triangle, with u, v and w their
+ *  barycentric coordinates. */
+const BoxSplineTerm box_spline_terms[] = {
+  // Stam's b4: the first corner
+  { 0,  6, 4,0,0 }, { 0, 24, 3,0,1 }, { 0, 24, 2,0,2 }, { 0,  8, 1,0,3 }, { 0,  1, 0,0,4 },
+  { 0, 24, 3,1,0 }, { 0, 60, 2,1,1 }, { 0, 36, 1,1,2 }, { 0,  6, 0,1,3 }, { 0, 24, 2,2,0 },
+  { 0, 36, 1,2,1 }, { 0, 12, 0,2,2 }, { 0,  8, 1,3,0 }, { 0,  6, 0,3,1 }, { 0,  1, 0,4,0 },
+  // b7: the second corner
+  { 1,  1, 4,0,0 }, { 1,  6, 3,0,1 }, { 1, 12, 2,0,2 }, { 1,  6, 1,0,3 }, { 1,  1, 0,0,4 },
+  { 1,  8, 3,1,0 }, { 1, 36, 2,1,1 }, { 1, 36, 1,1,2 }, { 1,  8, 0,1,3 }, { 1, 24, 2,2,0 },
+  { 1, 60, 1,2,1 }, { 1, 24, 0,2,2 }, { 1, 24, 1,3,0 }, { 1, 24, 0,3,1 }, { 1,  6, 0,4,0 },
+  // b8: the third corner
+  { 2,  1, 4,0,0 }, { 2,  8, 3,0,1 }, { 2, 24, 2,0,2 }, { 2, 24, 1,0,3 }, { 2,  6, 0,0,4 },
+  { 2,  6, 3,1,0 }, { 2, 36, 2,1,1 }, { 2, 60, 1,1,2 }, { 2, 24, 0,1,3 }, { 2, 12, 2,2,0 },
+  { 2, 36, 1,2,1 }, { 2, 24, 0,2,2 }, { 2,  6, 1,3,0 }, { 2,  8, 0,3,1 }, { 2,  1, 0,4,0 },
+  // b5: opposite of the second corner, across the edge of the first and third
+  { 3,  1, 4,0,0 }, { 3,  6, 3,0,1 }, { 3, 12, 2,0,2 }, { 3,  6, 1,0,3 }, { 3,  1, 0,0,4 },
+  { 3,  2, 3,1,0 }, { 3,  6, 2,1,1 }, { 3,  6, 1,1,2 }, { 3,  2, 0,1,3 },
+  // b2, b1: the outer neighbours of the first corner
+  { 4,  1, 4,0,0 }, { 4,  2, 3,0,1 },
+  { 5,  1, 4,0,0 }, { 5,  2, 3,1,0 },
+  // b3: opposite of the third corner, across the edge of the first and second
+  { 6,  1, 4,0,0 }, { 6,  2, 3,0,1 }, { 6,  6, 3,1,0 }, { 6,  6, 2,1,1 }, { 6, 12, 2,2,0 },
+  { 6,  6, 1,2,1 }, { 6,  6, 1,3,0 }, { 6,  2, 0,3,1 }, { 6,  1, 0,4,0 },
+  // b6, b10: the outer neighbours of the second corner
+  { 7,  2, 1,3,0 }, { 7,  1, 0,4,0 },
+  { 8,  2, 0,3,1 }, { 8,  1, 0,4,0 },
+  // b11: opposite of the first corner, across the edge of the second and third
+  { 9,  2, 1,0,3 }, { 9,  1, 0,0,4 }, { 9,  6, 1,1,2 }, { 9,  6, 0,1,3 }, { 9,  6, 1,2,1 },
+  { 9, 12, 0,2,2 }, { 9,  2, 1,3,0 }, { 9,  6, 0,3,1 }, { 9,  1, 0,4,0 },
+  // b12, b9: the outer neighbours of the third corner
+  { 10, 1, 0,0,4 }, { 10, 2, 0,1,3 },
+  { 11, 2, 1,0,3 }, { 11, 1, 0,0,4 }
+};
+
+/** Evaluates the regular patch with the 12 control points at barycentric
+ *  coordinates (s, t) of the second and third corner. */
+void evaluateBoxSpline(const glm::vec3* points, float s, float t,
+                       glm::vec3& position, glm::vec3& normal) {
+  float pu[5], pv[5], pw[5];
+  pu[0] = pv[0] = pw[0] = 1.0f;
+  for(int i=1; i<5; i++) {
+    pu[i] = pu[i-1]*(1.0f - s - t);
+    pv[i] = pv[i-1]*s;
+    pw[i] = pw[i-1]*t;
+  }
+
+  // The derivatives along s and t are the partial derivatives along v and
+  // w minus the partial derivative along u = 1 - s - t
+  glm::vec3 p(0.0f), ds(0.0f), dt(0.0f);
+  for(size_t i=0; i<sizeof(box_spline_terms)/sizeof(BoxSplineTerm); i++) {
+    const BoxSplineTerm& term = box_spline_terms[i];
+    const int a = term.m_a_, b = term.m_b_, c = term.m_c_;
+    const float du = a == 0 ? 0.0f : a*pu[a-1]*pv[b]*pw[c];
+    const float dv = b == 0 ? 0.0f : b*pu[a]*pv[b-1]*pw[c];
+    const float dw = c == 0 ? 0.0f : c*pu[a]*pv[b]*pw[c-1];
+    const glm::vec3 q = term.m_coefficient_ * points[term.m_basis_];
+    p += pu[a]*pv[b]*pw[c] * q;
+    ds += (dv - du) * q;
+    dt += (dw - du) * q;
+  }
+  position = p/12.0f;
+  const glm::vec3 N = glm::cross(ds, dt);
+  const float length = glm::length(N);
+  normal = length > 0.0f ? N/length : N;
+}
+
+/** Finds the child of a triangle split 1-to-4 like in subdivideLoop()
+ *  containing the point with barycentric coordinates (u, v), and replaces
+ *  (u, v) by the coordinates in the child.
+ *  \return 0, 1 or 2 for the corner triangles, 3 for the center. */
+int findChild(float& u, float& v) {
+  const float w = 1.0f - u - v;
+  if(w > 0.5f) {
+    u = 2.0f*u;
+    v = 2.0f*v;
+    return 0;
+  } else if(u >= 0.5f) {
+    u = 2.0f*v;
+    v = 2.0f*w;
+    return 1;
+  } else if(v >= 0.5f) {
+    v = 2.0f*u;
+    u = 2.0f*w;
+    return 2;
+  } else {
+    v = 1.0f - 2.0f*u;
+    u = 1.0f - 2.0f*w;
+    return 3;
+  }
+}
+
+/** Collects the control points of the patch of the triangle of half-edge
+ *  he, where the source of he is a node of valence N, and the two other
+ *  nodes have valence 6: the source, its 1-ring in anti-clockwise order
+ *  starting at the destination of he, the three outer neighbours of the
+ *  destination and the two outer neighbours of the third node, N+6 nodes.
+ *  \return False if a node is on the boundary or has another valence. */
+bool gatherPatch(const CompactTriMesh& mesh, uint32_t he, uint32_t* points, uint32_t& N) {
+  const uint32_t v0 = mesh.getSourceNode(he);
+  const uint32_t v1 = mesh.getDestinationNode(he);
+  const uint32_t v2 = mesh.getSourceNode(CompactTriMesh::getPrev(he));
+  if(mesh.isBoundaryNode(v0) || mesh.isBoundaryNode(v1) || mesh.isBoundaryNode(v2) ||
+     mesh.getValence(v1) != 6 || mesh.getValence(v2) != 6) {
+    return false;
+  }
+  N = mesh.getValence(v0);
+  if(N > MAX_VALENCE) {
+    return false;
+  }
+
+  points[0] = v0;
+  uint32_t h = he;
+  for(uint32_t i=1; i<=N; i++) {
+    points[i] = mesh.getDestinationNode(h);
+    h = mesh.getVtxRingNext(h);
+  }
+  // Around v1 from v1->v2: v0, the last node of the ring and then the outer
+  // nodes; around v2 from v2->v0: v1, the shared outer node and then the
+  // other two
+  h = CompactTriMesh::getNext(he);
+  for(uint32_t i=1; i<=5; i++) {
+    h = mesh.getVtxRingNext(h);
+    if(i >= 3) {
+      points[N+i-2] = mesh.getDestinationNode(h);
+    }
+  }
+  h = CompactTriMesh::getPrev(he);
+  for(uint32_t i=1; i<=4; i++) {
+    h = mesh.getVtxRingNext(h);
+    if(i >= 3) {
+      points[N+i+1] = mesh.getDestinationNode(h);
+    }
+  }
+  return true;
+}
+
+}  // namespace
+
+/** The products of the picking matrices of the three regular children and
+ *  the powers of the subdivision matrix, for one valence. */
+struct LoopLimitEvaluator::ValenceTable {
+  ValenceTable(uint32_t valence);
+
+  /** Returns the 12 x (N+6) matrix giving the control points of regular
+   *  child k after n steps towards the extraordinary node. */
+  const float* getMatrix(int k, int n) const {
+    return &m_matrices_[(k*MAX_LEVELS + n)*12*m_size_];
+  }
+
+  uint32_t      m_size_;      ///< Number of control points, N+6.
+  vector<float> m_matrices_;  ///< The matrices, row by row.
+};
+
+LoopLimitEvaluator::ValenceTable::ValenceTable(uint32_t N)
+    : m_size_(N+6), m_matrices_(3*MAX_LEVELS*12*(N+6)) {
+  const uint32_t K = m_size_;
+
+  // The patch of triangle (0, 1, 2), numbered like gatherPatch(), with the
+  // outer nodes a, b, c around 1 and c, d, e around 2
+  const uint32_t a = N+1, b = N+2, c = N+3, d = N+4, e = N+5;
+  vector<uint32_t> indices;
+  for(uint32_t i=1; i<=N; i++) {
+    const uint32_t tri[3] = { 0, i, i%N+1 };
+    indices.insert(indices.end(), tri, tri+3);
+  }
+  const uint32_t outer[7][3] = {
+    { 1, N, a }, { 1, a, b }, { 1, b, c }, { 1, c, 2 }, { 2, c, d }, { 2, d, e }, { 2, e, 3 }
+  };
+  for(int i=0; i<7; i++) {
+    indices.insert(indices.end(), outer[i], outer[i]+3);
+  }
+  const CompactTriMesh patch(vector<glm::vec3>(K, glm::vec3(0.0f)), indices);
+
+  // Subdivide the patch once, the stencils give the rows of the matrices
+  vector<uint32_t> edges, first_halfedges;
+  patch.numberEdges(edges, first_halfedges);
+  StencilTable stencils;
+  patch.buildLoopStencils(first_halfedges, stencils);
+  const CompactTriMesh* refined = patch.subdivideLoop();
+
+  // The children of triangle 0 are triangles 0 to 3, the first one is the
+  // patch at the extraordinary node one level down
+  vector<vector<double> > rows[4];
+  for(int k=0; k<4; k++) {
+    uint32_t points[MAX_VALENCE+6];
+    uint32_t valence;
+    if(!gatherPatch(*refined, 3*k, points, valence) || valence != (k == 0 ? N : 6)) {
+      delete refined;
+      throw std::runtime_error("LoopLimitEvaluator: unexpected patch in the subdivided patch");
+    }
+    rows[k].assign(valence+6, vector<double>(K, 0.0));
+    for(uint32_t i=0; i<valence+6; i++) {
+      for(uint32_t j=stencils.m_offsets_[points[i]]; j<stencils.m_offsets_[points[i]+1]; j++) {
+        rows[k][i][stencils.m_indices_[j]] += stencils.m_weights_[j];
+      }
+    }
+  }
+  delete refined;
+
+  // P_k A^n = P_k A^(n-1) A
+  for(int k=0; k<3; k++) {
+    vector<vector<double> > M(rows[k+1]);
+    for(int n=0; n<MAX_LEVELS; n++) {
+      float* matrix = &m_matrices_[((k*MAX_LEVELS + n)*12)*K];
+      for(uint32_t i=0; i<12; i++) {
+        for(uint32_t j=0; j<K; j++) {
+          matrix[i*K+j] = M[i][j];
+        }
+      }
+      vector<vector<double> > MA(12, vector<double>(K, 0.0));
+      for(uint32_t i=0; i<12; i++) {
+        for(uint32_t l=0; l<K; l++) {
+          for(uint32_t j=0; j<K; j++) {
+            MA[i][j] += M[i][l]*rows[0][l][j];
+          }
+        }
+      }
+      M.swap(MA);
+    }
+  }
+}
+
+LoopLimitEvaluator::LoopLimitEvaluator(const CompactTriMesh& mesh)
+    : m_refined(mesh.subdivideLoop()), m_tables(MAX_VALENCE+1, NULL) {
+  computeLimitNodes(*m_refined, m_limit_positions, m_limit_normals);
+
+  const long Nv = m_refined->getNumNodes();
+  for(long v=0; v<Nv; v++) {
+    if(m_refined->getLeadingHalfEdge(v) != NONE && !m_refined->isBoundaryNode(v)) {
+      const size_t valence = m_refined->getValence(v);
+      if(valence != 6 && valence <= MAX_VALENCE && m_tables[valence] == NULL) {
+        m_tables[valence] = new ValenceTable(valence);
+      }
+    }
+  }
+}
+
+LoopLimitEvaluator::~LoopLimitEvaluator() {
+  for(size_t i=0; i<m_tables.size(); i++) {
+    delete m_tables[i];
+  }
+  delete m_refined;
+}
+
+void LoopLimitEvaluator::evaluate(uint32_t face, float u, float v,
+                                  glm::vec3& position, glm::vec3& normal) const {
+  const int k = findChild(u, v);
+  evaluateRefined(4*face+k, u, v, position, normal);
+}
+
+void LoopLimitEvaluator::evaluate(const vector<uint32_t>& faces, const vector<glm::vec2>& uvs,
+                                  vector<glm::vec3>& positions, vector<glm::vec3>& normals) const {
+  const long N = faces.size();
+  positions.resize(N);
+  normals.resize(N);
+#pragma omp parallel for schedule(dynamic, 1024)
+  for(long i=0; i<N; i++) {
+    evaluate(faces[i], uvs[i].x, uvs[i].y, positions[i], normals[i]);
+  }
+}
+
+void LoopLimitEvaluator::evaluateRefined(uint32_t face, float u, float v,
+                                         glm::vec3& position, glm::vec3& normal) const {
+  const CompactTriMesh& mesh = *m_refined;
+  const vector<glm::vec3>& p = mesh.getPositions();
+
+  // Rotate the triangle so that the extraordinary node, if any, comes first
+  const float w[3] = { 1.0f - u - v, u, v };
+  uint32_t corner = 0;
+  for(uint32_t k=0; k<3; k++) {
+    const uint32_t node = mesh.getSourceNode(3*face+k);
+    if(!mesh.isBoundaryNode(node) && mesh.getValence(node) != 6) {
+      corner = k;
+    }
+  }
+  float s = w[(corner+1)%3];
+  float t = w[(corner+2)%3];
+
+  uint32_t points[MAX_VALENCE+6];
+  uint32_t N;
+  if(!gatherPatch(mesh, 3*face+corner, points, N)) {
+    // Boundary patches are interpolated from their nodes
+    position = glm::vec3(0.0f);
+    normal = glm::vec3(0.0f);
+    for(uint32_t k=0; k<3; k++) {
+      const uint32_t node = mesh.getSourceNode(3*face+k);
+      position += w[k]*m_limit_positions[node];
+      normal += w[k]*m_limit_normals[node];
+    }
+    const float length = glm::length(normal);
+    normal = length > 0.0f ? normal/length : normal;
+    return;
+  }
+
+  glm::vec3 control[12];
+  if(N == 6) {
+    for(uint32_t i=0; i<12; i++) {
+      control[i] = p[points[i]];
+    }
+    evaluateBoxSpline(control, s, t, position, normal);
+    return;
+  }
+
+  // Step towards the extraordinary node until the point is in one of the
+  // regular children
+  int n = 0;
+  while(s + t < 0.5f && n < MAX_LEVELS) {
+    s *= 2.0f;
+    t *= 2.0f;
+    n++;
+  }
+  if(n == MAX_LEVELS || s + t <= 0.0f) {
+    position = m_limit_positions[points[0]];
+    normal = m_limit_normals[points[0]];
+    return;
+  }
+  const int k = findChild(s, t);
+  const float* matrix = m_tables[N]->getMatrix(k-1, n);
+  const uint32_t K = N+6;
+  for(uint32_t i=0; i<12; i++) {
+    control[i] = glm::vec3(0.0f);
+    for(uint32_t j=0; j<K; j++) {
+      control[i] += matrix[i*K+j]*p[points[j]];
+    }
+  }
+  evaluateBoxSpline(control, s, t, position, normal);
+}
+
+void LoopLimitEvaluator::computeLimitNodes(const CompactTriMesh& mesh, vector<glm::vec3>& positions,
+                                           vector<glm::vec3>& normals) {
+  const long Nv = mesh.getNumNodes();
+  const vector<glm::vec3>& p = mesh.getPositions();
+  positions.resize(Nv);
+  normals.resize(Nv);
+#pragma omp parallel for schedule(dynamic, 1024)
+  for(long v=0; v<Nv; v++) {
+    const uint32_t first = mesh.getLeadingHalfEdge(v);
+    positions[v] = p[v];
+    normals[v] = mesh.getNormal(v);
+    if(first == NONE) {
+      continue;
+    }
+    if(mesh.isBoundaryNode(v)) {
+      // The limit of the boundary curve, the normal is left as it is
+      uint32_t last = first;
+      for(uint32_t he = mesh.getVtxRingNext(first); he != NONE; he = mesh.getVtxRingNext(he)) {
+        last = he;
+      }
+      positions[v] = (2.0f/3.0f)*p[v] + (1.0f/6.0f)*(p[mesh.getDestinationNode(first)] +
+                                                     p[mesh.getSourceNode(CompactTriMesh::getPrev(last))]);
+      continue;
+    }
+
+    // The limit masks of an inner node of valence n: the node and its ring
+    // weighted by 1 - n*chi and chi, and the two tangents weighted by the
+    // cosine and sine of the angle of each neighbour
+    const size_t n = mesh.getValence(v);
+    const float c = 0.375f + 0.25f*std::cos(2.0f*float(M_PI)/n);
+    const float beta = (0.625f - c*c)/n;
+    const float chi = 1.0f/(n + 0.375f/beta);
+    glm::vec3 sum(0.0f), t1(0.0f), t2(0.0f);
+    uint32_t he = first;
+    for(size_t i=0; i<n; i++) {
+      const glm::vec3& q = p[mesh.getDestinationNode(he)];
+      sum += q;
+      t1 += std::cos(2.0f*float(M_PI)*i/n)*q;
+      t2 += std::sin(2.0f*float(M_PI)*i/n)*q;
+      he = mesh.getVtxRingNext(he);
+    }
+    positions[v] = (1.0f - n*chi)*p[v] + chi*sum;
+    const glm::vec3 N = glm::cross(t1, t2);
+    const float length = glm::length(N);
+    if(length > 0.0f) {
+      normals[v] = N/length;
+    }
+  }
+}
+
+}  // GfxUtil
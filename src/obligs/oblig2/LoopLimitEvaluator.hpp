@@ -0,0 +1,76 @@
+/* LoopLimitEvaluator.hpp
+ *
+ * Distributed under the GNU GPL.
+ */
+
+#ifndef GFXUTIL_LOOPLIMITEVALUATOR_H
+#define GFXUTIL_LOOPLIMITEVALUATOR_H
+
+#include <vector>
+#include <stdint.h>
+#include <glm/glm.hpp>
+
+#include "CompactTriMesh.hpp"
+
+namespace GfxUtil {
+
+/** Evaluates the limit surface of Loop-subdivision directly, following
+ *  Stam, "Evaluation of Loop Subdivision Surfaces", SIGGRAPH 1998.
+ *
+ *  Around a triangle with all nodes of valence 6, the limit surface is a
+ *  quartic box spline given by the 12 nodes of the 1-rings of the triangle.
+ *  Around a triangle with one extraordinary node of valence N, it is a
+ *  sequence of such box spline patches, that shrink towards the
+ *  extraordinary node. The control points of the patch at level n are
+ *  P_k A^n times the N+6 nodes of the 1-rings of the triangle, where A is
+ *  the subdivision matrix and P_k picks one of the three regular children.
+ *  Stam computes A^n from the eigenbasis of A, here the products P_k A^n are
+ *  tabulated for each valence when the evaluator is created, which gives
+ *  the same O(1) cost per query.
+ *
+ *  The mesh is subdivided once up front, so that each triangle has at most
+ *  one extraordinary node. Triangles touching the boundary are not covered
+ *  by Stam's method, and are interpolated from the limit positions and
+ *  normals of their nodes.
+ */
+class LoopLimitEvaluator {
+ public:
+  /** Constructor, tabulates the valences used by the mesh. */
+  LoopLimitEvaluator(const CompactTriMesh& mesh);
+
+  /** Destructor. */
+  ~LoopLimitEvaluator();
+
+  /** Evaluates the limit surface at a point of a triangle of the mesh.
+   *  \param face The triangle.
+   *  \param u, v Barycentric coordinates, the point (0, 0) corresponds to
+   *              the first node of the triangle, (1, 0) to the second and
+   *              (0, 1) to the third.
+   *  \param position Set to the position on the limit surface.
+   *  \param normal Set to the unit normal of the limit surface. */
+  void evaluate(uint32_t face, float u, float v, glm::vec3& position, glm::vec3& normal) const;
+
+  /** Evaluates the limit surface at many points in parallel. */
+  void evaluate(const std::vector<uint32_t>& faces, const std::vector<glm::vec2>& uvs,
+                std::vector<glm::vec3>& positions, std::vector<glm::vec3>& normals) const;
+
+  /** Computes the limit position and normal of every node of a mesh, e.g.
+   *  for smooth shading of a coarse mesh. */
+  static void computeLimitNodes(const CompactTriMesh& mesh, std::vector<glm::vec3>& positions,
+                                std::vector<glm::vec3>& normals);
+
+ protected:
+  struct ValenceTable;
+
+  /** Evaluates the limit surface of a triangle of the subdivided mesh. */
+  void evaluateRefined(uint32_t face, float u, float v, glm::vec3& position, glm::vec3& normal) const;
+
+  CompactTriMesh*            m_refined;  /// The mesh subdivided once.
+  std::vector<glm::vec3>     m_limit_positions;  /// Limit position of each node of m_refined.
+  std::vector<glm::vec3>     m_limit_normals;    /// Limit normal of each node of m_refined.
+  std::vector<ValenceTable*> m_tables;   /// Tables of each valence, or NULL.
+};
+
+}  // GfxUtil
+
+#endif
@@ -0,0 +1,526 @@
+/* MeshBvh.cpp
+ *
+ * Distributed under the GNU GPL.
+ */
+
+#include "MeshBvh.hpp"
+
+#include <cmath>
+#include <vector>
+#include <limits>
+#include <algorithm>
+#include <glm/glm.hpp>
+
+using std::vector;
+
+namespace GfxUtil {
+
+const uint32_t MeshBvh::NONE;
+
+namespace {
+
+const size_t NUM_BINS = 12;
+
+/** Half the surface area of a box, which is proportional to the chance
+ *  that a random ray hits it. */
+float halfArea(const glm::vec3& min, const glm::vec3& max) {
+  const glm::vec3 d = glm::max(max - min, glm::vec3(0.0f));
+  return d.x*d.y + d.y*d.z + d.z*d.x;
+}
+
+/** Three times the centroid of a triangle along an axis. */
+struct CentroidOnAxis {
+  CentroidOnAxis(const vector<glm::vec3>& positions, const vector<uint32_t>& indices, int axis)
+      : m_positions_(positions), m_indices_(indices), m_axis_(axis) {
+  }
+
+  float operator()(uint32_t t) const {
+    return m_positions_[m_indices_[3*t]][m_axis_] + m_positions_[m_indices_[3*t+1]][m_axis_] +
+           m_positions_[m_indices_[3*t+2]][m_axis_];
+  }
+
+  const vector<glm::vec3>& m_positions_;  ///< Positions of the nodes.
+  const vector<uint32_t>&  m_indices_;    ///< Three nodes per triangle.
+  int                      m_axis_;       ///< The axis.
+};
+
+/** True for the triangles whose centroid falls in the bins below a cut. */
+struct CentroidInBins {
+  CentroidInBins(const CentroidOnAxis& centroid, float min, float scale, size_t cut)
+      : m_centroid_(centroid), m_min_(min), m_scale_(scale), m_cut_(cut) {
+  }
+
+  size_t getBin(uint32_t t) const {
+    return std::min(size_t((m_centroid_(t) - m_min_)*m_scale_), NUM_BINS-1);
+  }
+
+  bool operator()(uint32_t t) const {
+    return getBin(t) < m_cut_;
+  }
+
+  const CentroidOnAxis& m_centroid_;  ///< Centroids of the triangles.
+  float                 m_min_;       ///< Smallest centroid.
+  float                 m_scale_;     ///< Bins per unit.
+  size_t                m_cut_;       ///< First bin above the cut.
+};
+
+/** Orders triangles by their centroid, and ties by index. */
+struct CentroidLess {
+  CentroidLess(const CentroidOnAxis& centroid) : m_centroid_(centroid) {
+  }
+
+  bool operator()(uint32_t s, uint32_t t) const {
+    const float cs = m_centroid_(s);
+    const float ct = m_centroid_(t);
+    return cs < ct || (cs == ct && s < t);
+  }
+
+  const CentroidOnAxis& m_centroid_;  ///< Centroids of the triangles.
+};
+
+/** Returns the distance along the ray to where it enters the box, or
+ *  infinity if it misses it before max_distance. */
+float intersectBox(const glm::vec3& min, const glm::vec3& max, const glm::vec3& origin,
+                   const glm::vec3& inverse_direction, float max_distance) {
+  const glm::vec3 t0 = (min - origin)*inverse_direction;
+  const glm::vec3 t1 = (max - origin)*inverse_direction;
+  const glm::vec3 near = glm::min(t0, t1);
+  const glm::vec3 far = glm::max(t0, t1);
+  const float enter = std::max(std::max(near.x, near.y), std::max(near.z, 0.0f));
+  const float exit = std::min(std::min(far.x, far.y), std::min(far.z, max_distance));
+  return enter <= exit ? enter : std::numeric_limits<float>::infinity();
+}
+
+/** Returns the squared distance from p to the box. */
+float distanceToBox2(const glm::vec3& min, const glm::vec3& max, const glm::vec3& p) {
+  const glm::vec3 d = glm::max(glm::max(min - p, p - max), glm::vec3(0.0f));
+  return glm::dot(d, d);
+}
+
+}  // namespace
+
+MeshBvh::MeshBvh(const CompactTriMesh& mesh, size_t max_leaf_size)
+    : m_mesh(NULL), m_max_leaf_size(std::max(max_leaf_size, size_t(1))), m_depth(0) {
+  build(mesh);
+}
+
+void MeshBvh::build(const CompactTriMesh& mesh) {
+  const long Nt = mesh.getNumTriangles();
+  m_mesh = &mesh;
+  m_triangles.resize(Nt);
+#pragma omp parallel for
+  for(long t=0; t<Nt; t++) {
+    m_triangles[t] = t;
+  }
+
+  m_nodes.resize(1);
+  m_nodes[0].m_first_ = 0;
+  m_nodes[0].m_count_ = Nt;
+  splitLeaves(vector<uint32_t>(1, 0));
+  refit();
+}
+
+void MeshBvh::refine(const CompactTriMesh& refined, uint32_t children) {
+  const long Nt = m_triangles.size();
+  const long Nn = m_nodes.size();
+  m_mesh = &refined;
+
+  // The children of each triangle take its place, so the leaves keep their
+  // triangles in the same order, only more of them
+  vector<uint32_t> triangles(children*Nt);
+#pragma omp parallel for
+  for(long i=0; i<Nt; i++) {
+    for(uint32_t k=0; k<children; k++) {
+      triangles[children*i+k] = children*m_triangles[i]+k;
+    }
+  }
+  m_triangles.swap(triangles);
+
+  vector<uint32_t> leaves;
+  for(long n=0; n<Nn; n++) {
+    Node& node = m_nodes[n];
+    if(node.m_count_ > 0) {
+      node.m_first_ *= children;
+      node.m_count_ *= children;
+      leaves.push_back(n);
+    }
+  }
+  splitLeaves(leaves);
+  refit();
+}
+
+void MeshBvh::splitLeaves(vector<uint32_t> leaves) {
+  // The depth of each node bounds the traversal stack, children are always
+  // stored after their parent
+  vector<uint32_t> depths(m_nodes.size(), 0);
+  for(size_t n=0; n<m_nodes.size(); n++) {
+    if(m_nodes[n].m_count_ == 0) {
+      depths[m_nodes[n].m_first_] = depths[m_nodes[n].m_first_+1] = depths[n]+1;
+    }
+  }
+
+  // Split the leaves of one level in parallel, then add their children in
+  // order, and continue with the children
+  vector<uint32_t> splits;
+  while(!leaves.empty()) {
+    const long Nl = leaves.size();
+    splits.assign(Nl, NONE);
+#pragma omp parallel for schedule(dynamic, 1)
+    for(long i=0; i<Nl; i++) {
+      if(depths[leaves[i]] + 1 < STACK_SIZE) {
+        splits[i] = findSplit(m_nodes[leaves[i]]);
+      }
+    }
+
+    vector<uint32_t> next;
+    for(long i=0; i<Nl; i++) {
+      if(splits[i] == NONE) {
+        continue;
+      }
+      const uint32_t first = m_nodes[leaves[i]].m_first_;
+      const uint32_t count = m_nodes[leaves[i]].m_count_;
+      const uint32_t child = m_nodes.size();
+      Node left, right;
+      left.m_first_ = first;
+      left.m_count_ = splits[i] - first;
+      right.m_first_ = splits[i];
+      right.m_count_ = first + count - splits[i];
+      m_nodes.push_back(left);
+      m_nodes.push_back(right);
+      m_nodes[leaves[i]].m_first_ = child;
+      m_nodes[leaves[i]].m_count_ = 0;
+      depths.push_back(depths[leaves[i]]+1);
+      depths.push_back(depths[leaves[i]]+1);
+      next.push_back(child);
+      next.push_back(child+1);
+    }
+    leaves.swap(next);
+  }
+}
+
+uint32_t MeshBvh::findSplit(const Node& leaf) {
+  if(leaf.m_count_ <= m_max_leaf_size) {
+    return NONE;
+  }
+  const vector<glm::vec3>& positions = m_mesh->getPositions();
+  const vector<uint32_t>& indices = m_mesh->getIndices();
+  uint32_t* const begin = &m_triangles[leaf.m_first_];
+  uint32_t* const end = begin + leaf.m_count_;
+
+  // Bin the triangles by their centroid along the longest axis of the
+  // centroids, each triangle adding its box to its bin
+  glm::vec3 centroid_min(std::numeric_limits<float>::max());
+  glm::vec3 centroid_max(-std::numeric_limits<float>::max());
+  for(uint32_t* t=begin; t!=end; t++) {
+    const glm::vec3 c = positions[indices[3**t]] + positions[indices[3**t+1]] +
+                        positions[indices[3**t+2]];
+    centroid_min = glm::min(centroid_min, c);
+    centroid_max = glm::max(centroid_max, c);
+  }
+  const glm::vec3 extent = centroid_max - centroid_min;
+  const int axis = extent.x > extent.y ? (extent.x > extent.z ? 0 : 2)
+                                       : (extent.y > extent.z ? 1 : 2);
+  if(!(extent[axis] > 0.0f)) {
+    return NONE;
+  }
+  const float scale = NUM_BINS/extent[axis];
+  const CentroidOnAxis centroid(positions, indices, axis);
+  const CentroidInBins bins(centroid, centroid_min[axis], scale, 0);
+
+  size_t counts[NUM_BINS] = { 0 };
+  glm::vec3 bin_min[NUM_BINS], bin_max[NUM_BINS];
+  for(size_t b=0; b<NUM_BINS; b++) {
+    bin_min[b] = glm::vec3(std::numeric_limits<float>::max());
+    bin_max[b] = glm::vec3(-std::numeric_limits<float>::max());
+  }
+  for(uint32_t* t=begin; t!=end; t++) {
+    const glm::vec3& a = positions[indices[3**t]];
+    const glm::vec3& b = positions[indices[3**t+1]];
+    const glm::vec3& c = positions[indices[3**t+2]];
+    const size_t bin = bins.getBin(*t);
+    counts[bin]++;
+    bin_min[bin] = glm::min(bin_min[bin], glm::min(a, glm::min(b, c)));
+    bin_max[bin] = glm::max(bin_max[bin], glm::max(a, glm::max(b, c)));
+  }
+
+  // Sweep from the right, then from the left, to find the cheapest split
+  float right_cost[NUM_BINS];
+  glm::vec3 box_min(std::numeric_limits<float>::max());
+  glm::vec3 box_max(-std::numeric_limits<float>::max());
+  size_t count = 0;
+  for(size_t b=NUM_BINS-1; b>0; b--) {
+    box_min = glm::min(box_min, bin_min[b]);
+    box_max = glm::max(box_max, bin_max[b]);
+    count += counts[b];
+    right_cost[b] = count*halfArea(box_min, box_max);
+  }
+  box_min = glm::vec3(std::numeric_limits<float>::max());
+  box_max = glm::vec3(-std::numeric_limits<float>::max());
+  count = 0;
+  float best_cost = std::numeric_limits<float>::max();
+  size_t best = 0;
+  for(size_t b=1; b<NUM_BINS; b++) {
+    box_min = glm::min(box_min, bin_min[b-1]);
+    box_max = glm::max(box_max, bin_max[b-1]);
+    count += counts[b-1];
+    const float cost = count*halfArea(box_min, box_max) + right_cost[b];
+    if(count > 0 && count < leaf.m_count_ && cost < best_cost) {
+      best_cost = cost;
+      best = b;
+    }
+  }
+
+  // Both sides of the cut have triangles, if all centroids fall in one bin
+  // there is no cut, and the triangles are split at the median instead
+  uint32_t* middle;
+  if(best > 0) {
+    middle = std::partition(begin, end, CentroidInBins(centroid, centroid_min[axis], scale, best));
+  } else {
+    middle = begin + leaf.m_count_/2;
+    std::nth_element(begin, middle, end, CentroidLess(centroid));
+  }
+  return leaf.m_first_ + (middle - begin);
+}
+
+void MeshBvh::refit() {
+  const long Nn = m_nodes.size();
+  const vector<glm::vec3>& positions = m_mesh->getPositions();
+  const vector<uint32_t>& indices = m_mesh->getIndices();
+
+#pragma omp parallel for schedule(dynamic, 256)
+  for(long n=0; n<Nn; n++) {
+    Node& node = m_nodes[n];
+    if(node.m_count_ == 0) {
+      continue;
+    }
+    node.m_min_ = glm::vec3(std::numeric_limits<float>::max());
+    node.m_max_ = glm::vec3(-std::numeric_limits<float>::max());
+    for(uint32_t i=node.m_first_; i<node.m_first_+node.m_count_; i++) {
+      for(uint32_t k=0; k<3; k++) {
+        const glm::vec3& p = positions[indices[3*m_triangles[i]+k]];
+        node.m_min_ = glm::min(node.m_min_, p);
+        node.m_max_ = glm::max(node.m_max_, p);
+      }
+    }
+  }
+
+  vector<uint32_t> depths(Nn, 0);
+  for(long n=0; n<Nn; n++) {
+    if(m_nodes[n].m_count_ == 0) {
+      depths[m_nodes[n].m_first_] = depths[m_nodes[n].m_first_+1] = depths[n]+1;
+    }
+  }
+  m_depth = 0;
+  for(long n=Nn-1; n>=0; n--) {
+    Node& node = m_nodes[n];
+    m_depth = std::max(m_depth, size_t(depths[n]));
+    if(node.m_count_ == 0) {
+      const Node& left = m_nodes[node.m_first_];
+      const Node& right = m_nodes[node.m_first_+1];
+      node.m_min_ = glm::min(left.m_min_, right.m_min_);
+      node.m_max_ = glm::max(left.m_max_, right.m_max_);
+    }
+  }
+}
+
+bool MeshBvh::intersectRay(const glm::vec3& origin, const glm::vec3& direction, RayHit& hit,
+                           float max_distance) const {
+  const vector<glm::vec3>& positions = m_mesh->getPositions();
+  const vector<uint32_t>& indices = m_mesh->getIndices();
+  const glm::vec3 inverse_direction = 1.0f/direction;
+  hit.m_triangle_ = NONE;
+  hit.m_distance_ = max_distance;
+  if(m_nodes.empty() || m_triangles.empty()) {
+    return false;
+  }
+
+  // Visit the nearest child first, and skip boxes behind the closest hit
+  uint32_t stack[STACK_SIZE];
+  size_t size = 0;
+  uint32_t n = 0;
+  if(intersectBox(m_nodes[0].m_min_, m_nodes[0].m_max_, origin, inverse_direction,
+                  hit.m_distance_) == std::numeric_limits<float>::infinity()) {
+    return false;
+  }
+  while(true) {
+    const Node& node = m_nodes[n];
+    if(node.m_count_ > 0) {
+      // Möller and Trumbore, "Fast, minimum storage ray/triangle intersection"
+      for(uint32_t i=node.m_first_; i<node.m_first_+node.m_count_; i++) {
+        const uint32_t t = m_triangles[i];
+        const glm::vec3& a = positions[indices[3*t]];
+        const glm::vec3 e1 = positions[indices[3*t+1]] - a;
+        const glm::vec3 e2 = positions[indices[3*t+2]] - a;
+        const glm::vec3 p = glm::cross(direction, e2);
+        const float det = glm::dot(e1, p);
+        if(det == 0.0f) {
+          continue;
+        }
+        const float inverse_det = 1.0f/det;
+        const glm::vec3 s = origin - a;
+        const float u = glm::dot(s, p)*inverse_det;
+        if(u < 0.0f || u > 1.0f) {
+          continue;
+        }
+        const glm::vec3 q = glm::cross(s, e1);
+        const float v = glm::dot(direction, q)*inverse_det;
+        if(v < 0.0f || u + v > 1.0f) {
+          continue;
+        }
+        const float distance = glm::dot(e2, q)*inverse_det;
+        if(distance >= 0.0f && distance <= hit.m_distance_) {
+          hit.m_distance_ = distance;
+          hit.m_triangle_ = t;
+          hit.m_u_ = u;
+          hit.m_v_ = v;
+        }
+      }
+    } else {
+      uint32_t near = node.m_first_, far = node.m_first_+1;
+      float near_distance = intersectBox(m_nodes[near].m_min_, m_nodes[near].m_max_,
+                                         origin, inverse_direction, hit.m_distance_);
+      float far_distance = intersectBox(m_nodes[far].m_min_, m_nodes[far].m_max_,
+                                        origin, inverse_direction, hit.m_distance_);
+      if(far_distance < near_distance) {
+        std::swap(near, far);
+        std::swap(near_distance, far_distance);
+      }
+      if(near_distance != std::numeric_limits<float>::infinity()) {
+        if(far_distance != std::numeric_limits<float>::infinity()) {
+          stack[size++] = far;
+        }
+        n = near;
+        continue;
+      }
+    }
+
+    // Pop the next box that is still in front of the closest hit
+    bool found = false;
+    while(size > 0 && !found) {
+      n = stack[--size];
+      found = intersectBox(m_nodes[n].m_min_, m_nodes[n].m_max_, origin, inverse_direction,
+                           hit.m_distance_) != std::numeric_limits<float>::infinity();
+    }
+    if(!found) {
+      break;
+    }
+  }
+  return hit.m_triangle_ != NONE;
+}
+
+bool MeshBvh::findClosestPoint(const glm::vec3& point, glm::vec3& closest, uint32_t& triangle,
+                               float max_distance) const {
+  triangle = NONE;
+  if(m_nodes.empty() || m_triangles.empty()) {
+    return false;
+  }
+  float best = max_distance*max_distance;
+
+  // Visit the nearest child first, and skip boxes further away than the
+  // closest point so far
+  uint32_t stack[STACK_SIZE];
+  size_t size = 0;
+  stack[size++] = 0;
+  while(size > 0) {
+    const Node& node = m_nodes[stack[--size]];
+    if(distanceToBox2(node.m_min_, node.m_max_, point) > best) {
+      continue;
+    }
+    if(node.m_count_ > 0) {
+      for(uint32_t i=node.m_first_; i<node.m_first_+node.m_count_; i++) {
+        const glm::vec3 p = closestPointOnTriangle(point, m_triangles[i]);
+        const float distance2 = glm::dot(p - point, p - point);
+        if(distance2 <= best) {
+          best = distance2;
+          closest = p;
+          triangle = m_triangles[i];
+        }
+      }
+    } else {
+      uint32_t near = node.m_first_, far = node.m_first_+1;
+      if(distanceToBox2(m_nodes[far].m_min_, m_nodes[far].m_max_, point) <
+         distanceToBox2(m_nodes[near].m_min_, m_nodes[near].m_max_, point)) {
+        std::swap(near, far);
+      }
+      stack[size++] = far;
+      stack[size++] = near;
+    }
+  }
+  return triangle != NONE;
+}
+
+void MeshBvh::findTriangles(const glm::vec3& center, float radius,
+                            vector<uint32_t>& triangles) const {
+  if(m_nodes.empty() || m_triangles.empty()) {
+    return;
+  }
+  const float radius2 = radius*radius;
+  uint32_t stack[STACK_SIZE];
+  size_t size = 0;
+  stack[size++] = 0;
+  while(size > 0) {
+    const Node& node = m_nodes[stack[--size]];
+    if(distanceToBox2(node.m_min_, node.m_max_, center) > radius2) {
+      continue;
+    }
+    if(node.m_count_ > 0) {
+      for(uint32_t i=node.m_first_; i<node.m_first_+node.m_count_; i++) {
+        const glm::vec3 p = closestPointOnTriangle(center, m_triangles[i]);
+        if(glm::dot(p - center, p - center) <= radius2) {
+          triangles.push_back(m_triangles[i]);
+        }
+      }
+    } else {
+      stack[size++] = node.m_first_+1;
+      stack[size++] = node.m_first_;
+    }
+  }
+}
+
+glm::vec3 MeshBvh::closestPointOnTriangle(const glm::vec3& p, uint32_t t) const {
+  // Ericson, "Real-Time Collision Detection", section 5.1.5: find the
+  // Voronoi region of p among the nodes, edges and face
+  const vector<uint32_t>& indices = m_mesh->getIndices();
+  const glm::vec3& a = m_mesh->getPosition(indices[3*t]);
+  const glm::vec3& b = m_mesh->getPosition(indices[3*t+1]);
+  const glm::vec3& c = m_mesh->getPosition(indices[3*t+2]);
+  const glm::vec3 ab = b - a;
+  const glm::vec3 ac = c - a;
+  const glm::vec3 ap = p - a;
+  const float d1 = glm::dot(ab, ap);
+  const float d2 = glm::dot(ac, ap);
+  if(d1 <= 0.0f && d2 <= 0.0f) {
+    return a;
+  }
+  const glm::vec3 bp = p - b;
+  const float d3 = glm::dot(ab, bp);
+  const float d4 = glm::dot(ac, bp);
+  if(d3 >= 0.0f && d4 <= d3) {
+    return b;
+  }
+  const float vc = d1*d4 - d3*d2;
+  if(vc <= 0.0f && d1 >= 0.0f && d3 <= 0.0f) {
+    return a + (d1/(d1 - d3))*ab;
+  }
+  const glm::vec3 cp = p - c;
+  const float d5 = glm::dot(ab, cp);
+  const float d6 = glm::dot(ac, cp);
+  if(d6 >= 0.0f && d5 <= d6) {
+    return c;
+  }
+  const float vb = d5*d2 - d1*d6;
+  if(vb <= 0.0f && d2 >= 0.0f && d6 <= 0.0f) {
+    return a + (d2/(d2 - d6))*ac;
+  }
+  const float va = d3*d6 - d5*d4;
+  if(va <= 0.0f && (d4 - d3) >= 0.0f && (d5 - d6) >= 0.0f) {
+    return b + ((d4 - d3)/((d4 - d3) + (d5 - d6)))*(c - b);
+  }
+  const float denominator = va + vb + vc;
+  if(denominator == 0.0f) {
+    return a;
+  }
+  return a + (vb/denominator)*ab + (vc/denominator)*ac;
+}
+
+}  // GfxUtil
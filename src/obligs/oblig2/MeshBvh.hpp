@@ -0,0 +1,118 @@
+/* MeshBvh.hpp
+ *
+ * Distributed under the GNU GPL.
+ */
+
+#ifndef GFXUTIL_MESHBVH_H
+#define GFXUTIL_MESHBVH_H
+
+#include <vector>
+#include <limits>
+#include <stdint.h>
+#include <glm/glm.hpp>
+
+#include "CompactTriMesh.hpp"
+
+namespace GfxUtil {
+
+/** Bounding volume hierarchy over the triangles of a CompactTriMesh, for
+ *  ray picking, closest point and radius queries in logarithmic time.
+ *
+ *  The tree is built top-down with the surface area heuristic over binned
+ *  triangle centroids. The nodes are split level by level, the nodes of a
+ *  level in parallel, so the tree does not depend on the number of threads.
+ *  Children are stored after their parent, so the boxes are refitted in
+ *  one backwards pass.
+ *
+ *  After subdivision, the tree is refined instead of built again: each leaf
+ *  gets the children of its triangles, leaves that grow too large are split
+ *  further, and the boxes are refitted, e.g.
+ *
+ *    MeshBvh bvh(*mesh);
+ *    CompactTriMesh* refined = mesh->subdivideLoop();
+ *    bvh.refine(*refined, 4);
+ *
+ *  or bvh.refine(*mesh, 3) after mesh->subdivideSqrt3(). The tree refers to
+ *  the mesh, which must outlive it or be given to build() or refine().
+ */
+class MeshBvh {
+ public:
+  /** The closest intersection of a ray and the mesh. */
+  struct RayHit {
+    float    m_distance_;  ///< Distance along the ray, in units of its direction.
+    uint32_t m_triangle_;  ///< The triangle hit.
+    float    m_u_;         ///< Barycentric coordinate of the second node of the triangle.
+    float    m_v_;         ///< Barycentric coordinate of the third node of the triangle.
+  };
+
+  /** Constructor, builds the tree.
+   *  \param max_leaf_size Leaves with more triangles are always split. */
+  MeshBvh(const CompactTriMesh& mesh, size_t max_leaf_size = 4);
+
+  /** Builds the tree over the triangles of a mesh from scratch. */
+  void build(const CompactTriMesh& mesh);
+
+  /** Updates the tree for a mesh refined from the current one, where
+   *  triangle t is split into the triangles children*t to children*t +
+   *  children-1, as subdivideLoop() (4) and subdivideSqrt3() (3) do. */
+  void refine(const CompactTriMesh& refined, uint32_t children);
+
+  /** Finds the closest triangle hit by the ray origin + t*direction, for
+   *  0 <= t <= max_distance.
+   *  \return False if no triangle is hit. */
+  bool intersectRay(const glm::vec3& origin, const glm::vec3& direction, RayHit& hit,
+                    float max_distance = std::numeric_limits<float>::max()) const;
+
+  /** Finds the closest point on the mesh, within max_distance of point.
+   *  \return False if the mesh is further away. */
+  bool findClosestPoint(const glm::vec3& point, glm::vec3& closest, uint32_t& triangle,
+                        float max_distance = std::numeric_limits<float>::max()) const;
+
+  /** Appends the triangles within radius of center to triangles. */
+  void findTriangles(const glm::vec3& center, float radius,
+                     std::vector<uint32_t>& triangles) const;
+
+  /** Returns the number of nodes of the tree. */
+  size_t getNumNodes() const { return m_nodes.size(); }
+
+  /** Returns the depth of the tree. */
+  size_t getDepth() const { return m_depth; }
+
+ protected:
+  /** A node, 32 bytes. Inner nodes have the children m_first_ and
+   *  m_first_+1, leaves the triangles m_first_ to m_first_+m_count_-1 of
+   *  m_triangles. */
+  struct Node {
+    glm::vec3 m_min_;    ///< Minimum x,y,z-values of the triangles below.
+    glm::vec3 m_max_;    ///< Maximum x,y,z-values of the triangles below.
+    uint32_t  m_first_;  ///< First child, or first triangle of a leaf.
+    uint32_t  m_count_;  ///< Number of triangles of a leaf, 0 for inner nodes.
+  };
+
+  /** Splits the given leaves, and their children, until every leaf is
+   *  small enough or cannot be split. */
+  void splitLeaves(std::vector<uint32_t> leaves);
+
+  /** Splits the triangles of a leaf by the surface area heuristic, and
+   *  returns where the second half starts, or NONE to keep the leaf. */
+  uint32_t findSplit(const Node& leaf);
+
+  /** Recomputes the boxes of all nodes, and the depth. */
+  void refit();
+
+  /** Returns the closest point to p on triangle t. */
+  glm::vec3 closestPointOnTriangle(const glm::vec3& p, uint32_t t) const;
+
+  static const uint32_t NONE = CompactTriMesh::NONE;
+  static const size_t   STACK_SIZE = 64;
+
+  const CompactTriMesh*  m_mesh;           /// The mesh, not owned.
+  std::vector<Node>      m_nodes;          /// The nodes, the root first.
+  std::vector<uint32_t>  m_triangles;      /// The triangles of the leaves.
+  size_t                 m_max_leaf_size;  /// Leaves with more triangles are split.
+  size_t                 m_depth;          /// Depth of the tree.
+};
+
+}  // GfxUtil
+
+#endif
@@ -0,0 +1,502 @@
+/* MeshDecimator.cpp
+ *
+ * Distributed under the GNU GPL.
+ */
+
+#include "MeshDecimator.hpp"
+
+#include <cmath>
+#include <vector>
+#include <algorithm>
+#include <limits>
+#include <glm/glm.hpp>
+
+using std::vector;
+
+namespace GfxUtil {
+
+const uint32_t MeshDecimator::NONE;
+
+namespace {
+
+/** Returns the quadric error of position p. */
+double evaluateQuadric(const double* q, const glm::dvec3& p) {
+  return q[0]*p.x*p.x + 2.0*q[1]*p.x*p.y + 2.0*q[2]*p.x*p.z + 2.0*q[3]*p.x
+       + q[4]*p.y*p.y + 2.0*q[5]*p.y*p.z + 2.0*q[6]*p.y
+       + q[7]*p.z*p.z + 2.0*q[8]*p.z
+       + q[9];
+}
+
+/** Finds the position minimizing the quadric error. Returns false if the
+ *  quadric is close to singular, e.g. for nodes on a plane or a ridge. */
+bool minimizeQuadric(const double* q, glm::dvec3& p) {
+  // Cofactors of the symmetric 3x3 matrix
+  const double c00 = q[4]*q[7] - q[5]*q[5];
+  const double c01 = q[2]*q[5] - q[1]*q[7];
+  const double c02 = q[1]*q[5] - q[2]*q[4];
+  const double c11 = q[0]*q[7] - q[2]*q[2];
+  const double c12 = q[1]*q[2] - q[0]*q[5];
+  const double c22 = q[0]*q[4] - q[1]*q[1];
+  const double det = q[0]*c00 + q[1]*c01 + q[2]*c02;
+  const double scale = std::max(q[0], std::max(q[4], q[7]));
+  if(std::fabs(det) <= 1e-9*scale*scale*scale) {
+    return false;
+  }
+  p.x = -(c00*q[3] + c01*q[6] + c02*q[8])/det;
+  p.y = -(c01*q[3] + c11*q[6] + c12*q[8])/det;
+  p.z = -(c02*q[3] + c12*q[6] + c22*q[8])/det;
+  return true;
+}
+
+/** Smallest cosine of the angle a triangle normal may turn by in a
+ *  collapse, and smallest fraction of its area (length of the normal) a
+ *  triangle may keep, so that no triangle flips or becomes a sliver. */
+const float min_normal_cosine = 0.2f;
+const float min_area_ratio = 0.01f;
+
+/** Smallest shape quality, see triangleQuality(), of a triangle made worse
+ *  by a collapse, so that slivers are not made over several collapses
+ *  either. 0.01 is a height of about 1/50 of the longest edge. */
+const float min_quality = 0.01f;
+
+/** Returns the normal of the triangle with corners a, b and c, not normalized. */
+glm::vec3 triangleNormal(const glm::vec3& a, const glm::vec3& b, const glm::vec3& c) {
+  return glm::cross(b - a, c - a);
+}
+
+/** Returns twice the area over the sum of the squared edge lengths of the
+ *  triangle a, b, c with the given normal, 0.289 for an equilateral
+ *  triangle and 0 for a degenerate one. */
+float triangleQuality(const glm::vec3& a, const glm::vec3& b, const glm::vec3& c,
+                      const glm::vec3& normal) {
+  const float lengths = glm::dot(b - a, b - a) + glm::dot(c - b, c - b) + glm::dot(a - c, a - c);
+  return lengths > 0.0f ? glm::length(normal)/lengths : 0.0f;
+}
+
+}  // namespace
+
+MeshDecimator::MeshDecimator(const CompactTriMesh& mesh)
+    : m_positions(mesh.getPositions()),
+      m_sources(mesh.getIndices()),
+      m_twins(mesh.getTwins()),
+      m_leading(mesh.getLeadingHalfEdges()),
+      m_quadrics(mesh.getNumNodes()),
+      m_kinds(mesh.getNumNodes()),
+      m_stamps(mesh.getNumNodes(), 0),
+      m_marks(mesh.getNumNodes(), 0),
+      m_mark(0),
+      m_best(mesh.getNumNodes()),
+      m_num_triangles(mesh.getNumTriangles()),
+      m_num_nodes(0) {
+  const long Nv = m_positions.size();
+  const long Nhe = m_sources.size();
+
+  // Nodes where the 1-ring does not reach all their half-edges have more
+  // than one fan of triangles, and are left alone
+  vector<uint32_t> incident(Nv, 0);
+  for(long he=0; he<Nhe; he++) {
+    incident[m_sources[he]]++;
+  }
+
+  long num_nodes = 0;
+#pragma omp parallel for reduction(+:num_nodes)
+  for(long v=0; v<Nv; v++) {
+    double* q = m_quadrics[v].m_q_;
+    std::fill(q, q+10, 0.0);
+    const uint32_t first = m_leading[v];
+    if(first == NONE) {
+      m_kinds[v] = LOCKED_NODE;
+      continue;
+    }
+    num_nodes++;
+
+    // The sum of the squared distances to the planes of the triangles
+    // around the node, weighted by their area
+    uint32_t count = 0;
+    uint32_t he = first;
+    do {
+      const glm::dvec3 a(m_positions[v]);
+      const glm::dvec3 b(m_positions[m_sources[CompactTriMesh::getNext(he)]]);
+      const glm::dvec3 c(m_positions[m_sources[CompactTriMesh::getPrev(he)]]);
+      glm::dvec3 n = glm::cross(b - a, c - a);
+      const double length = glm::length(n);
+      if(length > 0.0) {
+        const double area = 0.5*length;
+        n /= length;
+        const double d = -glm::dot(n, a);
+        const double plane[4] = { n.x, n.y, n.z, d };
+        for(int i=0, k=0; i<4; i++) {
+          for(int j=i; j<4; j++, k++) {
+            q[k] += area*plane[i]*plane[j];
+          }
+        }
+      }
+      count++;
+      he = getVtxRingNext(he);
+    } while(he != NONE && he != first);
+
+    if(count != incident[v]) {
+      m_kinds[v] = LOCKED_NODE;
+    } else {
+      m_kinds[v] = he == NONE ? BOUNDARY_NODE : FREE_NODE;
+    }
+  }
+  m_num_nodes = num_nodes;
+
+  // The cheapest collapse of each node
+#pragma omp parallel for
+  for(long v=0; v<Nv; v++) {
+    findCollapse(v, m_best[v]);
+  }
+  vector<Collapse> collapses;
+  for(long v=0; v<Nv; v++) {
+    if(m_best[v].m_to_ != NONE) {
+      collapses.push_back(m_best[v]);
+    }
+  }
+  m_queue = std::priority_queue<Collapse>(std::less<Collapse>(), collapses);
+}
+
+bool MeshDecimator::gatherNeighbours(uint32_t v, vector<uint32_t>& neighbours) const {
+  neighbours.clear();
+  const uint32_t first = m_leading[v];
+  uint32_t he = first;
+  uint32_t last = first;
+  do {
+    neighbours.push_back(m_sources[CompactTriMesh::getNext(he)]);
+    last = he;
+    he = getVtxRingNext(he);
+  } while(he != NONE && he != first);
+
+  // The last edge of a boundary node has no half-edge leaving the node
+  if(he == NONE) {
+    neighbours.push_back(m_sources[CompactTriMesh::getPrev(last)]);
+    return true;
+  }
+  return false;
+}
+
+bool MeshDecimator::computeCollapse(uint32_t a, uint32_t b, Collapse& collapse,
+                                    glm::vec3& position) const {
+  const uint8_t kind_a = m_kinds[a];
+  const uint8_t kind_b = m_kinds[b];
+  if(kind_a == LOCKED_NODE || kind_b == LOCKED_NODE ||
+     (kind_a == BOUNDARY_NODE && kind_b == BOUNDARY_NODE)) {
+    return false;
+  }
+
+  // A free node is collapsed into a boundary node, which does not move
+  if(kind_a == BOUNDARY_NODE) {
+    std::swap(a, b);
+  }
+  collapse.m_from_ = a;
+  collapse.m_to_ = b;
+  collapse.m_stamp_ = m_stamps[a] + m_stamps[b];
+
+  double q[10];
+  for(int k=0; k<10; k++) {
+    q[k] = m_quadrics[a].m_q_[k] + m_quadrics[b].m_q_[k];
+  }
+
+  glm::dvec3 best(m_positions[b]);
+  double cost = evaluateQuadric(q, best);
+  if(m_kinds[b] == FREE_NODE) {
+    glm::dvec3 optimal;
+    if(minimizeQuadric(q, optimal)) {
+      best = optimal;
+      cost = evaluateQuadric(q, best);
+    } else {
+      // Try the nodes and the midpoint of the edge instead
+      const glm::dvec3 candidates[2] = {
+        glm::dvec3(m_positions[a]),
+        0.5*(glm::dvec3(m_positions[a]) + glm::dvec3(m_positions[b]))
+      };
+      for(int i=0; i<2; i++) {
+        const double c = evaluateQuadric(q, candidates[i]);
+        if(c < cost) {
+          cost = c;
+          best = candidates[i];
+        }
+      }
+    }
+  }
+  collapse.m_cost_ = float(std::max(cost, 0.0));
+  position = glm::vec3(best);
+  return true;
+}
+
+void MeshDecimator::findCollapse(uint32_t v, Collapse& collapse) const {
+  collapse.m_cost_ = std::numeric_limits<float>::max();
+  collapse.m_from_ = v;
+  collapse.m_to_ = NONE;
+  collapse.m_stamp_ = 0;
+  if(m_kinds[v] != FREE_NODE) {
+    return;
+  }
+  const uint32_t first = m_leading[v];
+  uint32_t he = first;
+  do {
+    Collapse candidate;
+    glm::vec3 position;
+    if(computeCollapse(v, m_sources[CompactTriMesh::getNext(he)], candidate, position) &&
+       collapse < candidate) {
+      collapse = candidate;
+    }
+    he = getVtxRingNext(he);
+  } while(he != first);
+}
+
+bool MeshDecimator::isCollapseValid(const Collapse& collapse, const glm::vec3& position,
+                                    uint32_t& he) {
+  const uint32_t u = collapse.m_from_;
+  const uint32_t v = collapse.m_to_;
+
+  // The half-edge from u to v, u is interior so its ring is closed
+  const uint32_t first = m_leading[u];
+  he = first;
+  while(m_sources[CompactTriMesh::getNext(he)] != v) {
+    he = getVtxRingNext(he);
+    if(he == first) {
+      return false;
+    }
+  }
+  const uint32_t twin = m_twins[he];
+  const uint32_t w = m_sources[CompactTriMesh::getPrev(he)];
+  const uint32_t x = m_sources[CompactTriMesh::getPrev(twin)];
+  if(m_kinds[w] == LOCKED_NODE || m_kinds[x] == LOCKED_NODE) {
+    return false;
+  }
+
+  // Link condition: the only common neighbours of u and v are w and x
+  m_mark++;
+  gatherNeighbours(u, m_ring);
+  for(size_t i=0; i<m_ring.size(); i++) {
+    m_marks[m_ring[i]] = m_mark;
+  }
+  gatherNeighbours(v, m_ring);
+  size_t common = 0;
+  for(size_t i=0; i<m_ring.size(); i++) {
+    common += m_marks[m_ring[i]] == m_mark;
+  }
+  if(common != 2) {
+    return false;
+  }
+
+  // w and x lose an edge, and must not end up with two triangles on top of
+  // each other
+  const uint32_t opposite[2] = { w, x };
+  for(int i=0; i<2; i++) {
+    const bool boundary = gatherNeighbours(opposite[i], m_ring);
+    if(m_ring.size() <= (boundary ? 2u : 3u)) {
+      return false;
+    }
+  }
+
+  // The twins of the other edges of the two removed triangles become twins
+  // of each other, and are boundary edges if one of them was
+  const uint32_t relinked[4][2] = {
+    { m_twins[CompactTriMesh::getNext(he)], m_twins[CompactTriMesh::getPrev(he)] },
+    { m_twins[CompactTriMesh::getPrev(he)], m_twins[CompactTriMesh::getNext(he)] },
+    { m_twins[CompactTriMesh::getNext(twin)], m_twins[CompactTriMesh::getPrev(twin)] },
+    { m_twins[CompactTriMesh::getPrev(twin)], m_twins[CompactTriMesh::getNext(twin)] }
+  };
+
+  // No triangle around u or v may flip or become a sliver when they are
+  // moved, and none may get a second boundary edge, which would put three
+  // boundary nodes, maybe on a line, in one triangle
+  const uint32_t moved[2] = { u, v };
+  for(int i=0; i<2; i++) {
+    const uint32_t start = m_leading[moved[i]];
+    uint32_t e = start;
+    do {
+      const uint32_t t = CompactTriMesh::getTriangle(e);
+      if(t != CompactTriMesh::getTriangle(he) && t != CompactTriMesh::getTriangle(twin)) {
+        const glm::vec3& b = m_positions[m_sources[CompactTriMesh::getNext(e)]];
+        const glm::vec3& c = m_positions[m_sources[CompactTriMesh::getPrev(e)]];
+        const glm::vec3 before = triangleNormal(m_positions[moved[i]], b, c);
+        const glm::vec3 after = triangleNormal(position, b, c);
+        const float before_length = glm::length(before);
+        const float after_length = glm::length(after);
+        if(after_length <= min_area_ratio*before_length ||
+           glm::dot(before, after) <= min_normal_cosine*before_length*after_length) {
+          return false;
+        }
+        const float quality = triangleQuality(position, b, c, after);
+        if(quality < min_quality &&
+           quality < triangleQuality(m_positions[moved[i]], b, c, before)) {
+          return false;
+        }
+        uint32_t boundary_before = 0, boundary_after = 0;
+        for(uint32_t k=0; k<3; k++) {
+          const uint32_t h = 3*t+k;
+          uint32_t h_twin = m_twins[h];
+          boundary_before += h_twin == NONE;
+          for(int r=0; r<4; r++) {
+            h_twin = h == relinked[r][0] ? relinked[r][1] : h_twin;
+          }
+          boundary_after += h_twin == NONE;
+        }
+        if(boundary_after >= 2 && boundary_after > boundary_before) {
+          return false;
+        }
+      }
+      e = getVtxRingNext(e);
+    } while(e != NONE && e != start);
+  }
+  return true;
+}
+
+void MeshDecimator::collapseHalfEdge(uint32_t he, const glm::vec3& position) {
+  const uint32_t twin = m_twins[he];
+  const uint32_t u = m_sources[he];
+  const uint32_t v = m_sources[twin];
+
+  // The other half-edges of the two triangles, and their twins. The twins
+  // of the half-edges at u exist since u is interior.
+  const uint32_t a0 = CompactTriMesh::getNext(he);    // v to w
+  const uint32_t b0 = CompactTriMesh::getPrev(he);    // w to u
+  const uint32_t a1 = CompactTriMesh::getNext(twin);  // u to x
+  const uint32_t b1 = CompactTriMesh::getPrev(twin);  // x to v
+  const uint32_t ta0 = m_twins[a0];
+  const uint32_t tb0 = m_twins[b0];
+  const uint32_t ta1 = m_twins[a1];
+  const uint32_t tb1 = m_twins[b1];
+  const uint32_t w = m_sources[b0];
+  const uint32_t x = m_sources[b1];
+
+  // Give the half-edges of u to v
+  uint32_t e = he;
+  do {
+    m_sources[e] = v;
+    e = getVtxRingNext(e);
+  } while(e != he);
+
+  // Leading half-edges in the removed triangles. For boundary nodes the
+  // replacements are the half-edges that end up on the boundary.
+  const uint32_t t0 = CompactTriMesh::getTriangle(he);
+  const uint32_t t1 = CompactTriMesh::getTriangle(twin);
+  const uint32_t tv = CompactTriMesh::getTriangle(m_leading[v]);
+  if(tv == t0 || tv == t1) {
+    m_leading[v] = tb0;
+  }
+  if(m_leading[w] == b0) {
+    m_leading[w] = ta0;
+  }
+  if(m_leading[x] == b1) {
+    m_leading[x] = ta1;
+  }
+
+  // Unlink the triangles
+  if(ta0 != NONE) {
+    m_twins[ta0] = tb0;
+  }
+  m_twins[tb0] = ta0;
+  m_twins[ta1] = tb1;
+  if(tb1 != NONE) {
+    m_twins[tb1] = ta1;
+  }
+  for(int k=0; k<3; k++) {
+    m_sources[3*t0+k] = m_sources[3*t1+k] = NONE;
+    m_twins[3*t0+k] = m_twins[3*t1+k] = NONE;
+  }
+
+  for(int k=0; k<10; k++) {
+    m_quadrics[v].m_q_[k] += m_quadrics[u].m_q_[k];
+  }
+  m_positions[v] = position;
+  m_kinds[u] = LOCKED_NODE;
+  m_leading[u] = NONE;
+  m_stamps[v]++;
+  m_num_triangles -= 2;
+  m_num_nodes--;
+}
+
+size_t MeshDecimator::decimate(size_t target_triangles, float max_error) {
+  size_t collapses = 0;
+  while(m_num_triangles > target_triangles && !m_queue.empty()) {
+    const Collapse collapse = m_queue.top();
+    if(collapse.m_cost_ > max_error) {
+      break;
+    }
+    m_queue.pop();
+
+    // Skip collapses that have been replaced, or where a node has moved
+    // since. The stamps only grow, so their sum is unchanged only if neither
+    // node has changed.
+    const uint32_t u = collapse.m_from_;
+    const uint32_t v = collapse.m_to_;
+    const Collapse& best = m_best[u];
+    if(m_kinds[u] != FREE_NODE || best.m_to_ != v || best.m_cost_ != collapse.m_cost_ ||
+       m_stamps[u] + m_stamps[v] != collapse.m_stamp_) {
+      continue;
+    }
+
+    Collapse current;
+    glm::vec3 position;
+    uint32_t he;
+    if(!computeCollapse(u, v, current, position) || !isCollapseValid(collapse, position, he)) {
+      // Tried again when a neighbour changes
+      m_best[u].m_to_ = NONE;
+      continue;
+    }
+    collapseHalfEdge(he, position);
+    collapses++;
+
+    // The kept node has moved, and the neighbours that were to collapse
+    // into u or v need a new collapse. The others only need one if the new
+    // edge to v is cheaper.
+    findCollapse(v, m_best[v]);
+    if(m_best[v].m_to_ != NONE) {
+      m_queue.push(m_best[v]);
+    }
+    gatherNeighbours(v, m_ring);
+    for(size_t i=0; i<m_ring.size(); i++) {
+      const uint32_t n = m_ring[i];
+      Collapse& next = m_best[n];
+      if(m_kinds[n] != FREE_NODE) {
+        continue;
+      }
+      if(next.m_to_ == NONE || next.m_to_ == u || next.m_to_ == v) {
+        findCollapse(n, next);
+      } else if(!computeCollapse(n, v, current, position) || !(next < current)) {
+        continue;
+      } else {
+        next = current;
+      }
+      if(next.m_to_ != NONE) {
+        m_queue.push(next);
+      }
+    }
+  }
+  return collapses;
+}
+
+CompactTriMesh* MeshDecimator::extractMesh() const {
+  const size_t Nv = m_positions.size();
+  const size_t Nhe = m_sources.size();
+
+  vector<uint32_t> remap(Nv, NONE);
+  for(size_t he=0; he<Nhe; he++) {
+    if(m_sources[he] != NONE) {
+      remap[m_sources[he]] = 0;
+    }
+  }
+  vector<glm::vec3> positions;
+  positions.reserve(m_num_nodes);
+  for(size_t v=0; v<Nv; v++) {
+    if(remap[v] != NONE) {
+      remap[v] = positions.size();
+      positions.push_back(m_positions[v]);
+    }
+  }
+  vector<uint32_t> indices;
+  indices.reserve(3*m_num_triangles);
+  for(size_t he=0; he<Nhe; he++) {
+    if(m_sources[he] != NONE) {
+      indices.push_back(remap[m_sources[he]]);
+    }
+  }
+  return new CompactTriMesh(positions, indices);
+}
+
+}  // GfxUtil
@@ -0,0 +1,156 @@
+/* MeshDecimator.hpp
+ *
+ * Distributed under the GNU GPL.
+ */
+
+#ifndef GFXUTIL_MESHDECIMATOR_H
+#define GFXUTIL_MESHDECIMATOR_H
+
+#include <vector>
+#include <queue>
+#include <limits>
+#include <stdint.h>
+#include <glm/glm.hpp>
+
+#include "CompactTriMesh.hpp"
+
+namespace GfxUtil {
+
+/** Mesh simplification by edge collapses, ordered by the quadric error
+ *  metric of Garland and Heckbert, "Surface simplification using quadric
+ *  error metrics", SIGGRAPH 1997.
+ *
+ *  The decimator works on a copy of the half-edge arrays of a
+ *  CompactTriMesh and collapses edges in place: the two triangles of the
+ *  edge are unlinked by making the twins of their other edges twins of each
+ *  other, and the half-edges of the removed node are given to the kept
+ *  node. Nothing is compacted until extractMesh() is called.
+ *
+ *  Each free node queues the cheapest collapse into one of its neighbours,
+ *  so the queue holds about one collapse per node, and only the kept node
+ *  and its neighbours are updated after a collapse.
+ *
+ *  An edge is only collapsed if the link condition holds, i.e., the nodes of
+ *  the edge have no common neighbours but the two opposite the edge, and if
+ *  no triangle around the edge flips, turns by much, loses most of its area
+ *  or becomes a sliver, and none gets a second boundary edge. Boundary
+ *  nodes, and nodes next to non-manifold or misoriented edges, are never
+ *  moved or removed, so the boundary of the mesh is preserved exactly.
+ *
+ *  decimate() can be called repeatedly with decreasing targets, so a chain
+ *  of levels of detail is built in one run, e.g.
+ *
+ *    MeshDecimator decimator(mesh);
+ *    for(size_t n=mesh.getNumTriangles()/4; n>1000; n/=4) {
+ *      decimator.decimate(n);
+ *      levels.push_back(decimator.extractMesh());
+ *    }
+ */
+class MeshDecimator {
+ public:
+  /** Constructor, computes the quadrics of the nodes and the cost of
+   *  collapsing every edge, in parallel. */
+  MeshDecimator(const CompactTriMesh& mesh);
+
+  /** Collapses the cheapest edges until the mesh has at most the given
+   *  number of triangles, or no edge can be collapsed without exceeding
+   *  max_error.
+   *  \param max_error The largest quadric error allowed, i.e., the sum of
+   *                   squared distances times area to the original planes.
+   *  \return The number of edges collapsed. */
+  size_t decimate(size_t target_triangles,
+                  float max_error = std::numeric_limits<float>::max());
+
+  /** Returns the number of triangles left. */
+  size_t getNumTriangles() const { return m_num_triangles; }
+
+  /** Returns the number of nodes left. */
+  size_t getNumNodes() const { return m_num_nodes; }
+
+  /** Returns a new mesh of the nodes and triangles that are left, in their
+   *  original order. The caller owns the mesh. */
+  CompactTriMesh* extractMesh() const;
+
+ protected:
+  static const uint32_t NONE = CompactTriMesh::NONE;
+
+  /** Symmetric 4x4 matrix of the quadric error, the upper triangle row by
+   *  row: a2, ab, ac, ad, b2, bc, bd, c2, cd, d2. */
+  struct Quadric {
+    double m_q_[10];
+  };
+
+  /** An edge collapse in the priority queue, 16 bytes so that the heap
+   *  stays small. Collapses are not removed from the queue when the nodes
+   *  change, instead they are skipped if they are no longer the collapse of
+   *  their node or the stamps of the nodes no longer add up. The position
+   *  is computed again when the collapse is done. */
+  struct Collapse {
+    /** Orders the cheapest collapse first, and ties by the nodes, so the
+     *  result does not depend on the number of threads. */
+    bool operator<(const Collapse& other) const {
+      if(m_cost_ != other.m_cost_) {
+        return m_cost_ > other.m_cost_;
+      }
+      return m_from_ != other.m_from_ ? m_from_ > other.m_from_ : m_to_ > other.m_to_;
+    }
+
+    float    m_cost_;   ///< Quadric error of the collapse.
+    uint32_t m_from_;   ///< The node that is removed.
+    uint32_t m_to_;     ///< The node that is kept.
+    uint32_t m_stamp_;  ///< Sum of the stamps of the nodes when the cost was computed.
+  };
+
+  /** Kind of each node. */
+  enum NodeKind {
+    FREE_NODE,      ///< Interior node, may be moved and removed.
+    BOUNDARY_NODE,  ///< On the boundary, may only be collapsed into.
+    LOCKED_NODE     ///< Non-manifold, or removed, never touched.
+  };
+
+  /** Returns the next half-edge from the same node in a counter-clockwise
+   *  order, or NONE at the boundary. */
+  uint32_t getVtxRingNext(uint32_t he) const {
+    return m_twins[CompactTriMesh::getPrev(he)];
+  }
+
+  /** Gathers the neighbours of node v in counter-clockwise order.
+   *  \return True if v is on the boundary. */
+  bool gatherNeighbours(uint32_t v, std::vector<uint32_t>& neighbours) const;
+
+  /** Finds the cost of collapsing the edge between a and b, and which of
+   *  them to remove. Returns false if neither can be removed.
+   *  \param position Set to the position of the kept node after the collapse. */
+  bool computeCollapse(uint32_t a, uint32_t b, Collapse& collapse, glm::vec3& position) const;
+
+  /** Finds the cheapest collapse of node v into one of its neighbours,
+   *  m_to_ is NONE if there is none. */
+  void findCollapse(uint32_t v, Collapse& collapse) const;
+
+  /** Returns true if the collapse keeps the mesh manifold and does not
+   *  flip any triangles, and sets he to the half-edge of the edge from the
+   *  removed node. */
+  bool isCollapseValid(const Collapse& collapse, const glm::vec3& position, uint32_t& he);
+
+  /** Collapses half-edge he into its destination, moved to position. */
+  void collapseHalfEdge(uint32_t he, const glm::vec3& position);
+
+  std::vector<glm::vec3> m_positions;  /// Position of each node.
+  std::vector<uint32_t>  m_sources;    /// Source node of each half-edge, NONE if removed.
+  std::vector<uint32_t>  m_twins;      /// Twin of each half-edge, or NONE.
+  std::vector<uint32_t>  m_leading;    /// Leading half-edge of each node.
+  std::vector<Quadric>   m_quadrics;   /// Quadric of each node.
+  std::vector<uint8_t>   m_kinds;      /// NodeKind of each node.
+  std::vector<uint32_t>  m_stamps;     /// Incremented when a node changes, never decreases.
+  std::vector<uint32_t>  m_marks;      /// Scratch marks for the link condition.
+  uint32_t               m_mark;       /// Current mark.
+  std::vector<uint32_t>  m_ring;       /// Scratch neighbours.
+  std::vector<Collapse>  m_best;       /// The queued collapse of each node.
+  std::priority_queue<Collapse> m_queue;  /// Collapses, cheapest first.
+  size_t                 m_num_triangles;  /// Number of triangles left.
+  size_t                 m_num_nodes;      /// Number of nodes left.
+};
+
+}  // GfxUtil
+
+#endif
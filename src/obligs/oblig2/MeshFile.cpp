@@ -0,0 +1,234 @@
+/* MeshFile.cpp
+ *
+ * Distributed under the GNU GPL.
+ */
+
+#include "MeshFile.hpp"
+#include "CompactTriMesh.hpp"
+
+#include <stdexcept>
+#include <fstream>
+#include <vector>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <glm/glm.hpp>
+
+using std::runtime_error;
+using std::string;
+using std::vector;
+
+namespace GfxUtil {
+
+namespace {
+
+const uint32_t mesh_file_version = 1;
+
+typedef std::pair<const void*, size_t> Block;
+
+}  // namespace
+
+MeshFile::MeshFile(const string& filename)
+    : m_mapping(NULL), m_size(0), m_header(NULL), m_positions(NULL), m_indices(NULL),
+      m_twins(NULL), m_leading(NULL), m_problems(NULL), m_normals(NULL) {
+  int fd = open(filename.c_str(), O_RDONLY);
+  if(fd < 0) {
+    throw runtime_error("Error reading from " + filename);
+  }
+  struct stat buffer;
+  if(fstat(fd, &buffer) != 0 || buffer.st_size < off_t(sizeof(Header))) {
+    close(fd);
+    throw runtime_error("Not a binary mesh file: " + filename);
+  }
+  m_size = buffer.st_size;
+  m_mapping = mmap(NULL, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if(m_mapping == MAP_FAILED) {
+    m_mapping = NULL;
+    throw runtime_error("Error mapping " + filename);
+  }
+
+  // The blocks follow the header in a fixed order, so the header gives the
+  // size of the file, which is checked before any block is touched
+  const char* data = static_cast<const char*>(m_mapping);
+  m_header = reinterpret_cast<const Header*>(data);
+  const Header& h = *m_header;
+  const uint64_t Nv = h.m_nodes_;
+  const uint64_t Nt = h.m_triangles_;
+  // The counts are bounded first, so that the size below cannot overflow
+  bool valid = std::memcmp(h.m_magic_, "BMSH", 4) == 0 && h.m_version_ == mesh_file_version &&
+               Nv < CompactTriMesh::NONE && Nt < CompactTriMesh::NONE/3 &&
+               h.m_problem_halfedges_ <= 3*Nt;
+  if(valid) {
+    uint64_t expected = sizeof(Header) + 12*Nv + 12*Nt;
+    if(h.m_flags_ & HAS_CONNECTIVITY) {
+      expected += 12*Nt + 4*Nv + 4*h.m_problem_halfedges_;
+    }
+    if(h.m_flags_ & HAS_NORMALS) {
+      expected += 12*Nv;
+    }
+    valid = expected == m_size;
+  }
+  if(!valid) {
+    munmap(m_mapping, m_size);
+    throw runtime_error("Not a valid binary mesh file: " + filename);
+  }
+
+  size_t offset = sizeof(Header);
+  m_positions = reinterpret_cast<const glm::vec3*>(data + offset);
+  offset += 12*Nv;
+  m_indices = reinterpret_cast<const uint32_t*>(data + offset);
+  offset += 12*Nt;
+  if(h.m_flags_ & HAS_CONNECTIVITY) {
+    m_twins = reinterpret_cast<const uint32_t*>(data + offset);
+    offset += 12*Nt;
+    m_leading = reinterpret_cast<const uint32_t*>(data + offset);
+    offset += 4*Nv;
+    m_problems = reinterpret_cast<const uint32_t*>(data + offset);
+    offset += 4*h.m_problem_halfedges_;
+  }
+  if(h.m_flags_ & HAS_NORMALS) {
+    m_normals = reinterpret_cast<const glm::vec3*>(data + offset);
+  }
+}
+
+MeshFile::~MeshFile() {
+  if(m_mapping != NULL) {
+    munmap(m_mapping, m_size);
+  }
+}
+
+bool MeshFile::isMeshFile(const string& filename) {
+  const string extension = ".bmsh";
+  return filename.size() >= extension.size() &&
+         filename.compare(filename.size() - extension.size(), extension.size(), extension) == 0;
+}
+
+void MeshFile::write(const string& filename, Header& header, const vector<Block>& blocks) {
+  std::memcpy(header.m_magic_, "BMSH", 4);
+  header.m_version_ = mesh_file_version;
+  header.m_reserved_ = 0;
+
+  std::ofstream out(filename.c_str(), std::ios::out | std::ios::binary);
+  if(!out.good()) {
+    throw runtime_error("Error writing to " + filename);
+  }
+  out.write(reinterpret_cast<const char*>(&header), sizeof(Header));
+  for(size_t i=0; i<blocks.size(); i++) {
+    if(blocks[i].second > 0) {
+      out.write(static_cast<const char*>(blocks[i].first), blocks[i].second);
+    }
+  }
+  if(!out.good()) {
+    throw runtime_error("Error writing to " + filename);
+  }
+}
+
+void MeshFile::write(const string& filename, const vector<glm::vec3>& positions,
+                     const vector<uint32_t>& indices) {
+  Header header;
+  std::memset(&header, 0, sizeof(Header));
+  header.m_nodes_ = positions.size();
+  header.m_triangles_ = indices.size()/3;
+
+  vector<Block> blocks;
+  blocks.push_back(Block(positions.empty() ? NULL : &positions[0], 12*positions.size()));
+  blocks.push_back(Block(indices.empty() ? NULL : &indices[0], 4*3*header.m_triangles_));
+  write(filename, header, blocks);
+}
+
+void MeshFile::write(const string& filename, const CompactTriMesh& mesh) {
+  const CompactTriMesh::ConnectivityReport& report = mesh.getConnectivityReport();
+  const vector<glm::vec3>& positions = mesh.getPositions();
+  const vector<glm::vec3>& normals = mesh.getNormals();
+  const vector<uint32_t>& indices = mesh.getIndices();
+  const vector<uint32_t>& twins = mesh.getTwins();
+  const vector<uint32_t>& leading = mesh.getLeadingHalfEdges();
+  const vector<uint32_t>& problems = report.m_problem_halfedges_;
+
+  Header header;
+  std::memset(&header, 0, sizeof(Header));
+  header.m_flags_ = HAS_CONNECTIVITY | HAS_NORMALS;
+  header.m_nodes_ = positions.size();
+  header.m_triangles_ = mesh.getNumTriangles();
+  header.m_inner_edges_ = report.m_inner_edges_;
+  header.m_boundary_edges_ = report.m_boundary_edges_;
+  header.m_nonmanifold_edges_ = report.m_nonmanifold_edges_;
+  header.m_misoriented_edges_ = report.m_misoriented_edges_;
+  header.m_problem_halfedges_ = problems.size();
+
+  vector<Block> blocks;
+  blocks.push_back(Block(positions.empty() ? NULL : &positions[0], 12*positions.size()));
+  blocks.push_back(Block(indices.empty() ? NULL : &indices[0], 4*indices.size()));
+  blocks.push_back(Block(twins.empty() ? NULL : &twins[0], 4*twins.size()));
+  blocks.push_back(Block(leading.empty() ? NULL : &leading[0], 4*leading.size()));
+  blocks.push_back(Block(problems.empty() ? NULL : &problems[0], 4*problems.size()));
+  blocks.push_back(Block(normals.empty() ? NULL : &normals[0], 12*normals.size()));
+  write(filename, header, blocks);
+}
+
+MeshFileWriter::MeshFileWriter(const string& filename, size_t num_nodes, size_t num_triangles,
+                               bool normals)
+    : m_filename(filename), m_fd(-1), m_num_nodes(num_nodes), m_num_triangles(num_triangles),
+      m_normals_offset(0) {
+  if(num_nodes >= CompactTriMesh::NONE || 3*uint64_t(num_triangles) >= CompactTriMesh::NONE) {
+    throw runtime_error("MeshFileWriter: mesh is too large for 32-bit indices: " + filename);
+  }
+  MeshFile::Header header;
+  std::memset(&header, 0, sizeof(MeshFile::Header));
+  std::memcpy(header.m_magic_, "BMSH", 4);
+  header.m_version_ = mesh_file_version;
+  header.m_flags_ = normals ? MeshFile::HAS_NORMALS : 0;
+  header.m_nodes_ = num_nodes;
+  header.m_triangles_ = num_triangles;
+  uint64_t size = sizeof(MeshFile::Header) + 12*m_num_nodes + 12*m_num_triangles;
+  if(normals) {
+    m_normals_offset = size;
+    size += 12*m_num_nodes;
+  }
+
+  m_fd = open(filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if(m_fd < 0 || ftruncate(m_fd, size) != 0) {
+    if(m_fd >= 0) {
+      close(m_fd);
+    }
+    throw runtime_error("Error writing to " + filename);
+  }
+  write(0, &header, sizeof(MeshFile::Header));
+}
+
+MeshFileWriter::~MeshFileWriter() {
+  close(m_fd);
+}
+
+void MeshFileWriter::writePositions(size_t first, const glm::vec3* positions, size_t count) {
+  write(sizeof(MeshFile::Header) + 12*uint64_t(first), positions, 12*count);
+}
+
+void MeshFileWriter::writeTriangles(size_t first, const uint32_t* indices, size_t count) {
+  write(sizeof(MeshFile::Header) + 12*m_num_nodes + 12*uint64_t(first), indices, 12*count);
+}
+
+void MeshFileWriter::writeNormals(size_t first, const glm::vec3* normals, size_t count) {
+  if(m_normals_offset == 0) {
+    throw runtime_error("MeshFileWriter: no normals block in " + m_filename);
+  }
+  write(m_normals_offset + 12*uint64_t(first), normals, 12*count);
+}
+
+void MeshFileWriter::write(uint64_t offset, const void* data, size_t size) {
+  const char* bytes = static_cast<const char*>(data);
+  while(size > 0) {
+    const ssize_t written = pwrite(m_fd, bytes, size, offset);
+    if(written <= 0) {
+      throw runtime_error("Error writing to " + m_filename);
+    }
+    bytes += written;
+    offset += written;
+    size -= written;
+  }
+}
+
+}  // GfxUtil
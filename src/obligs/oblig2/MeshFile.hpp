@@ -0,0 +1,160 @@
+/* MeshFile.hpp
+ *
+ * Distributed under the GNU GPL.
+ */
+
+#ifndef GFXUTIL_MESHFILE_H
+#define GFXUTIL_MESHFILE_H
+
+#include <vector>
+#include <string>
+#include <stdint.h>
+#include <glm/glm.hpp>
+
+namespace GfxUtil {
+
+class CompactTriMesh;
+
+/** Binary mesh file (*.bmsh), read through a read-only memory mapping.
+ *
+ *  The file is a header followed by the arrays of the mesh, in the byte
+ *  order of the machine that wrote it:
+ *
+ *  - Nv x 3 floats, the positions of the nodes.
+ *  - Nt x 3 uint32, the node indices of the triangles.
+ *  - If HAS_CONNECTIVITY is set: Nt x 3 uint32 twin half-edges, Nv uint32
+ *    leading half-edges, and the problem half-edges of the connectivity
+ *    report, as in CompactTriMesh.
+ *  - If HAS_NORMALS is set: Nv x 3 floats, the normals of the nodes.
+ *
+ *  Opening a file only maps it and checks the header against the file
+ *  size, so the arrays can be used or copied right away, without parsing.
+ */
+class MeshFile {
+ public:
+  /** Flags of the optional blocks. */
+  enum {
+    HAS_CONNECTIVITY = 1,
+    HAS_NORMALS      = 2
+  };
+
+  /** The header at the start of the file. */
+  struct Header {
+    char     m_magic_[4];           ///< "BMSH".
+    uint32_t m_version_;            ///< Version of the format.
+    uint32_t m_flags_;              ///< The optional blocks present.
+    uint32_t m_reserved_;           ///< Zero.
+    uint64_t m_nodes_;              ///< Number of nodes, Nv.
+    uint64_t m_triangles_;          ///< Number of triangles, Nt.
+    uint64_t m_inner_edges_;        ///< Connectivity report, see CompactTriMesh.
+    uint64_t m_boundary_edges_;
+    uint64_t m_nonmanifold_edges_;
+    uint64_t m_misoriented_edges_;
+    uint64_t m_problem_halfedges_;  ///< Number of problem half-edges.
+  };
+
+  /** Maps a file, throws std::runtime_error if it is not a valid mesh file. */
+  MeshFile(const std::string& filename);
+
+  /** Destructor, unmaps the file. */
+  ~MeshFile();
+
+  /** Returns true if the filename has the extension of binary mesh files. */
+  static bool isMeshFile(const std::string& filename);
+
+  /** Writes positions and triangles, without connectivity. */
+  static void write(const std::string& filename, const std::vector<glm::vec3>& positions,
+                    const std::vector<uint32_t>& indices);
+
+  /** Writes a mesh with its connectivity and normals. */
+  static void write(const std::string& filename, const CompactTriMesh& mesh);
+
+  const Header& getHeader() const { return *m_header; }
+
+  size_t getNumNodes() const { return m_header->m_nodes_; }
+
+  size_t getNumTriangles() const { return m_header->m_triangles_; }
+
+  bool hasConnectivity() const { return m_header->m_flags_ & HAS_CONNECTIVITY; }
+
+  bool hasNormals() const { return m_header->m_flags_ & HAS_NORMALS; }
+
+  const glm::vec3* getPositions() const { return m_positions; }
+
+  const uint32_t* getIndices() const { return m_indices; }
+
+  /** Returns the twins, or NULL without HAS_CONNECTIVITY. */
+  const uint32_t* getTwins() const { return m_twins; }
+
+  /** Returns the leading half-edges, or NULL without HAS_CONNECTIVITY. */
+  const uint32_t* getLeadingHalfEdges() const { return m_leading; }
+
+  /** Returns the problem half-edges, or NULL without HAS_CONNECTIVITY. */
+  const uint32_t* getProblemHalfEdges() const { return m_problems; }
+
+  /** Returns the normals, or NULL without HAS_NORMALS. */
+  const glm::vec3* getNormals() const { return m_normals; }
+
+ protected:
+  /** Writes the header and the blocks. */
+  static void write(const std::string& filename, Header& header,
+                    const std::vector<std::pair<const void*, size_t> >& blocks);
+
+  void*            m_mapping;    /// Start of the mapping.
+  size_t           m_size;       /// Size of the mapping in bytes.
+  const Header*    m_header;     /// The header.
+  const glm::vec3* m_positions;  /// The positions block.
+  const uint32_t*  m_indices;    /// The indices block.
+  const uint32_t*  m_twins;      /// The twins block, or NULL.
+  const uint32_t*  m_leading;    /// The leading half-edges block, or NULL.
+  const uint32_t*  m_problems;   /// The problem half-edges block, or NULL.
+  const glm::vec3* m_normals;    /// The normals block, or NULL.
+
+ private:
+  MeshFile(const MeshFile&);
+  MeshFile& operator=(const MeshFile&);
+};
+
+/** Writes a binary mesh file (*.bmsh) of known size in pieces, in any
+ *  order, so that a mesh larger than memory can be streamed to disk.
+ *
+ *  The file is created with its final size, and the positions, triangles
+ *  and normals are written at their offsets. The connectivity is not
+ *  written, it is built when the file is read.
+ */
+class MeshFileWriter {
+ public:
+  /** Creates the file, throws std::runtime_error on failure. */
+  MeshFileWriter(const std::string& filename, size_t num_nodes, size_t num_triangles,
+                 bool normals);
+
+  /** Destructor, closes the file. */
+  ~MeshFileWriter();
+
+  /** Writes the positions of the nodes first to first+count-1. */
+  void writePositions(size_t first, const glm::vec3* positions, size_t count);
+
+  /** Writes the node indices of the triangles first to first+count-1. */
+  void writeTriangles(size_t first, const uint32_t* indices, size_t count);
+
+  /** Writes the normals of the nodes first to first+count-1. */
+  void writeNormals(size_t first, const glm::vec3* normals, size_t count);
+
+ protected:
+  /** Writes bytes at an offset of the file. */
+  void write(uint64_t offset, const void* data, size_t size);
+
+  std::string m_filename;         /// Name of the file.
+  int         m_fd;               /// The open file.
+  uint64_t    m_num_nodes;        /// Number of nodes, Nv.
+  uint64_t    m_num_triangles;    /// Number of triangles, Nt.
+  uint64_t    m_normals_offset;   /// Offset of the normals block, 0 if none.
+
+ private:
+  MeshFileWriter(const MeshFileWriter&);
+  MeshFileWriter& operator=(const MeshFileWriter&);
+};
+
+}  // GfxUtil
+
+#endif
@@ -0,0 +1,290 @@
+/* MeshOptimizer.cpp
+ *
+ * Distributed under the GNU GPL.
+ */
+
+#include "MeshOptimizer.hpp"
+
+#include <cmath>
+#include <vector>
+#include <algorithm>
+#include <glm/glm.hpp>
+
+using std::vector;
+
+namespace GfxUtil {
+
+namespace {
+
+const uint32_t NONE = 0xffffffffu;
+
+/** FIFO cache simulated with time stamps: a vertex is in the cache if less
+ *  than cache_size vertices have been added since it was added itself. */
+struct FifoCache {
+  FifoCache(size_t num_vertices, size_t cache_size)
+      : m_timestamps_(num_vertices, 0), m_time_(cache_size+1), m_cache_size_(cache_size) {
+  }
+
+  /** Uses a vertex, and returns true if it was not in the cache. */
+  bool miss(uint32_t v) {
+    if(m_time_ - m_timestamps_[v] > m_cache_size_) {
+      m_timestamps_[v] = m_time_++;
+      return true;
+    }
+    return false;
+  }
+
+  /** Empties the cache. */
+  void flush() {
+    m_time_ += m_cache_size_+1;
+  }
+
+  vector<size_t> m_timestamps_;  ///< When each vertex was added.
+  size_t         m_time_;        ///< Number of vertices added, plus offset.
+  size_t         m_cache_size_;  ///< Size of the cache.
+};
+
+/** Area weighted centroid and normal of a range of triangles, not normalized. */
+void sumTriangles(const vector<uint32_t>& indices, const vector<glm::vec3>& positions,
+                  size_t begin, size_t end, glm::vec3& centroid, glm::vec3& normal, float& area) {
+  centroid = normal = glm::vec3(0.0f);
+  area = 0.0f;
+  for(size_t t=begin; t<end; t++) {
+    const glm::vec3& a = positions[indices[3*t+0]];
+    const glm::vec3& b = positions[indices[3*t+1]];
+    const glm::vec3& c = positions[indices[3*t+2]];
+    const glm::vec3 N = glm::cross(b - a, c - a);
+    const float A = glm::length(N);
+    centroid += (A/3.0f)*(a + b + c);
+    normal += N;
+    area += A;
+  }
+}
+
+}  // namespace
+
+VertexCacheStatistics analyzeVertexCache(const vector<uint32_t>& indices, size_t num_vertices,
+                                         size_t cache_size) {
+  FifoCache cache(num_vertices, cache_size);
+  vector<uint8_t> used(num_vertices, 0);
+  size_t num_used = 0;
+  VertexCacheStatistics statistics;
+  statistics.m_transformed_ = 0;
+  for(size_t i=0; i<indices.size(); i++) {
+    statistics.m_transformed_ += cache.miss(indices[i]);
+    num_used += !used[indices[i]];
+    used[indices[i]] = 1;
+  }
+  const size_t Nt = indices.size()/3;
+  statistics.m_acmr_ = Nt == 0 ? 0.0f : float(statistics.m_transformed_)/Nt;
+  statistics.m_atvr_ = num_used == 0 ? 0.0f : float(statistics.m_transformed_)/num_used;
+  return statistics;
+}
+
+void optimizeVertexCache(vector<uint32_t>& indices, size_t num_vertices, size_t cache_size,
+                         vector<uint32_t>* clusters) {
+  const size_t Nv = num_vertices;
+  const size_t Nt = indices.size()/3;
+
+  // The triangles of each vertex, bucketed with a counting sort
+  vector<uint32_t> offsets(Nv+1, 0);
+  for(size_t i=0; i<3*Nt; i++) {
+    offsets[indices[i]+1]++;
+  }
+  for(size_t v=0; v<Nv; v++) {
+    offsets[v+1] += offsets[v];
+  }
+  vector<uint32_t> adjacency(3*Nt);
+  vector<uint32_t> fill(offsets.begin(), offsets.end()-1);
+  for(size_t i=0; i<3*Nt; i++) {
+    adjacency[fill[indices[i]]++] = i/3;
+  }
+
+  // Number of triangles left of each vertex
+  vector<uint32_t> live(Nv);
+  for(size_t v=0; v<Nv; v++) {
+    live[v] = offsets[v+1] - offsets[v];
+  }
+
+  vector<size_t> timestamps(Nv, 0);
+  size_t time = cache_size+1;
+  vector<uint8_t> emitted(Nt, 0);
+  vector<uint32_t> dead_end;
+  vector<uint32_t> candidates;
+  vector<uint32_t> output;
+  output.reserve(3*Nt);
+  size_t cursor = 0;
+  if(clusters != NULL) {
+    clusters->clear();
+  }
+
+  uint32_t fanning = NONE;
+  while(true) {
+    if(fanning == NONE) {
+      // Dead end: continue with the most recent vertex with triangles left,
+      // or the next one in input order
+      while(!dead_end.empty() && live[dead_end.back()] == 0) {
+        dead_end.pop_back();
+      }
+      if(!dead_end.empty()) {
+        fanning = dead_end.back();
+        dead_end.pop_back();
+      } else {
+        while(cursor < Nv && live[cursor] == 0) {
+          cursor++;
+        }
+        if(cursor == Nv) {
+          break;
+        }
+        fanning = cursor;
+      }
+      if(clusters != NULL) {
+        clusters->push_back(output.size()/3);
+      }
+    }
+
+    // Emit the remaining triangles around the fanning vertex
+    candidates.clear();
+    for(uint32_t j=offsets[fanning]; j<offsets[fanning+1]; j++) {
+      const uint32_t t = adjacency[j];
+      if(emitted[t]) {
+        continue;
+      }
+      for(uint32_t k=0; k<3; k++) {
+        const uint32_t v = indices[3*t+k];
+        output.push_back(v);
+        dead_end.push_back(v);
+        candidates.push_back(v);
+        live[v]--;
+        if(time - timestamps[v] > cache_size) {
+          timestamps[v] = time++;
+        }
+      }
+      emitted[t] = 1;
+    }
+
+    // The next fanning vertex is the oldest candidate that stays in the
+    // cache while its triangles are emitted, or any candidate with
+    // triangles left
+    fanning = NONE;
+    long best = -1;
+    for(size_t i=0; i<candidates.size(); i++) {
+      const uint32_t v = candidates[i];
+      if(live[v] == 0) {
+        continue;
+      }
+      long priority = 0;
+      if(time - timestamps[v] + 2*live[v] <= cache_size) {
+        priority = time - timestamps[v];
+      }
+      if(priority > best) {
+        best = priority;
+        fanning = v;
+      }
+    }
+  }
+
+  if(clusters != NULL) {
+    clusters->push_back(Nt);
+  }
+  indices.swap(output);
+}
+
+void optimizeOverdraw(vector<uint32_t>& indices, const vector<glm::vec3>& positions,
+                      const vector<uint32_t>& clusters, size_t cache_size, float threshold) {
+  const size_t Nt = indices.size()/3;
+  if(Nt == 0) {
+    return;
+  }
+
+  // Clusters that do not split [0, Nt) into non-empty ranges, e.g. none,
+  // are replaced by one cluster of all the triangles
+  bool valid = clusters.size() >= 2 && clusters.front() == 0 && clusters.back() == Nt;
+  for(size_t c=0; valid && c+1<clusters.size(); c++) {
+    valid = clusters[c] < clusters[c+1];
+  }
+  vector<uint32_t> all(2, 0);
+  all[1] = Nt;
+  const vector<uint32_t>& ranges = valid ? clusters : all;
+
+  // Split the clusters where the cache miss ratio so far is close to that
+  // of the whole cluster, with the cache flushed at the start of each
+  FifoCache cache(positions.size(), cache_size);
+  vector<uint32_t> starts;
+  for(size_t c=0; c+1<ranges.size(); c++) {
+    const size_t begin = ranges[c], end = ranges[c+1];
+    cache.flush();
+    size_t misses = 0;
+    for(size_t i=3*begin; i<3*end; i++) {
+      misses += cache.miss(indices[i]);
+    }
+    const float limit = threshold*misses/(end - begin);
+
+    cache.flush();
+    size_t start = begin;
+    misses = 0;
+    starts.push_back(begin);
+    for(size_t t=begin; t<end; t++) {
+      for(uint32_t k=0; k<3; k++) {
+        misses += cache.miss(indices[3*t+k]);
+      }
+      if(t+1 < end && misses <= limit*(t+1 - start)) {
+        starts.push_back(t+1);
+        start = t+1;
+        misses = 0;
+        cache.flush();
+      }
+    }
+  }
+  starts.push_back(Nt);
+
+  glm::vec3 mesh_centroid, mesh_normal;
+  float mesh_area;
+  sumTriangles(indices, positions, 0, Nt, mesh_centroid, mesh_normal, mesh_area);
+  mesh_centroid = mesh_area > 0.0f ? mesh_centroid/mesh_area : positions[indices[0]];
+
+  // Clusters facing away from the center are likely to occlude others, and
+  // are drawn first
+  const size_t Nc = starts.size()-1;
+  vector<std::pair<float, uint32_t> > order(Nc);
+#pragma omp parallel for
+  for(long c=0; c<long(Nc); c++) {
+    glm::vec3 centroid, normal;
+    float area;
+    sumTriangles(indices, positions, starts[c], starts[c+1], centroid, normal, area);
+    const float length = glm::length(normal);
+    float key = 0.0f;
+    if(area > 0.0f && length > 0.0f) {
+      key = glm::dot(centroid/area - mesh_centroid, normal/length);
+    }
+    order[c] = std::make_pair(-key, uint32_t(c));
+  }
+  std::stable_sort(order.begin(), order.end());
+
+  vector<uint32_t> output;
+  output.reserve(indices.size());
+  for(size_t i=0; i<Nc; i++) {
+    const uint32_t c = order[i].second;
+    output.insert(output.end(), &indices[3*starts[c]], &indices[0] + 3*starts[c+1]);
+  }
+  indices.swap(output);
+}
+
+void optimizeVertexFetch(vector<uint32_t>& indices, size_t num_vertices, vector<uint32_t>& remap) {
+  remap.assign(num_vertices, NONE);
+  uint32_t next = 0;
+  for(size_t i=0; i<indices.size(); i++) {
+    uint32_t& v = remap[indices[i]];
+    if(v == NONE) {
+      v = next++;
+    }
+    indices[i] = v;
+  }
+  for(size_t v=0; v<num_vertices; v++) {
+    if(remap[v] == NONE) {
+      remap[v] = next++;
+    }
+  }
+}
+
+}  // GfxUtil
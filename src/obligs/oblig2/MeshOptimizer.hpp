@@ -0,0 +1,72 @@
+/* MeshOptimizer.hpp
+ *
+ * Distributed under the GNU GPL.
+ */
+
+#ifndef GFXUTIL_MESHOPTIMIZER_H
+#define GFXUTIL_MESHOPTIMIZER_H
+
+#include <vector>
+#include <stdint.h>
+#include <glm/glm.hpp>
+
+namespace GfxUtil {
+
+/** Post-transform vertex cache statistics of an index buffer. */
+struct VertexCacheStatistics {
+  size_t m_transformed_;  ///< Number of vertices transformed, i.e., cache misses.
+  float  m_acmr_;         ///< Average cache miss ratio, transformed vertices per triangle.
+  float  m_atvr_;         ///< Average transformed to vertex ratio, 1 is optimal.
+};
+
+/** Simulates a FIFO post-transform vertex cache of the given size.
+ *  \param indices Three vertex indices per triangle.
+ *  \param num_vertices The number of vertices referenced by the indices. */
+VertexCacheStatistics analyzeVertexCache(const std::vector<uint32_t>& indices,
+                                         size_t num_vertices, size_t cache_size = 16);
+
+/** Reorders the triangles for the post-transform vertex cache, using
+ *  Tipsify (Sander, Nehab and Barczak, "Fast triangle reordering for vertex
+ *  locality and reduced overdraw", SIGGRAPH 2007). Tipsify runs in linear
+ *  time, and fans around one vertex at a time while the neighbours of that
+ *  vertex are still in the cache.
+ *  \param indices Three vertex indices per triangle, reordered in place.
+ *  \param clusters If not NULL, set to the first triangle of each run of
+ *                  triangles that starts after the cache is flushed, and
+ *                  the number of triangles, for optimizeOverdraw(). */
+void optimizeVertexCache(std::vector<uint32_t>& indices, size_t num_vertices,
+                         size_t cache_size = 16, std::vector<uint32_t>* clusters = NULL);
+
+/** Reorders clusters of triangles to reduce overdraw, keeping the order
+ *  inside each cluster. The clusters of optimizeVertexCache() are split
+ *  further where the cache miss ratio so far is below threshold times that
+ *  of the whole cluster, and sorted front to back from the outside of the
+ *  mesh, by the signed distance of their centroid from the centroid of the
+ *  mesh along their normal. Without valid clusters, all the triangles are
+ *  taken as one cluster.
+ *  \param threshold How much the cache miss ratio may grow, e.g. 1.05. */
+void optimizeOverdraw(std::vector<uint32_t>& indices, const std::vector<glm::vec3>& positions,
+                      const std::vector<uint32_t>& clusters, size_t cache_size = 16,
+                      float threshold = 1.05f);
+
+/** Renumbers the vertices in the order they are first used by the
+ *  triangles, so that vertices are fetched sequentially. Unused vertices
+ *  are moved to the end.
+ *  \param indices Updated to the new vertex numbers.
+ *  \param remap Set to the new number of each vertex. */
+void optimizeVertexFetch(std::vector<uint32_t>& indices, size_t num_vertices,
+                         std::vector<uint32_t>& remap);
+
+/** Reorders per-vertex values with the remap of optimizeVertexFetch(). */
+template <class T>
+void remapVertices(std::vector<T>& values, const std::vector<uint32_t>& remap) {
+  std::vector<T> remapped(values.size());
+  for(size_t i=0; i<values.size(); i++) {
+    remapped[remap[i]] = values[i];
+  }
+  values.swap(remapped);
+}
+
+}  // GfxUtil
+
+#endif
@@ -0,0 +1,114 @@
+/* MeshRenderer.cpp
+ *
+ * Distributed under the GNU GPL.
+ */
+
+#include "MeshRenderer.hpp"
+
+#include <vector>
+#include <algorithm>
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#ifndef BUFFER_OFFSET
+#define BUFFER_OFFSET(i) ((char *)NULL + (i))
+#endif
+
+using std::vector;
+
+namespace GfxUtil {
+
+MeshRenderer::MeshRenderer()
+    : m_indices_vbo_id(0), m_num_indices(0), m_upload_vertices(NULL), m_upload_indices(NULL),
+      m_upload_num_vertices(0), m_upload_num_indices(0), m_next_vertex(0), m_next_index(0),
+      m_uploading(false) {
+}
+
+MeshRenderer::~MeshRenderer() {
+  if(m_indices_vbo_id != 0) {
+    glDeleteBuffers(1, &m_indices_vbo_id);
+  }
+}
+
+void MeshRenderer::upload(const vector<glm::vec3>& positions, const vector<glm::vec3>& normals,
+                          const vector<uint32_t>& indices) {
+  m_vertex_buffer.update(positions, normals);
+
+  if(m_indices_vbo_id == 0) {
+    glGenBuffers(1, &m_indices_vbo_id);
+  }
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_indices_vbo_id);
+  glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size()*sizeof(uint32_t),
+               indices.empty() ? NULL : &indices[0], GL_STATIC_DRAW);
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+  m_num_indices = indices.size();
+  m_uploading = false;
+}
+
+void MeshRenderer::beginUpload(const vector<PackedVertex>& vertices, const vector<uint32_t>& indices) {
+  m_upload_vertices = vertices.empty() ? NULL : &vertices[0];
+  m_upload_indices = indices.empty() ? NULL : &indices[0];
+  m_upload_num_vertices = vertices.size();
+  m_upload_num_indices = indices.size();
+  m_next_vertex = m_next_index = 0;
+  m_uploading = true;
+  m_num_indices = 0;
+
+  // Allocate the buffers, the data follows in continueUpload()
+  m_vertex_buffer.resize(vertices.size());
+  if(m_indices_vbo_id == 0) {
+    glGenBuffers(1, &m_indices_vbo_id);
+  }
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_indices_vbo_id);
+  glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size()*sizeof(uint32_t), NULL, GL_STATIC_DRAW);
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+}
+
+bool MeshRenderer::continueUpload(size_t max_bytes) {
+  if(!m_uploading) {
+    return true;
+  }
+
+  // The vertices first, then the indices
+  if(m_next_vertex < m_upload_num_vertices) {
+    const size_t count = std::min(m_upload_num_vertices - m_next_vertex,
+                                  std::max(max_bytes/sizeof(PackedVertex), size_t(1)));
+    m_vertex_buffer.update(m_upload_vertices + m_next_vertex, m_next_vertex, count);
+    m_next_vertex += count;
+    max_bytes -= std::min(max_bytes, count*sizeof(PackedVertex));
+    if(max_bytes < sizeof(uint32_t)) {
+      return false;
+    }
+  }
+  if(m_next_index < m_upload_num_indices) {
+    const size_t count = std::min(m_upload_num_indices - m_next_index,
+                                  std::max(max_bytes/sizeof(uint32_t), size_t(1)));
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_indices_vbo_id);
+    glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, m_next_index*sizeof(uint32_t), count*sizeof(uint32_t),
+                    m_upload_indices + m_next_index);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+    m_next_index += count;
+  }
+  if(m_next_index < m_upload_num_indices) {
+    return false;
+  }
+
+  m_num_indices = m_upload_num_indices;
+  m_upload_vertices = NULL;
+  m_upload_indices = NULL;
+  m_uploading = false;
+  return true;
+}
+
+void MeshRenderer::render() const {
+  if(m_uploading || m_num_indices == 0) {
+    return;
+  }
+  m_vertex_buffer.bind();
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_indices_vbo_id);
+  glDrawElements(GL_TRIANGLES, m_num_indices, GL_UNSIGNED_INT, BUFFER_OFFSET(0));
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+  m_vertex_buffer.unbind();
+}
+
+}  // GfxUtil
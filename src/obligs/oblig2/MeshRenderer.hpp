@@ -0,0 +1,71 @@
+/* MeshRenderer.hpp
+ *
+ * Distributed under the GNU GPL.
+ */
+
+#ifndef GFXUTIL_MESHRENDERER_H
+#define GFXUTIL_MESHRENDERER_H
+
+#include <vector>
+#include <stdint.h>
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include "PackedVertexBuffer.hpp"
+
+namespace GfxUtil {
+
+/** Vertex and element buffer objects for drawing a triangle mesh that has
+ *  no buffers of its own, e.g. a CompactTriMesh, which does not depend on
+ *  OpenGL. */
+class MeshRenderer {
+ public:
+  /** Constructor, does not touch OpenGL. */
+  MeshRenderer();
+
+  /** Destructor, deletes the buffer objects. */
+  ~MeshRenderer();
+
+  /** Uploads the vertices and triangles, replacing the old ones.
+   *  \param indices Three vertex indices per triangle, e.g. reordered
+   *                 with optimizeVertexCache(). */
+  void upload(const std::vector<glm::vec3>& positions, const std::vector<glm::vec3>& normals,
+              const std::vector<uint32_t>& indices);
+
+  /** Starts uploading packed vertices and triangles, replacing the old
+   *  ones, to be continued with continueUpload(). Nothing is drawn until
+   *  the upload is done. The arrays must stay alive and unchanged until
+   *  then. */
+  void beginUpload(const std::vector<PackedVertex>& vertices, const std::vector<uint32_t>& indices);
+
+  /** Uploads up to about max_bytes more, at least one vertex or index.
+   *  \return True when everything has been uploaded. */
+  bool continueUpload(size_t max_bytes);
+
+  /** Draws the triangles, if any have been uploaded. */
+  void render() const;
+
+  /** Returns the number of triangles uploaded. */
+  size_t getNumTriangles() const { return m_num_indices/3; }
+
+ protected:
+  PackedVertexBuffer m_vertex_buffer;   /// Packed positions and normals.
+  GLuint             m_indices_vbo_id;  /// Element buffer object id, or 0.
+  size_t             m_num_indices;     /// Number of indices in the element buffer.
+
+  const PackedVertex* m_upload_vertices;      /// Vertices being uploaded, or NULL.
+  const uint32_t*     m_upload_indices;       /// Indices being uploaded, or NULL.
+  size_t              m_upload_num_vertices;  /// Number of vertices to upload.
+  size_t              m_upload_num_indices;   /// Number of indices to upload.
+  size_t              m_next_vertex;          /// First vertex not uploaded yet.
+  size_t              m_next_index;           /// First index not uploaded yet.
+  bool                m_uploading;            /// True until the upload is done.
+
+ private:
+  MeshRenderer(const MeshRenderer&);
+  MeshRenderer& operator=(const MeshRenderer&);
+};
+
+}  // GfxUtil
+
+#endif
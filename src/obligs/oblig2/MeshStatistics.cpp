@@ -0,0 +1,268 @@
+/* MeshStatistics.cpp
+ *
+ * Distributed under the GNU GPL.
+ */
+
+#include "MeshStatistics.hpp"
+
+#include <cmath>
+#include <vector>
+#include <atomic>
+#include <limits>
+#include <algorithm>
+#include <glm/glm.hpp>
+
+using std::vector;
+
+namespace GfxUtil {
+
+namespace {
+
+const uint32_t NONE = CompactTriMesh::NONE;
+
+/** Returns the root of the set of node v, and halves the path to it. The
+ *  parents are only ever changed to an ancestor, so threads may find roots
+ *  and unite sets concurrently. */
+uint32_t findRoot(vector<std::atomic<uint32_t> >& parents, uint32_t v) {
+  while(true) {
+    uint32_t parent = parents[v].load(std::memory_order_relaxed);
+    if(parent == v) {
+      return v;
+    }
+    const uint32_t grandparent = parents[parent].load(std::memory_order_relaxed);
+    if(grandparent != parent) {
+      parents[v].compare_exchange_weak(parent, grandparent, std::memory_order_relaxed);
+    }
+    v = grandparent;
+  }
+}
+
+/** Unites the sets of nodes a and b, by linking the larger root below the
+ *  smaller one, which keeps the links acyclic when threads race. */
+void uniteSets(vector<std::atomic<uint32_t> >& parents, uint32_t a, uint32_t b) {
+  while(true) {
+    a = findRoot(parents, a);
+    b = findRoot(parents, b);
+    if(a == b) {
+      return;
+    }
+    if(a < b) {
+      std::swap(a, b);
+    }
+    uint32_t expected = a;
+    if(parents[a].compare_exchange_strong(expected, b, std::memory_order_relaxed)) {
+      return;
+    }
+  }
+}
+
+/** Circumradius over twice the inradius, from the edge lengths, or 0 if
+ *  the triangle has no area. */
+float aspectRatio(const glm::vec3& a, const glm::vec3& b, const glm::vec3& c) {
+  const float la = glm::length(b - c);
+  const float lb = glm::length(c - a);
+  const float lc = glm::length(a - b);
+  const float s = 0.5f*(la + lb + lc);
+  const float denominator = 8.0f*(s - la)*(s - lb)*(s - lc);
+  return denominator > 0.0f ? la*lb*lc/denominator : 0.0f;
+}
+
+}  // namespace
+
+MeshStatistics analyzeMesh(const CompactTriMesh& mesh) {
+  const long Nv = mesh.getNumNodes();
+  const long Nt = mesh.getNumTriangles();
+  const vector<glm::vec3>& positions = mesh.getPositions();
+  const vector<uint32_t>& indices = mesh.getIndices();
+
+  MeshStatistics statistics;
+  const float limits[] = { 1.25f, 1.5f, 2.0f, 3.0f, 5.0f, 10.0f, 100.0f,
+                           std::numeric_limits<float>::max() };
+  statistics.m_aspect_ratio_limits_.assign(limits, limits + sizeof(limits)/sizeof(limits[0]));
+  const size_t Nbins = statistics.m_aspect_ratio_limits_.size();
+  statistics.m_aspect_ratios_.assign(Nbins, 0);
+
+  // Triangles: quality, the number of half-edges from each node, the
+  // components and the half-edges without twins
+  vector<uint32_t> incident(Nv, 0);
+  vector<uint32_t> boundary;
+  vector<std::atomic<uint32_t> > parents(Nv);
+#pragma omp parallel for
+  for(long v=0; v<Nv; v++) {
+    parents[v].store(v, std::memory_order_relaxed);
+  }
+
+  size_t degenerate = 0;
+  float min_aspect = std::numeric_limits<float>::max(), max_aspect = 0.0f;
+  double sum_aspect = 0.0, area = 0.0;
+#pragma omp parallel reduction(+:degenerate,sum_aspect,area)
+  {
+    vector<size_t> local_bins(Nbins, 0);
+    vector<uint32_t> local_boundary;
+    float local_min = std::numeric_limits<float>::max(), local_max = 0.0f;
+#pragma omp for schedule(static, 4096)
+    for(long t=0; t<Nt; t++) {
+      const uint32_t i0 = indices[3*t+0];
+      const uint32_t i1 = indices[3*t+1];
+      const uint32_t i2 = indices[3*t+2];
+      const glm::vec3& a = positions[i0];
+      const glm::vec3& b = positions[i1];
+      const glm::vec3& c = positions[i2];
+      area += 0.5f*glm::length(glm::cross(b - a, c - a));
+
+      const float aspect = aspectRatio(a, b, c);
+      if(i0 == i1 || i1 == i2 || i2 == i0 || aspect == 0.0f) {
+        degenerate++;
+      } else {
+        local_min = std::min(local_min, aspect);
+        local_max = std::max(local_max, aspect);
+        sum_aspect += aspect;
+        local_bins[std::lower_bound(limits, limits + Nbins - 1, aspect) - limits]++;
+      }
+
+      for(long k=0; k<3; k++) {
+#pragma omp atomic
+        incident[indices[3*t+k]]++;
+        if(mesh.isBoundary(3*t+k)) {
+          local_boundary.push_back(3*t+k);
+        }
+      }
+      uniteSets(parents, i0, i1);
+      uniteSets(parents, i0, i2);
+    }
+#pragma omp critical
+    {
+      min_aspect = std::min(min_aspect, local_min);
+      max_aspect = std::max(max_aspect, local_max);
+      for(size_t i=0; i<Nbins; i++) {
+        statistics.m_aspect_ratios_[i] += local_bins[i];
+      }
+      boundary.insert(boundary.end(), local_boundary.begin(), local_boundary.end());
+    }
+  }
+
+  // Nodes: valence, boundary, fans, components and bounding box. A node
+  // with more than one fan has half-edges that are not in the fan of its
+  // leading half-edge. This is a second pass since it compares with the
+  // number of half-edges from each node, and takes the components from
+  // the sets, which are only complete after all the triangles.
+  size_t used = 0, boundary_nodes = 0, nonmanifold_nodes = 0, irregular = 0, components = 0;
+  glm::vec3 bbox_min(std::numeric_limits<float>::max());
+  glm::vec3 bbox_max(-std::numeric_limits<float>::max());
+#pragma omp parallel reduction(+:used,boundary_nodes,nonmanifold_nodes,irregular,components)
+  {
+    vector<size_t> local_valences;
+    glm::vec3 local_min(std::numeric_limits<float>::max());
+    glm::vec3 local_max(-std::numeric_limits<float>::max());
+#pragma omp for schedule(dynamic, 4096)
+    for(long v=0; v<Nv; v++) {
+      const uint32_t first = mesh.getLeadingHalfEdge(v);
+      if(first == NONE || incident[v] == 0) {
+        continue;
+      }
+      used++;
+      local_min = glm::min(local_min, positions[v]);
+      local_max = glm::max(local_max, positions[v]);
+      if(findRoot(parents, v) == uint32_t(v)) {
+        components++;
+      }
+
+      size_t fan = 0;
+      uint32_t he = first;
+      do {
+        fan++;
+        he = mesh.getVtxRingNext(he);
+      } while(he != NONE && he != first);
+      const bool on_boundary = he == NONE;
+      const size_t valence = on_boundary ? fan+1 : fan;
+      if(fan != incident[v]) {
+        nonmanifold_nodes++;
+      }
+      if(on_boundary) {
+        boundary_nodes++;
+      }
+      if(valence != (on_boundary ? 4u : 6u)) {
+        irregular++;
+      }
+      if(valence >= local_valences.size()) {
+        local_valences.resize(valence+1, 0);
+      }
+      local_valences[valence]++;
+    }
+#pragma omp critical
+    {
+      bbox_min = glm::min(bbox_min, local_min);
+      bbox_max = glm::max(bbox_max, local_max);
+      if(local_valences.size() > statistics.m_valences_.size()) {
+        statistics.m_valences_.resize(local_valences.size(), 0);
+      }
+      for(size_t i=0; i<local_valences.size(); i++) {
+        statistics.m_valences_[i] += local_valences[i];
+      }
+    }
+  }
+
+  // Boundary loops. A half-edge without twin is followed by the one
+  // leaving its destination on the other side of the same fan, found by
+  // turning clockwise around the destination. At a node with several fans
+  // each fan pairs up its own two, so this maps the half-edges without
+  // twins one to one, and the loops are the cycles of the map. The
+  // boundary is small compared to the mesh, so the cycles are counted
+  // serially.
+  std::sort(boundary.begin(), boundary.end());
+  const long Nb = boundary.size();
+  vector<uint32_t> next_boundary(Nb);
+#pragma omp parallel for
+  for(long i=0; i<Nb; i++) {
+    uint32_t he = CompactTriMesh::getNext(boundary[i]);
+    while(!mesh.isBoundary(he)) {
+      he = mesh.getVtxRingPrev(he);
+    }
+    next_boundary[i] = std::lower_bound(boundary.begin(), boundary.end(), he) - boundary.begin();
+  }
+  vector<uint8_t> visited(Nb, 0);
+  size_t loops = 0;
+  for(long i=0; i<Nb; i++) {
+    if(visited[i]) {
+      continue;
+    }
+    loops++;
+    for(uint32_t j=i; !visited[j]; j=next_boundary[j]) {
+      visited[j] = 1;
+    }
+  }
+
+  const CompactTriMesh::ConnectivityReport& report = mesh.getConnectivityReport();
+  statistics.m_nodes_ = used;
+  statistics.m_unused_nodes_ = Nv - used;
+  statistics.m_triangles_ = Nt;
+  statistics.m_edges_ = report.m_inner_edges_ + report.m_boundary_edges_ +
+                        report.m_nonmanifold_edges_ + report.m_misoriented_edges_;
+  statistics.m_boundary_edges_ = report.m_boundary_edges_;
+  statistics.m_nonmanifold_edges_ = report.m_nonmanifold_edges_;
+  statistics.m_misoriented_edges_ = report.m_misoriented_edges_;
+  statistics.m_boundary_nodes_ = boundary_nodes;
+  statistics.m_nonmanifold_nodes_ = nonmanifold_nodes;
+  statistics.m_irregular_nodes_ = irregular;
+  statistics.m_boundary_loops_ = loops;
+  statistics.m_components_ = components;
+  statistics.m_euler_characteristic_ = long(used) - long(statistics.m_edges_) + Nt;
+  if(report.m_nonmanifold_edges_ == 0 && report.m_misoriented_edges_ == 0 &&
+     nonmanifold_nodes == 0) {
+    statistics.m_genus_ =
+        (2*long(components) - statistics.m_euler_characteristic_ - long(loops))/2;
+  } else {
+    statistics.m_genus_ = -1;
+  }
+  statistics.m_degenerate_triangles_ = degenerate;
+  const size_t regular = Nt - degenerate;
+  statistics.m_min_aspect_ratio_ = regular > 0 ? min_aspect : 0.0f;
+  statistics.m_max_aspect_ratio_ = max_aspect;
+  statistics.m_mean_aspect_ratio_ = regular > 0 ? float(sum_aspect/regular) : 0.0f;
+  statistics.m_area_ = area;
+  statistics.m_bbox_min_ = used > 0 ? bbox_min : glm::vec3(0.0f);
+  statistics.m_bbox_max_ = used > 0 ? bbox_max : glm::vec3(0.0f);
+  return statistics;
+}
+
+}  // GfxUtil
@@ -0,0 +1,64 @@
+/* MeshStatistics.hpp
+ *
+ * Distributed under the GNU GPL.
+ */
+
+#ifndef GFXUTIL_MESHSTATISTICS_H
+#define GFXUTIL_MESHSTATISTICS_H
+
+#include <vector>
+#include <stdint.h>
+#include <glm/glm.hpp>
+
+#include "CompactTriMesh.hpp"
+
+namespace GfxUtil {
+
+/** Topology and quality of a mesh, see analyzeMesh(). */
+struct MeshStatistics {
+  size_t    m_nodes_;               ///< Nodes used by a triangle.
+  size_t    m_unused_nodes_;        ///< Nodes not used by any triangle.
+  size_t    m_triangles_;           ///< Number of triangles.
+  size_t    m_edges_;               ///< Number of edges, of all kinds.
+  size_t    m_boundary_edges_;      ///< Edges of a single triangle.
+  size_t    m_nonmanifold_edges_;   ///< Edges shared by more than two triangles.
+  size_t    m_misoriented_edges_;   ///< Edges shared by two triangles of opposite orientation.
+  size_t    m_boundary_nodes_;      ///< Nodes on the boundary.
+  size_t    m_nonmanifold_nodes_;   ///< Nodes with more than one fan of triangles.
+  size_t    m_irregular_nodes_;     ///< Inner nodes with valence other than 6, boundary nodes other than 4.
+  size_t    m_boundary_loops_;      ///< Closed or open chains of boundary edges.
+  size_t    m_components_;          ///< Connected components.
+  long      m_euler_characteristic_;  ///< Nodes - edges + triangles.
+  long      m_genus_;               ///< Sum of the genus of the components, -1 if not an oriented manifold.
+  std::vector<size_t> m_valences_;  ///< Number of used nodes of each valence.
+  size_t    m_degenerate_triangles_;  ///< Triangles with a repeated node or no area.
+  float     m_min_aspect_ratio_;    ///< Smallest aspect ratio of the other triangles.
+  float     m_max_aspect_ratio_;    ///< Largest aspect ratio of the other triangles.
+  float     m_mean_aspect_ratio_;   ///< Mean aspect ratio of the other triangles.
+  std::vector<float>  m_aspect_ratio_limits_;  ///< Upper limit of each aspect ratio bin.
+  std::vector<size_t> m_aspect_ratios_;        ///< Number of triangles in each bin.
+  double    m_area_;                ///< Total area.
+  glm::vec3 m_bbox_min_;            ///< Minimum x,y,z-values of the used nodes.
+  glm::vec3 m_bbox_max_;            ///< Maximum x,y,z-values of the used nodes.
+};
+
+/** Computes topology and quality statistics of a mesh, in parallel, with one
+ *  pass over the triangles and one over the nodes. The nodes need a pass of
+ *  their own, since finding the nodes with several fans compares with the
+ *  number of triangles at each node, which is only known after all the
+ *  triangles.
+ *
+ *  The aspect ratio of a triangle is its circumradius over twice its
+ *  inradius, 1 for an equilateral triangle. The edge kinds are those found
+ *  when the connectivity was built, and the boundary loops are traced along
+ *  all half-edges without twins, including non-manifold and misoriented
+ *  ones, going from one to the next around the same fan of triangles, so
+ *  loops through non-manifold nodes are kept whole. The genus follows from
+ *  the Euler characteristic of each component, 2 - 2g - b, summed over the
+ *  components.
+ */
+MeshStatistics analyzeMesh(const CompactTriMesh& mesh);
+
+}  // GfxUtil
+
+#endif
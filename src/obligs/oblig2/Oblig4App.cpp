@@ -17,28 +17,34 @@
 #include "ReadTextfile.hpp"
 
 Oblig4App::Oblig4App()
-    : m_viewer_(), m_meshes_(), m_current_level_() {
+    : m_viewer_(), m_lod_(NULL), m_meshes_(), m_current_level_(0), m_use_trimesh_(false),
+      m_mesh_filename_("share/cube.msh"), m_window_width_(1), m_window_height_(1) {
 }
 
 Oblig4App::~Oblig4App() {
-  for(int mesh_index = 0;mesh_index < m_meshes_.size();++mesh_index) {
+  delete m_lod_;
+  for(size_t mesh_index = 0;mesh_index < m_meshes_.size();++mesh_index) {
     delete m_meshes_[mesh_index];
   }
 }
 
+bool Oblig4App::init(int argc, char** argv) {
+  if(argc > 1) {
+    m_mesh_filename_ = argv[1];
+  }
+  return true;
+}
+
 void Oblig4App::initGL() {
   glClearColor(0.0f, 0.0f, 0.5f, 0.0f);
   glEnable(GL_CULL_FACE);
   glEnable(GL_DEPTH_TEST);
   glEnable(GL_LIGHTING);
   
-  std::string mesh_filename = "share/cube.msh";
-  
-  m_meshes_.reserve(10);
-  m_meshes_.push_back(new GfxUtil::TriMesh(mesh_filename));
-  setupBoundingBox(m_meshes_[0]->getBBoxMin(), m_meshes_[0]->getBBoxMax());
-  
-  m_current_level_ = 0;
+  // The levels of detail are subdivided or decimated from this mesh on a
+  // background thread, as they are needed
+  m_lod_ = new GfxUtil::LodManager(new GfxUtil::CompactTriMesh(m_mesh_filename_));
+  setupBoundingBox(m_lod_->getBBoxMin(), m_lod_->getBBoxMax());
   
   setupLightParameters();
 }
@@ -70,17 +76,31 @@ void Oblig4App::display() {
   GLfloat light1_position[] = { 0.0f, -1.0f,  0.0f,  0.0f };
   glLightfv(GL_LIGHT1, GL_POSITION, light1_position);
   
-  // Render the mesh
+  // Render the level of detail that fits the size of the mesh on screen, or
+  // the level of the TriMesh chosen with '+' and '-'
   setupMaterials();
-  m_meshes_[m_current_level_]->render();
+  if(m_use_trimesh_) {
+    m_meshes_[m_current_level_]->render();
+  } else {
+    m_lod_->update(projection_matrix, model_view_matrix, m_window_width_, m_window_height_);
+    m_lod_->render();
+  }
   
   glutSwapBuffers();
   CHECK_OPENGL;
+
+  // Redraw until the selected level is built and uploaded, the upload
+  // continues a part per frame
+  if(!m_use_trimesh_ && m_lod_->isBuilding()) {
+    glutTimerFunc(30, redisplay, 0);
+  }
 }
 
 void Oblig4App::reshape(int w, int h) {
   glViewport(0, 0, w, h);
   m_viewer_.setWindowSize(w,h);
+  m_window_width_ = w;
+  m_window_height_ = h;
 }
 
 void Oblig4App::keyboard(unsigned char key, int /*x*/, int /*y*/) { 
@@ -88,14 +108,38 @@ void Oblig4App::keyboard(unsigned char key, int /*x*/, int /*y*/) {
     case 'q':
       std::exit(0);
       break;
+    case 't':
+      // Switch between the levels of detail and the TriMesh subdivision
+      m_use_trimesh_ = !m_use_trimesh_;
+      if(m_use_trimesh_ && m_meshes_.empty()) {
+        m_meshes_.reserve(10);
+        m_meshes_.push_back(new GfxUtil::TriMesh(m_mesh_filename_));
+        m_current_level_ = 0;
+      }
+      break;
     case '+':
-      ++m_current_level_;
-      if (m_current_level_ >= int(m_meshes_.size())) {
-        m_meshes_.push_back(m_meshes_.back()->subdivide());
+      if(m_use_trimesh_) {
+        ++m_current_level_;
+        if (m_current_level_ >= int(m_meshes_.size())) {
+          m_meshes_.push_back(m_meshes_.back()->subdivide());
+        }
+      } else {
+        // More detail, display() requests the levels from the background thread
+        m_lod_->setPixelsPerTriangle(0.5f*m_lod_->getPixelsPerTriangle());
       }
       break;
     case '-':
-      if (m_current_level_) --m_current_level_;
+      if(m_use_trimesh_) {
+        if (m_current_level_) --m_current_level_;
+      } else {
+        m_lod_->setPixelsPerTriangle(2.0f*m_lod_->getPixelsPerTriangle());
+      }
+      break;
+    case 'b':
+      m_lod_->setTriangleBudget(m_lod_->getTriangleBudget()/2);
+      break;
+    case 'B':
+      m_lod_->setTriangleBudget(2*m_lod_->getTriangleBudget());
       break;
   }
   glutPostRedisplay();
@@ -166,6 +210,10 @@ void Oblig4App::setupMaterials() {
   glMaterialf(GL_FRONT, GL_SHININESS, mat_shininess);
 }
 
+void Oblig4App::redisplay(int) {
+  glutPostRedisplay();
+}
+
 void Oblig4App::setupBoundingBox(const glm::vec3& low, const glm::vec3& high) {
   glm::vec3 origin = 0.5f * (low + high);
   float radius = 0.5f * glm::length(high - low);
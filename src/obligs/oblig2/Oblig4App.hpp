@@ -11,6 +11,7 @@
 
 #include "GLApp.hpp"
 #include "SimpleViewer.hpp"
+#include "LodManager.hpp"
 #include "TriMesh.hpp"
 
 class Oblig4App : public GLApp {
@@ -18,6 +19,7 @@ class Oblig4App : public GLApp {
   Oblig4App();
   ~Oblig4App();
   
+  bool init(int argc, char** argv);
   void initGL();
   void display();
   void reshape(int w, int h);
@@ -31,10 +33,16 @@ class Oblig4App : public GLApp {
   void setupLightParameters();
   void setupMaterials();
   void setupBoundingBox(const glm::vec3& low, const glm::vec3& high);
+  static void redisplay(int);
   
   GfxUtil::SimpleViewer m_viewer_;
-  std::vector<GfxUtil::TriMesh*> m_meshes_;
+  GfxUtil::LodManager* m_lod_;
+  std::vector<GfxUtil::TriMesh*> m_meshes_;  // Subdivided with TriMesh, made on the first 't'
   int m_current_level_;
+  bool m_use_trimesh_;
+  std::string m_mesh_filename_;
+  int m_window_width_;
+  int m_window_height_;
 };
 
 #endif // OBLIG4APP_HEADER_H_
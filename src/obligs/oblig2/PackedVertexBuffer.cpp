@@ -0,0 +1,101 @@
+/* PackedVertexBuffer.cpp
+ *
+ * Distributed under the GNU GPL.
+ */
+
+#include "PackedVertexBuffer.hpp"
+
+#include <cmath>
+#include <vector>
+#include <algorithm>
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#ifndef BUFFER_OFFSET
+#define BUFFER_OFFSET(i) ((char *)NULL + (i))
+#endif
+
+using std::vector;
+
+namespace GfxUtil {
+
+void packVertices(const glm::vec3* positions, const glm::vec3* normals, size_t stride,
+                  size_t count, PackedVertex* vertices) {
+  const char* p = reinterpret_cast<const char*>(positions);
+  const char* n = reinterpret_cast<const char*>(normals);
+  const long N = count;
+#pragma omp parallel for
+  for(long i=0; i<N; i++) {
+    const glm::vec3& position = *reinterpret_cast<const glm::vec3*>(p + i*stride);
+    const glm::vec3& normal = *reinterpret_cast<const glm::vec3*>(n + i*stride);
+    vertices[i].m_position_ = position;
+    for(int k=0; k<3; k++) {
+      const float c = std::max(-1.0f, std::min(1.0f, normal[k]));
+      vertices[i].m_normal_[k] = int16_t(std::floor(32767.0f*c + 0.5f));
+    }
+    vertices[i].m_padding_ = 0;
+  }
+}
+
+PackedVertexBuffer::PackedVertexBuffer()
+    : m_buffer_id(0), m_capacity(0), m_size(0) {
+}
+
+PackedVertexBuffer::~PackedVertexBuffer() {
+  if(m_buffer_id != 0) {
+    glDeleteBuffers(1, &m_buffer_id);
+  }
+}
+
+void PackedVertexBuffer::update(const glm::vec3* positions, const glm::vec3* normals,
+                                size_t stride, size_t count) {
+  m_staging.resize(count);
+  if(count > 0) {
+    packVertices(positions, normals, stride, count, &m_staging[0]);
+  }
+  resize(count);
+  update(m_staging.empty() ? NULL : &m_staging[0], 0, count);
+}
+
+void PackedVertexBuffer::update(const vector<glm::vec3>& positions, const vector<glm::vec3>& normals) {
+  update(positions.empty() ? NULL : &positions[0], normals.empty() ? NULL : &normals[0],
+         sizeof(glm::vec3), std::min(positions.size(), normals.size()));
+}
+
+void PackedVertexBuffer::resize(size_t count) {
+  if(m_buffer_id == 0) {
+    glGenBuffers(1, &m_buffer_id);
+  }
+  if(count > m_capacity) {
+    m_capacity = count + count/2;
+    glBindBuffer(GL_ARRAY_BUFFER, m_buffer_id);
+    glBufferData(GL_ARRAY_BUFFER, m_capacity*sizeof(PackedVertex), NULL, GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+  }
+  m_size = count;
+}
+
+void PackedVertexBuffer::update(const PackedVertex* vertices, size_t first, size_t count) {
+  if(count == 0) {
+    return;
+  }
+  glBindBuffer(GL_ARRAY_BUFFER, m_buffer_id);
+  glBufferSubData(GL_ARRAY_BUFFER, first*sizeof(PackedVertex), count*sizeof(PackedVertex), vertices);
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void PackedVertexBuffer::bind() const {
+  glBindBuffer(GL_ARRAY_BUFFER, m_buffer_id);
+  glVertexPointer(3, GL_FLOAT, sizeof(PackedVertex), BUFFER_OFFSET(0));
+  glNormalPointer(GL_SHORT, sizeof(PackedVertex), BUFFER_OFFSET(sizeof(glm::vec3)));
+  glEnableClientState(GL_VERTEX_ARRAY);
+  glEnableClientState(GL_NORMAL_ARRAY);
+}
+
+void PackedVertexBuffer::unbind() const {
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+  glDisableClientState(GL_VERTEX_ARRAY);
+  glDisableClientState(GL_NORMAL_ARRAY);
+}
+
+}  // GfxUtil
@@ -0,0 +1,88 @@
+/* PackedVertexBuffer.hpp
+ *
+ * Distributed under the GNU GPL.
+ */
+
+#ifndef GFXUTIL_PACKEDVERTEXBUFFER_H
+#define GFXUTIL_PACKEDVERTEXBUFFER_H
+
+#include <vector>
+#include <stdint.h>
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+namespace GfxUtil {
+
+/** Vertex as uploaded to the GPU: the position as floats, and the normal as
+ *  normalized shorts, 20 bytes in total. */
+struct PackedVertex {
+  glm::vec3 m_position_;   ///< Position.
+  int16_t   m_normal_[3];  ///< Normal, with -32767 to 32767 for -1 to 1.
+  int16_t   m_padding_;    ///< Zero, keeps the vertices 4-byte aligned.
+};
+
+/** Packs positions and normals into vertices, in parallel.
+ *  \param stride Bytes between consecutive positions and normals, e.g.
+ *                sizeof(glm::vec3) for arrays, or the size of a struct
+ *                holding both. */
+void packVertices(const glm::vec3* positions, const glm::vec3* normals, size_t stride,
+                  size_t count, PackedVertex* vertices);
+
+/** Vertex buffer object holding packed vertices.
+ *
+ *  The fixed function pipeline reads the normals with glNormalPointer as
+ *  GL_SHORT, which is normalized to [-1, 1]. An octahedral encoding of the
+ *  normal would be smaller, but needs a shader to decode.
+ *
+ *  The buffer keeps its capacity, so updating the vertices, e.g. after the
+ *  normals are recomputed, streams the new data into the existing buffer
+ *  with glBufferSubData. It only reallocates when the number of vertices
+ *  grows beyond the capacity, and then with room to grow.
+ */
+class PackedVertexBuffer {
+ public:
+  /** Constructor, does not touch OpenGL. */
+  PackedVertexBuffer();
+
+  /** Destructor, deletes the buffer object. */
+  ~PackedVertexBuffer();
+
+  /** Packs and uploads the vertices, replacing the old ones. */
+  void update(const glm::vec3* positions, const glm::vec3* normals, size_t stride, size_t count);
+
+  /** Packs and uploads the vertices, replacing the old ones. */
+  void update(const std::vector<glm::vec3>& positions, const std::vector<glm::vec3>& normals);
+
+  /** Sets the number of vertices, reallocating the buffer if it grows
+   *  beyond the capacity. The contents are undefined until they are
+   *  uploaded with update(). */
+  void resize(size_t count);
+
+  /** Uploads already packed vertices to the range starting at first, which
+   *  must be within the size, so that large buffers can be filled a part
+   *  at a time. */
+  void update(const PackedVertex* vertices, size_t first, size_t count);
+
+  /** Binds the buffer and sets the vertex and normal pointers. */
+  void bind() const;
+
+  /** Unbinds the buffer and disables the vertex and normal arrays. */
+  void unbind() const;
+
+  /** Returns the number of vertices. */
+  size_t getSize() const { return m_size; }
+
+ protected:
+  GLuint                    m_buffer_id;  /// The buffer object, or 0.
+  size_t                    m_capacity;   /// Number of vertices the buffer has room for.
+  size_t                    m_size;       /// Number of vertices in the buffer.
+  std::vector<PackedVertex> m_staging;    /// The packed vertices, reused between updates.
+
+ private:
+  PackedVertexBuffer(const PackedVertexBuffer&);
+  PackedVertexBuffer& operator=(const PackedVertexBuffer&);
+};
+
+}  // GfxUtil
+
+#endif
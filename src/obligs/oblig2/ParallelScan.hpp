@@ -0,0 +1,53 @@
+/* ParallelScan.hpp
+ *
+ * Distributed under the GNU GPL.
+ */
+
+#ifndef GFXUTIL_PARALLELSCAN_H
+#define GFXUTIL_PARALLELSCAN_H
+
+#include <vector>
+#include <algorithm>
+
+namespace GfxUtil {
+
+/** Replaces the values by their exclusive prefix sum, and returns the total.
+ *
+ *  The values are split into fixed blocks that are summed and scanned in
+ *  parallel with OpenMP, so the result does not depend on the number of
+ *  threads.
+ */
+template <class T>
+T exclusiveScan(std::vector<T>& values) {
+  const long N = values.size();
+  const long block_size = std::max(N/256, 4096L);
+  const long Nb = (N + block_size - 1)/block_size;
+
+  std::vector<T> block_sums(Nb+1, T(0));
+#pragma omp parallel for
+  for(long b=0; b<Nb; b++) {
+    T sum = T(0);
+    for(long i=b*block_size; i<std::min(N, (b+1)*block_size); i++) {
+      sum += values[i];
+    }
+    block_sums[b+1] = sum;
+  }
+  for(long b=0; b<Nb; b++) {
+    block_sums[b+1] += block_sums[b];
+  }
+
+#pragma omp parallel for
+  for(long b=0; b<Nb; b++) {
+    T sum = block_sums[b];
+    for(long i=b*block_size; i<std::min(N, (b+1)*block_size); i++) {
+      T value = values[i];
+      values[i] = sum;
+      sum += value;
+    }
+  }
+  return block_sums[Nb];
+}
+
+}  // GfxUtil
+
+#endif
@@ -0,0 +1,59 @@
+/* StencilTable.hpp
+ *
+ * Distributed under the GNU GPL.
+ */
+
+#ifndef GFXUTIL_STENCILTABLE_H
+#define GFXUTIL_STENCILTABLE_H
+
+#include <vector>
+#include <stdint.h>
+#include <glm/glm.hpp>
+
+namespace GfxUtil {
+
+/** Sparse matrix giving each node of a refined mesh as a weighted sum of
+ *  nodes of the coarse mesh.
+ *
+ *  The stencils only depend on the topology of the coarse mesh, so they can
+ *  be computed once and applied to any number of positions (or other
+ *  per-node values) of that mesh. The stencils are stored as three flat
+ *  arrays, like a compressed sparse row matrix: the stencil of node i
+ *  consists of the entries m_offsets_[i] to m_offsets_[i+1]-1 of m_indices_
+ *  and m_weights_.
+ */
+struct StencilTable {
+  /** Returns the number of refined nodes. */
+  size_t getNumStencils() const {
+    return m_offsets_.empty() ? 0 : m_offsets_.size()-1;
+  }
+
+  /** Computes refined value i from the coarse values. */
+  template <class T>
+  T apply(const std::vector<T>& coarse, size_t i) const {
+    T value = m_weights_[m_offsets_[i]] * coarse[m_indices_[m_offsets_[i]]];
+    for(uint32_t j=m_offsets_[i]+1; j<m_offsets_[i+1]; j++) {
+      value += m_weights_[j] * coarse[m_indices_[j]];
+    }
+    return value;
+  }
+
+  /** Computes the refined values from the coarse values, in parallel. */
+  template <class T>
+  void apply(const std::vector<T>& coarse, std::vector<T>& refined) const {
+    const long N = getNumStencils();
+    refined.resize(N);
+#pragma omp parallel for schedule(dynamic, 4096)
+    for(long i=0; i<N; i++) {
+      refined[i] = apply(coarse, i);
+    }
+  }
+
+  std::vector<uint32_t> m_offsets_;  ///< First entry of each stencil, and the total number of entries.
+  std::vector<uint32_t> m_indices_;  ///< Coarse node of each entry.
+  std::vector<float>    m_weights_;  ///< Weight of each entry.
+};
+
+}  // GfxUtil
+
+#endif
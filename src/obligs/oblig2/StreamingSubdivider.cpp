@@ -0,0 +1,357 @@
+/* StreamingSubdivider.cpp
+ *
+ * Distributed under the GNU GPL.
+ */
+
+#include "StreamingSubdivider.hpp"
+#include "MeshFile.hpp"
+#include "ParallelScan.hpp"
+
+#include <vector>
+#include <algorithm>
+#include <stdexcept>
+#include <glm/glm.hpp>
+
+using std::vector;
+
+namespace GfxUtil {
+
+namespace {
+
+/** Returns a new mesh of the triangles of mesh that share a node with the
+ *  owned triangles, and deletes mesh. The nodes of the owned triangles keep
+ *  all their triangles, which is all that the next level of the owned
+ *  triangles depends on, while the refinement of the rest of the one-ring
+ *  is dropped. The order of the triangles is kept, and owned is renumbered
+ *  to the new mesh. */
+CompactTriMesh* keepOneRing(CompactTriMesh* mesh, vector<uint32_t>& owned) {
+  const long Nt = mesh->getNumTriangles();
+  const vector<uint32_t>& indices = mesh->getIndices();
+  vector<uint8_t> marked(mesh->getNumNodes(), 0);
+  for(size_t i=0; i<owned.size(); i++) {
+    for(uint32_t k=0; k<3; k++) {
+      marked[indices[3*owned[i]+k]] = 1;
+    }
+  }
+
+  vector<uint32_t> kept, renumbered(Nt, CompactTriMesh::NONE);
+  for(long t=0; t<Nt; t++) {
+    if(marked[indices[3*t]] || marked[indices[3*t+1]] || marked[indices[3*t+2]]) {
+      renumbered[t] = kept.size();
+      kept.push_back(t);
+    }
+  }
+  for(size_t i=0; i<owned.size(); i++) {
+    owned[i] = renumbered[owned[i]];
+  }
+  CompactTriMesh* trimmed = mesh->extractTriangles(kept);
+  delete mesh;
+  return trimmed;
+}
+
+}  // namespace
+
+const uint32_t StreamingSubdivider::NONE;
+
+StreamingSubdivider::StreamingSubdivider(const CompactTriMesh& mesh, size_t max_patch_triangles)
+    : m_mesh(mesh), m_max_patch_triangles(max_patch_triangles), m_num_patches(0),
+      m_max_refined_triangles(0) {
+  const long Nv = mesh.getNumNodes();
+  const long Nhe = mesh.getNumHalfEdges();
+  mesh.numberEdges(m_edges, m_first_halfedges);
+
+  // The triangles around each node, including all fans of non-manifold
+  // nodes, which the half-edges do not connect
+  m_node_offsets.assign(Nv+1, 0);
+#pragma omp parallel for
+  for(long he=0; he<Nhe; he++) {
+#pragma omp atomic
+    m_node_offsets[mesh.getSourceNode(he)]++;
+  }
+  const uint32_t Nentries = exclusiveScan(m_node_offsets);
+  m_node_triangles.resize(Nentries);
+  vector<uint32_t> fill(m_node_offsets.begin(), m_node_offsets.end()-1);
+  for(long he=0; he<Nhe; he++) {
+    m_node_triangles[fill[mesh.getSourceNode(he)]++] = CompactTriMesh::getTriangle(he);
+  }
+}
+
+void StreamingSubdivider::subdivide(int levels, const std::string& filename) {
+  // Beyond 15 levels a single triangle has more than 2^32 children
+  if(levels < 0 || levels > 15) {
+    throw std::runtime_error("StreamingSubdivider: invalid number of levels for " + filename);
+  }
+
+  // A base triangle that alone refines to more than a patch is refined one
+  // level in memory first, and its children are streamed instead
+  if((uint64_t(1) << 2*levels) > m_max_patch_triangles && levels > 0) {
+    CompactTriMesh* coarse = m_mesh.subdivideLoop();
+    try {
+      StreamingSubdivider subdivider(*coarse, m_max_patch_triangles);
+      subdivider.subdivide(levels-1, filename);
+      m_num_patches = subdivider.m_num_patches;
+      m_max_refined_triangles = std::max(subdivider.m_max_refined_triangles,
+                                         coarse->getNumTriangles());
+    } catch(...) {
+      delete coarse;
+      throw;
+    }
+    delete coarse;
+    return;
+  }
+
+  const uint64_t Nv = m_mesh.getNumNodes();
+  const uint64_t Nt = m_mesh.getNumTriangles();
+  const uint64_t Ne = m_first_halfedges.size();
+  const uint32_t n = 1u << levels;
+  const uint64_t children = uint64_t(1) << 2*levels;
+  const uint64_t face_nodes = uint64_t(n-1)*(n > 1 ? n-2 : 0)/2;
+  MeshFileWriter writer(filename, Nv + Ne*(n-1) + Nt*face_nodes, Nt*children, true);
+
+  // Unused base nodes are not in any patch
+  for(uint64_t v=0; v<Nv; v++) {
+    if(m_mesh.getLeadingHalfEdge(v) == NONE) {
+      writer.writePositions(v, &m_mesh.getPosition(v), 1);
+      writer.writeNormals(v, &m_mesh.getNormal(v), 1);
+    }
+  }
+
+  // Lattice coordinates (l1, l2) of the corners of the refined triangles of
+  // one base triangle, split like subdivideLoop() does: child k < 3 of
+  // (c0, c1, c2) is (ck, mk, m(k-1)), child 3 is (m0, m1, m2), where mk is
+  // the middle of the edge from ck
+  vector<uint32_t> lattice(6);
+  lattice[0] = 0; lattice[1] = 0;
+  lattice[2] = n; lattice[3] = 0;
+  lattice[4] = 0; lattice[5] = n;
+  for(int level=0; level<levels; level++) {
+    vector<uint32_t> refined(4*lattice.size());
+    for(size_t t=0; t<lattice.size()/6; t++) {
+      const uint32_t* c = &lattice[6*t];
+      uint32_t m[6];
+      for(uint32_t k=0; k<3; k++) {
+        const uint32_t k1 = (k+1)%3;
+        m[2*k+0] = (c[2*k+0] + c[2*k1+0])/2;
+        m[2*k+1] = (c[2*k+1] + c[2*k1+1])/2;
+      }
+      for(uint32_t k=0; k<3; k++) {
+        uint32_t* child = &refined[6*(4*t+k)];
+        const uint32_t k2 = (k+2)%3;
+        child[0] = c[2*k+0];  child[1] = c[2*k+1];
+        child[2] = m[2*k+0];  child[3] = m[2*k+1];
+        child[4] = m[2*k2+0]; child[5] = m[2*k2+1];
+      }
+      std::copy(m, m+6, &refined[6*(4*t+3)]);
+    }
+    lattice.swap(refined);
+  }
+
+  m_num_patches = partition(std::max(m_max_patch_triangles/children, size_t(1)));
+  m_max_refined_triangles = 0;
+  vector<uint32_t> local_nodes(Nv, NONE);
+  for(uint32_t patch=0; patch<m_num_patches; patch++) {
+    // The patch and the other triangles around its nodes, in the order of
+    // the base mesh, so that the leading half-edges of nodes with several
+    // fans, and thus their stencils, are the same as in the base mesh
+    const vector<uint32_t> owned(m_patch_triangles.begin() + m_patch_offsets[patch],
+                                 m_patch_triangles.begin() + m_patch_offsets[patch+1]);
+    const long Nowned = owned.size();
+    vector<uint32_t> triangles;
+    for(long i=0; i<Nowned; i++) {
+      for(uint32_t k=0; k<3; k++) {
+        const uint32_t v = m_mesh.getSourceNode(3*owned[i]+k);
+        triangles.insert(triangles.end(), m_node_triangles.begin() + m_node_offsets[v],
+                         m_node_triangles.begin() + m_node_offsets[v+1]);
+      }
+    }
+    std::sort(triangles.begin(), triangles.end());
+    triangles.erase(std::unique(triangles.begin(), triangles.end()), triangles.end());
+    vector<uint32_t> local_owned(Nowned);
+    for(long i=0; i<Nowned; i++) {
+      local_owned[i] = std::lower_bound(triangles.begin(), triangles.end(), owned[i]) -
+                       triangles.begin();
+    }
+
+    vector<glm::vec3> positions;
+    vector<uint32_t> indices(3*triangles.size());
+    for(size_t i=0; i<indices.size(); i++) {
+      const uint32_t v = m_mesh.getSourceNode(3*triangles[i/3] + i%3);
+      if(local_nodes[v] == NONE) {
+        local_nodes[v] = positions.size();
+        positions.push_back(m_mesh.getPosition(v));
+      }
+      indices[i] = local_nodes[v];
+    }
+    for(size_t i=0; i<indices.size(); i++) {
+      local_nodes[m_mesh.getSourceNode(3*triangles[i/3] + i%3)] = NONE;
+    }
+
+    // Refine level by level, keeping only the triangles around the nodes of
+    // the refined patch, so that the one-ring shrinks with the triangles
+    // instead of being refined to full depth. The refined patch triangles
+    // of owned triangle i are owned_local[children*i] and on, in the order
+    // of subdivideLoop().
+    CompactTriMesh* refined = new CompactTriMesh(positions, indices);
+    vector<uint32_t> owned_local(local_owned), children_local;
+    for(int level=0; level<levels; level++) {
+      CompactTriMesh* next = refined->subdivideLoop();
+      delete refined;
+      refined = next;
+      m_max_refined_triangles = std::max(m_max_refined_triangles, refined->getNumTriangles());
+      children_local.resize(4*owned_local.size());
+      for(size_t i=0; i<owned_local.size(); i++) {
+        for(uint32_t k=0; k<4; k++) {
+          children_local[4*i+k] = 4*owned_local[i]+k;
+        }
+      }
+      owned_local.swap(children_local);
+      if(level+1 < levels) {
+        refined = keepOneRing(refined, owned_local);
+      }
+    }
+    m_max_refined_triangles = std::max(m_max_refined_triangles, refined->getNumTriangles());
+
+    // Number the refined triangles of the patch in the refined base mesh
+    const vector<uint32_t>& refined_indices = refined->getIndices();
+    vector<uint32_t> renumbered(3*children*Nowned);
+#pragma omp parallel for
+    for(long i=0; i<Nowned; i++) {
+      for(uint64_t j=0; j<3*children; j++) {
+        renumbered[3*children*i+j] = getRefinedNode(owned[i], n, lattice[2*j], lattice[2*j+1]);
+      }
+    }
+
+    // Write the triangles, and the nodes this patch is responsible for, in
+    // runs of consecutive nodes
+    vector<std::pair<uint32_t, uint32_t> > nodes;
+    vector<bool> seen(refined->getNumNodes(), false);
+    for(long i=0; i<Nowned; i++) {
+      writer.writeTriangles(children*owned[i], &renumbered[3*children*i], children);
+      for(uint64_t j=0; j<3*children; j++) {
+        const uint32_t node = refined_indices[3*owned_local[children*i + j/3] + j%3];
+        if(!seen[node] && isWrittenBy(patch, owned[i], n, lattice[2*j], lattice[2*j+1])) {
+          nodes.push_back(std::make_pair(renumbered[3*children*i+j], node));
+        }
+        seen[node] = true;
+      }
+    }
+    std::sort(nodes.begin(), nodes.end());
+    vector<glm::vec3> run_positions, run_normals;
+    for(size_t i=0; i<nodes.size(); ) {
+      size_t j = i;
+      run_positions.clear();
+      run_normals.clear();
+      while(j < nodes.size() && nodes[j].first == nodes[i].first + (j-i)) {
+        run_positions.push_back(refined->getPosition(nodes[j].second));
+        run_normals.push_back(refined->getNormal(nodes[j].second));
+        j++;
+      }
+      writer.writePositions(nodes[i].first, &run_positions[0], j-i);
+      writer.writeNormals(nodes[i].first, &run_normals[0], j-i);
+      i = j;
+    }
+    delete refined;
+  }
+}
+
+size_t StreamingSubdivider::partition(size_t patch_triangles) {
+  // Grow each patch breadth first across the edges, and start the next one
+  // from the first triangle left when it is full
+  const uint32_t Nt = m_mesh.getNumTriangles();
+  m_patches.assign(Nt, NONE);
+  uint32_t patch = 0;
+  size_t size = 0;
+  vector<uint32_t> queue;
+  for(uint32_t seed=0; seed<Nt; seed++) {
+    if(m_patches[seed] != NONE) {
+      continue;
+    }
+    queue.assign(1, seed);
+    m_patches[seed] = patch;
+    size++;
+    for(size_t i=0; i<queue.size() && size < patch_triangles; i++) {
+      for(uint32_t k=0; k<3 && size < patch_triangles; k++) {
+        const uint32_t twin = m_mesh.getTwin(3*queue[i]+k);
+        if(twin != NONE && m_patches[CompactTriMesh::getTriangle(twin)] == NONE) {
+          m_patches[CompactTriMesh::getTriangle(twin)] = patch;
+          queue.push_back(CompactTriMesh::getTriangle(twin));
+          size++;
+        }
+      }
+    }
+    if(size == patch_triangles) {
+      patch++;
+      size = 0;
+    }
+  }
+  const size_t num_patches = size > 0 ? patch+1 : patch;
+
+  m_patch_offsets.assign(num_patches+1, 0);
+  for(uint32_t t=0; t<Nt; t++) {
+    m_patch_offsets[m_patches[t]+1]++;
+  }
+  for(size_t p=0; p<num_patches; p++) {
+    m_patch_offsets[p+1] += m_patch_offsets[p];
+  }
+  m_patch_triangles.resize(Nt);
+  vector<uint32_t> fill(m_patch_offsets.begin(), m_patch_offsets.end()-1);
+  for(uint32_t t=0; t<Nt; t++) {
+    m_patch_triangles[fill[m_patches[t]]++] = t;
+  }
+  return num_patches;
+}
+
+uint32_t StreamingSubdivider::getRefinedNode(uint32_t t, uint32_t n, uint32_t l1,
+                                             uint32_t l2) const {
+  const uint32_t l0 = n - l1 - l2;
+  if(l1 == 0 && l2 == 0) {
+    return m_mesh.getSourceNode(3*t);
+  } else if(l0 == 0 && l2 == 0) {
+    return m_mesh.getSourceNode(3*t+1);
+  } else if(l0 == 0 && l1 == 0) {
+    return m_mesh.getSourceNode(3*t+2);
+  }
+
+  const uint64_t Nv = m_mesh.getNumNodes();
+  const uint64_t Ne = m_first_halfedges.size();
+  if(l0 == 0 || l1 == 0 || l2 == 0) {
+    // On the edge of half-edge he, at along steps from its source
+    uint32_t he, along;
+    if(l2 == 0) {
+      he = 3*t;
+      along = l1;
+    } else if(l0 == 0) {
+      he = 3*t+1;
+      along = l2;
+    } else {
+      he = 3*t+2;
+      along = l0;
+    }
+    const uint32_t e = m_edges[he];
+    if(m_mesh.getSourceNode(m_first_halfedges[e]) != m_mesh.getSourceNode(he)) {
+      along = n - along;
+    }
+    return Nv + uint64_t(e)*(n-1) + along-1;
+  }
+
+  // Inside the triangle, row by row of l1
+  const uint64_t face_nodes = uint64_t(n-1)*(n-2)/2;
+  const uint64_t row = uint64_t(l1-1)*(n-1) - uint64_t(l1-1)*l1/2;
+  return Nv + Ne*(n-1) + t*face_nodes + row + l2-1;
+}
+
+bool StreamingSubdivider::isWrittenBy(uint32_t patch, uint32_t t, uint32_t n, uint32_t l1,
+                                      uint32_t l2) const {
+  const uint32_t l0 = n - l1 - l2;
+  const uint32_t corners = (l0 > 0) + (l1 > 0) + (l2 > 0);
+  if(corners == 3) {
+    return true;
+  } else if(corners == 1) {
+    const uint32_t v = m_mesh.getSourceNode(3*t + (l1 > 0 ? 1 : l2 > 0 ? 2 : 0));
+    return m_patches[CompactTriMesh::getTriangle(m_mesh.getLeadingHalfEdge(v))] == patch;
+  }
+  const uint32_t he = l2 == 0 ? 3*t : l0 == 0 ? 3*t+1 : 3*t+2;
+  return m_patches[CompactTriMesh::getTriangle(m_first_halfedges[m_edges[he]])] == patch;
+}
+
+}  // GfxUtil
@@ -0,0 +1,100 @@
+/* StreamingSubdivider.hpp
+ *
+ * Distributed under the GNU GPL.
+ */
+
+#ifndef GFXUTIL_STREAMINGSUBDIVIDER_H
+#define GFXUTIL_STREAMINGSUBDIVIDER_H
+
+#include <vector>
+#include <string>
+#include <stdint.h>
+
+#include "CompactTriMesh.hpp"
+
+namespace GfxUtil {
+
+/** Out-of-core Loop-subdivision, for refined meshes larger than memory.
+ *
+ *  The base mesh is partitioned into patches of neighbouring triangles.
+ *  Each patch is refined on its own, together with the one-ring of
+ *  triangles around it, which the stencils of the patch reach, and only the
+ *  triangles of the patch itself are kept. The result is streamed to a
+ *  binary mesh file (see MeshFileWriter). After each level, only the
+ *  refined triangles of the patch and the one-ring around them are kept,
+ *  so the ring does not grow with the levels, and the memory used is
+ *  bounded by the size of a refined patch with its ring, and the base mesh,
+ *  no matter how many levels are added.
+ *
+ *  If a single base triangle refines to more than max_patch_triangles, the
+ *  base mesh is refined in memory first, until a triangle fits in a patch,
+ *  and the remaining levels are streamed. The numbering below is then that
+ *  of the refined base mesh.
+ *
+ *  The nodes and triangles are numbered by where they come from in the
+ *  base mesh, so that patches agree on the nodes they share without
+ *  talking to each other:
+ *
+ *  - The base nodes keep their indices.
+ *  - The 2^levels-1 nodes inside each base edge follow, edge by edge,
+ *    in the order of numberEdges(), from the source of the first half-edge.
+ *  - The nodes inside each base triangle follow, triangle by triangle.
+ *  - Triangle t is split into the triangles 4^levels*t and on, in the same
+ *    order as levels times subdivideLoop().
+ *
+ *  A shared node is written by one patch only, the one of the triangle of
+ *  the leading half-edge of a base node, or of the first half-edge of a
+ *  base edge.
+ */
+class StreamingSubdivider {
+ public:
+  /** Constructor, prepares the adjacency of the base mesh, which must
+   *  outlive the subdivider.
+   *  \param max_patch_triangles The number of triangles of a refined patch,
+   *                             without the one-ring, bounding the memory. */
+  StreamingSubdivider(const CompactTriMesh& mesh, size_t max_patch_triangles = 1 << 20);
+
+  /** Refines the base mesh and writes it to a .bmsh-file with normals,
+   *  throws std::runtime_error if the file cannot be written, or the
+   *  refined mesh is too large for 32-bit indices. */
+  void subdivide(int levels, const std::string& filename);
+
+  /** Returns the number of patches of the last subdivide(). */
+  size_t getNumPatches() const { return m_num_patches; }
+
+  /** Returns the largest number of triangles held in memory by the last
+   *  subdivide(), that of a refined patch with its one-ring at any level,
+   *  or of the base mesh refined in memory. */
+  size_t getMaxRefinedTriangles() const { return m_max_refined_triangles; }
+
+ protected:
+  /** Splits the triangles into patches of neighbouring triangles, and
+   *  returns the number of patches. */
+  size_t partition(size_t patch_triangles);
+
+  /** Returns the index in the refined mesh of the node at the lattice
+   *  coordinates l1, l2 in base triangle t, in steps of 1/n of its edges
+   *  from its first node towards its second and third nodes. */
+  uint32_t getRefinedNode(uint32_t t, uint32_t n, uint32_t l1, uint32_t l2) const;
+
+  /** Returns true if patch writes the refined node. */
+  bool isWrittenBy(uint32_t patch, uint32_t t, uint32_t n, uint32_t l1, uint32_t l2) const;
+
+  static const uint32_t NONE = CompactTriMesh::NONE;
+
+  const CompactTriMesh&  m_mesh;             /// The base mesh.
+  size_t                 m_max_patch_triangles;  /// Triangles of a refined patch.
+  std::vector<uint32_t>  m_edges;            /// Edge of each half-edge.
+  std::vector<uint32_t>  m_first_halfedges;  /// First half-edge of each edge.
+  std::vector<uint32_t>  m_node_offsets;     /// First triangle of each node in m_node_triangles.
+  std::vector<uint32_t>  m_node_triangles;   /// The triangles around each node.
+  std::vector<uint32_t>  m_patches;          /// Patch of each triangle.
+  std::vector<uint32_t>  m_patch_offsets;    /// First triangle of each patch in m_patch_triangles.
+  std::vector<uint32_t>  m_patch_triangles;  /// The triangles of each patch.
+  size_t                 m_num_patches;      /// Number of patches.
+  size_t                 m_max_refined_triangles;  /// Largest refined patch.
+};
+
+}  // GfxUtil
+
+#endif
@@ -0,0 +1,369 @@
+/* TextMeshParser.cpp
+ *
+ * Distributed under the GNU GPL.
+ */
+
+#include "TextMeshParser.hpp"
+#include "ParallelScan.hpp"
+
+#include <cmath>
+#include <stdexcept>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <glm/glm.hpp>
+
+using std::runtime_error;
+using std::string;
+using std::vector;
+
+namespace GfxUtil {
+
+namespace {
+
+/** Approximate size of the chunks parsed in parallel. */
+const size_t CHUNK_SIZE = 1 << 20;
+
+/** Read-only mapping of a whole file. */
+struct MappedFile {
+  MappedFile(const string& filename) : m_data_(NULL), m_size_(0) {
+    int fd = open(filename.c_str(), O_RDONLY);
+    struct stat buffer;
+    if(fd < 0 || fstat(fd, &buffer) != 0) {
+      if(fd >= 0) {
+        close(fd);
+      }
+      throw runtime_error("Error reading from " + filename);
+    }
+    m_size_ = buffer.st_size;
+    if(m_size_ > 0) {
+      void* mapping = mmap(NULL, m_size_, PROT_READ, MAP_PRIVATE, fd, 0);
+      if(mapping == MAP_FAILED) {
+        close(fd);
+        throw runtime_error("Error mapping " + filename);
+      }
+      m_data_ = static_cast<const char*>(mapping);
+    }
+    close(fd);
+  }
+
+  ~MappedFile() {
+    if(m_data_ != NULL) {
+      munmap(const_cast<char*>(m_data_), m_size_);
+    }
+  }
+
+  const char* m_data_;  ///< The contents of the file, or NULL if it is empty.
+  size_t      m_size_;  ///< Size of the file in bytes.
+};
+
+bool isSpace(char c) {
+  return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\v' || c == '\f';
+}
+
+bool isDigit(char c) {
+  return c >= '0' && c <= '9';
+}
+
+const char* skipSpace(const char* p, const char* end) {
+  while(p < end && isSpace(*p)) {
+    p++;
+  }
+  return p;
+}
+
+/** Parses a decimal integer of at most 32 bits.
+ *  \return The end of the number, or NULL if there is no number at p. */
+const char* parseInt(const char* p, const char* end, long& value) {
+  bool negative = false;
+  if(p < end && (*p == '-' || *p == '+')) {
+    negative = *p == '-';
+    p++;
+  }
+  if(p == end || !isDigit(*p)) {
+    return NULL;
+  }
+  long v = 0;
+  for(; p < end && isDigit(*p); p++) {
+    v = 10*v + (*p - '0');
+    if(v > 0xffffffffL) {
+      return NULL;
+    }
+  }
+  value = negative ? -v : v;
+  return p;
+}
+
+/** Splits [begin, end) into chunks of about CHUNK_SIZE bytes, each starting
+ *  at a whitespace character, or at the start of a line if lines is set.
+ *  \return The start of each chunk, and end. */
+vector<const char*> splitChunks(const char* begin, const char* end, bool lines) {
+  vector<const char*> starts(1, begin);
+  while(size_t(end - starts.back()) > CHUNK_SIZE) {
+    const char* p = starts.back() + CHUNK_SIZE;
+    while(p < end && (lines ? p[-1] != '\n' : !isSpace(*p))) {
+      p++;
+    }
+    if(p == end) {
+      break;
+    }
+    starts.push_back(p);
+  }
+  starts.push_back(end);
+  return starts;
+}
+
+/** Returns true if the line at p starts with the keyword followed by a
+ *  space, like "v 1 2 3" for "v" but not "vn 1 2 3". */
+bool hasKeyword(const char* p, const char* end, char keyword) {
+  return end - p >= 2 && p[0] == keyword && (p[1] == ' ' || p[1] == '\t');
+}
+
+}  // namespace
+
+const char* parseFloat(const char* p, const char* end, float& value) {
+  static const double powers[23] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+  };
+
+  bool negative = false;
+  if(p < end && (*p == '-' || *p == '+')) {
+    negative = *p == '-';
+    p++;
+  }
+
+  // The significant digits are collected in an integer, and the position
+  // of the decimal point in the exponent
+  uint64_t mantissa = 0;
+  int digits = 0;
+  int exponent = 0;
+  bool any = false;
+  for(; p < end && isDigit(*p); p++) {
+    any = true;
+    if(digits < 19) {
+      mantissa = 10*mantissa + (*p - '0');
+      digits += mantissa != 0;
+    } else {
+      exponent++;
+    }
+  }
+  if(p < end && *p == '.') {
+    for(p++; p < end && isDigit(*p); p++) {
+      any = true;
+      if(digits < 19) {
+        mantissa = 10*mantissa + (*p - '0');
+        digits += mantissa != 0;
+        exponent--;
+      }
+    }
+  }
+  if(!any) {
+    return NULL;
+  }
+  if(p < end && (*p == 'e' || *p == 'E')) {
+    const char* q = p+1;
+    bool negative_exponent = false;
+    if(q < end && (*q == '-' || *q == '+')) {
+      negative_exponent = *q == '-';
+      q++;
+    }
+    if(q < end && isDigit(*q)) {
+      int e = 0;
+      for(; q < end && isDigit(*q); q++) {
+        e = e < 10000 ? 10*e + (*q - '0') : e;
+      }
+      exponent += negative_exponent ? -e : e;
+      p = q;
+    }
+  }
+
+  double v = double(mantissa);
+  if(mantissa != 0 && exponent != 0) {
+    if(exponent > 0 && exponent <= 22) {
+      v *= powers[exponent];
+    } else if(exponent < 0 && exponent >= -22) {
+      v /= powers[-exponent];
+    } else {
+      v *= std::pow(10.0, exponent);
+    }
+  }
+  value = float(negative ? -v : v);
+  return p;
+}
+
+void parseMsh(const char* begin, const char* end, vector<glm::vec3>& points,
+              vector<uint32_t>& indices) {
+  long Nv, Nt;
+  const char* p = parseInt(skipSpace(begin, end), end, Nv);
+  p = p == NULL ? NULL : parseInt(skipSpace(p, end), end, Nt);
+  if(p == NULL || Nv < 0 || Nt < 0) {
+    throw runtime_error("Invalid header in .msh-data");
+  }
+
+  // Count the numbers of each chunk, which gives the number of the first
+  // value of each chunk
+  const vector<const char*> chunks = splitChunks(p, end, false);
+  const long Nc = chunks.size()-1;
+  vector<size_t> first(Nc);
+#pragma omp parallel for schedule(dynamic, 1)
+  for(long c=0; c<Nc; c++) {
+    size_t count = 0;
+    for(const char* q = chunks[c]; q < chunks[c+1]; q++) {
+      count += !isSpace(*q) && (q == chunks[c] || isSpace(q[-1]));
+    }
+    first[c] = count;
+  }
+  const size_t Nvalues = 3*Nv + 3*Nt;
+  if(exclusiveScan(first) < Nvalues) {
+    throw runtime_error("Unexpected end of .msh-data");
+  }
+
+  // Parse the coordinates and indices, numbers after them are ignored
+  points.resize(Nv);
+  indices.resize(3*Nt);
+  vector<uint8_t> failed(Nc, 0);
+#pragma omp parallel for schedule(dynamic, 1)
+  for(long c=0; c<Nc; c++) {
+    const char* chunk_end = chunks[c+1];
+    size_t value = first[c];
+    for(const char* q = skipSpace(chunks[c], chunk_end); q < chunk_end && value < Nvalues;
+        q = skipSpace(q, chunk_end), value++) {
+      if(value < size_t(3*Nv)) {
+        q = parseFloat(q, chunk_end, points[value/3][value%3]);
+      } else {
+        long ix = -1;
+        q = parseInt(q, chunk_end, ix);
+        if(ix < 0 || ix >= Nv) {
+          q = NULL;
+        }
+        indices[value - 3*Nv] = ix;
+      }
+      if(q == NULL || (q < chunk_end && !isSpace(*q))) {
+        failed[c] = 1;
+        break;
+      }
+    }
+  }
+  for(long c=0; c<Nc; c++) {
+    if(failed[c]) {
+      throw runtime_error("Invalid number in .msh-data");
+    }
+  }
+}
+
+void parseObj(const char* begin, const char* end, vector<glm::vec3>& points,
+              vector<uint32_t>& indices) {
+  // Count the vertices and the triangles of the faces of each chunk
+  const vector<const char*> chunks = splitChunks(begin, end, true);
+  const long Nc = chunks.size()-1;
+  vector<size_t> first_vertex(Nc);
+  vector<size_t> first_triangle(Nc);
+#pragma omp parallel for schedule(dynamic, 1)
+  for(long c=0; c<Nc; c++) {
+    size_t vertices = 0, triangles = 0;
+    const char* line_end;
+    for(const char* p = chunks[c]; p < chunks[c+1]; p = line_end + 1) {
+      line_end = p;
+      while(line_end < chunks[c+1] && *line_end != '\n') {
+        line_end++;
+      }
+      p = skipSpace(p, line_end);
+      if(hasKeyword(p, line_end, 'v')) {
+        vertices++;
+      } else if(hasKeyword(p, line_end, 'f')) {
+        size_t corners = 0;
+        for(const char* q = p+1; q < line_end; q++) {
+          corners += !isSpace(*q) && isSpace(q[-1]);
+        }
+        triangles += corners > 2 ? corners-2 : 0;
+      }
+    }
+    first_vertex[c] = vertices;
+    first_triangle[c] = triangles;
+  }
+  const size_t Nv = exclusiveScan(first_vertex);
+  const size_t Nt = exclusiveScan(first_triangle);
+  if(Nv >= 0xffffffffu || 3*Nt >= 0xffffffffu) {
+    throw runtime_error("Too large .obj-data");
+  }
+
+  // Parse the vertices and faces, faces with n corners are split into a fan
+  // of n-2 triangles
+  points.resize(Nv);
+  indices.resize(3*Nt);
+  vector<uint8_t> failed(Nc, 0);
+#pragma omp parallel for schedule(dynamic, 1)
+  for(long c=0; c<Nc; c++) {
+    size_t vertex = first_vertex[c];
+    size_t triangle = first_triangle[c];
+    const char* line_end;
+    for(const char* p = chunks[c]; p < chunks[c+1] && !failed[c]; p = line_end + 1) {
+      line_end = p;
+      while(line_end < chunks[c+1] && *line_end != '\n') {
+        line_end++;
+      }
+      p = skipSpace(p, line_end);
+      if(hasKeyword(p, line_end, 'v')) {
+        const char* q = p+1;
+        for(int i=0; i<3 && q != NULL; i++) {
+          q = parseFloat(skipSpace(q, line_end), line_end, points[vertex][i]);
+        }
+        failed[c] = q == NULL;
+        vertex++;
+      } else if(hasKeyword(p, line_end, 'f')) {
+        // Corners are v, v/vt, v//vn or v/vt/vn, only v is used. Indices
+        // start at 1, and negative indices count back from the last vertex.
+        uint32_t corner_first = 0, corner_prev = 0;
+        int corners = 0;
+        for(const char* q = skipSpace(p+1, line_end); q < line_end; q = skipSpace(q, line_end)) {
+          long ix = 0;
+          q = parseInt(q, line_end, ix);
+          if(q == NULL || ix == 0 || (ix > 0 && size_t(ix) > Nv) || (ix < 0 && size_t(-ix) > vertex)) {
+            failed[c] = 1;
+            break;
+          }
+          while(q < line_end && !isSpace(*q)) {
+            q++;
+          }
+          const uint32_t corner = ix > 0 ? ix-1 : vertex + ix;
+          if(corners == 0) {
+            corner_first = corner;
+          } else if(corners >= 2) {
+            indices[3*triangle+0] = corner_first;
+            indices[3*triangle+1] = corner_prev;
+            indices[3*triangle+2] = corner;
+            triangle++;
+          }
+          corner_prev = corner;
+          corners++;
+        }
+      }
+    }
+  }
+  for(long c=0; c<Nc; c++) {
+    if(failed[c]) {
+      throw runtime_error("Invalid vertex or face in .obj-data");
+    }
+  }
+}
+
+void parseTextMesh(const string& filename, vector<glm::vec3>& points, vector<uint32_t>& indices) {
+  const MappedFile file(filename);
+  const char* begin = file.m_data_;
+  const char* end = begin + file.m_size_;
+  const string extension = filename.size() >= 4 ? filename.substr(filename.size()-4) : "";
+  try {
+    if(extension == ".obj" || extension == ".OBJ") {
+      parseObj(begin, end, points, indices);
+    } else {
+      parseMsh(begin, end, points, indices);
+    }
+  } catch(runtime_error& e) {
+    throw runtime_error(string(e.what()) + " in " + filename);
+  }
+}
+
+}  // GfxUtil
@@ -0,0 +1,49 @@
+/* TextMeshParser.hpp
+ *
+ * Distributed under the GNU GPL.
+ */
+
+#ifndef GFXUTIL_TEXTMESHPARSER_H
+#define GFXUTIL_TEXTMESHPARSER_H
+
+#include <vector>
+#include <string>
+#include <stdint.h>
+#include <glm/glm.hpp>
+
+namespace GfxUtil {
+
+/** Reads the nodes and triangles of an ASCII mesh file, a .msh-file or a
+ *  Wavefront .obj-file depending on the extension.
+ *
+ *  The file is mapped into memory and split into chunks of about a
+ *  megabyte, which are parsed in parallel with OpenMP: a first pass counts
+ *  the numbers (or the vertices and faces) of each chunk, a prefix sum gives
+ *  where each chunk writes its values, and a second pass parses the chunks
+ *  straight into the output arrays. Numbers are parsed by hand instead of
+ *  with iostreams, so loading is limited by the disk rather than the CPU.
+ *
+ *  Throws std::runtime_error if the file cannot be read or parsed.
+ */
+void parseTextMesh(const std::string& filename, std::vector<glm::vec3>& points,
+                   std::vector<uint32_t>& indices);
+
+/** Parses the contents of a .msh-file: the number of nodes and triangles,
+ *  the coordinates of each node and the node indices of each triangle. */
+void parseMsh(const char* begin, const char* end, std::vector<glm::vec3>& points,
+              std::vector<uint32_t>& indices);
+
+/** Parses the contents of an .obj-file. Only the vertex positions (v) and
+ *  faces (f) are used, faces with more than three vertices are split into
+ *  fans, and relative (negative) indices are supported. */
+void parseObj(const char* begin, const char* end, std::vector<glm::vec3>& points,
+              std::vector<uint32_t>& indices);
+
+/** Parses a decimal floating point number, like strtof but without locale
+ *  handling. Digits beyond the 19th significant digit are ignored.
+ *  \return The end of the number, or NULL if there is no number at p. */
+const char* parseFloat(const char* p, const char* end, float& value);
+
+}  // GfxUtil
+
+#endif
@@ -11,13 +11,14 @@
 
 #include <vector>
 #include <string>
-#include <GL/glew.h>
 #include <glm/glm.hpp>
 
 #define BUFFER_OFFSET(i) ((char *)NULL + (i))
 
 namespace GfxUtil {
 
+class PackedVertexBuffer;
+
 /** Triangulation data structure using half-edges. */
 class TriMesh {
  public:
@@ -37,7 +38,9 @@ class TriMesh {
   /** Destructor. */
   ~TriMesh();
 
-  /** Reads a mesh from a .msh-file. Call this if you used the default constructor. */
+  /** Reads a mesh from a .msh-file or an .obj-file (see parseTextMesh), or
+   *  from a binary .bmsh-file (see MeshFile). Call this if you used the
+   *  default constructor. */
   void readMesh(const std::string& filename);
 
   /** Returns the minimum x,y,z-values of the vertices. */
@@ -47,13 +50,23 @@ class TriMesh {
   const glm::vec3& getBBoxMax() const { return m_bbox_max; }
 
   /** Finds suitable normal vectors for triangles
-     *  and vertices. */
+     *  and vertices, and uploads them with updateVertexBuffer(). */
   void computeNormals();
 
-  /** Renders the mesh according to the given RenderMode. */
+  /** Renders the mesh according to the given RenderMode. The buffer objects
+   *  are created on the first call, so meshes that are never rendered do not
+   *  need an OpenGL context. */
   void render();
 
-  /** Refines the mesh one step. */
+  /** Uploads the positions and normals of the nodes again, in place, e.g.
+   *  after the normals are recomputed. Does nothing before the first
+   *  render(). */
+  void updateVertexBuffer();
+
+  /** Refines the mesh one step. The refined mesh takes over the vertex
+   *  buffer of this mesh, and streams its vertices into it when it is first
+   *  rendered, as it usually replaces this mesh. The buffers of this mesh
+   *  are created again if it is rendered again. */
   TriMesh* subdivide();
 
  protected:
@@ -77,7 +90,11 @@ class TriMesh {
   TriMesh* subdivideSqrt3();
   
   /** Prepares VBO and EBO for drawing */
-  void prepareBufferObjects(const std::vector<int>& indices);
+  void prepareBufferObjects();
+
+  /** Deletes the VBO and EBO, if they were created. Needs OpenGL only
+   *  after render(). */
+  void releaseBufferObjects();
   
   glm::vec3              m_bbox_min;   /// Minimum values of bounding box.
   glm::vec3              m_bbox_max;   /// Maximum values of bounding box.
@@ -86,8 +103,8 @@ class TriMesh {
   std::vector<Triangle*> m_triangles;  /// The triangles of this mesh.
   std::vector<HalfEdge*> m_halfedges;  /// The half-edges of this mesh.
   
-  GLuint                 m_vertices_vbo_id;  /// Vertex buffer object id
-  GLuint                 m_indices_vbo_id;   /// Element buffer object id
+  PackedVertexBuffer*    m_vertex_buffer;    /// Packed positions and normals, or NULL
+  unsigned int           m_indices_vbo_id;   /// Element buffer object id
 };
 
 
@@ -0,0 +1,70 @@
+/* WorkerPool.cpp
+ *
+ * Distributed under the GNU GPL.
+ */
+
+#include "WorkerPool.hpp"
+
+#include <thread>
+#include <mutex>
+#include <functional>
+
+namespace GfxUtil {
+
+WorkerPool::WorkerPool(size_t num_threads)
+    : m_running(0), m_quit(false) {
+  if(num_threads == 0) {
+    const size_t cores = std::thread::hardware_concurrency();
+    num_threads = cores > 1 ? cores-1 : 1;
+  }
+  for(size_t i=0; i<num_threads; i++) {
+    m_threads.push_back(std::thread(&WorkerPool::run, this));
+  }
+}
+
+WorkerPool::~WorkerPool() {
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_quit = true;
+    m_jobs.clear();
+  }
+  m_condition.notify_all();
+  for(size_t i=0; i<m_threads.size(); i++) {
+    m_threads[i].join();
+  }
+}
+
+void WorkerPool::submit(const std::function<void()>& job) {
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_jobs.push_back(job);
+  }
+  m_condition.notify_one();
+}
+
+size_t WorkerPool::getNumPending() const {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return m_jobs.size() + m_running;
+}
+
+void WorkerPool::run() {
+  std::unique_lock<std::mutex> lock(m_mutex);
+  while(true) {
+    while(!m_quit && m_jobs.empty()) {
+      m_condition.wait(lock);
+    }
+    if(m_quit) {
+      return;
+    }
+    std::function<void()> job = m_jobs.front();
+    m_jobs.pop_front();
+    m_running++;
+
+    lock.unlock();
+    job();
+    lock.lock();
+    m_running--;
+  }
+}
+
+}  // GfxUtil
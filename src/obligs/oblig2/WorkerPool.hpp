@@ -0,0 +1,62 @@
+/* WorkerPool.hpp
+ *
+ * Distributed under the GNU GPL.
+ */
+
+#ifndef GFXUTIL_WORKERPOOL_H
+#define GFXUTIL_WORKERPOOL_H
+
+#include <deque>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+
+namespace GfxUtil {
+
+/** A fixed set of threads running jobs in the order they are submitted.
+ *
+ *  Jobs that produce results for the render thread should hand them back
+ *  through a LockFreeQueue, so that the render thread polls for them
+ *  instead of waiting on the pool.
+ */
+class WorkerPool {
+ public:
+  /** Constructor, starts the threads.
+   *  \param num_threads Number of threads, or 0 for one less than the
+   *                     number of cores, but at least one. */
+  WorkerPool(size_t num_threads = 0);
+
+  /** Destructor, drops the jobs that have not started, and waits for the
+   *  running ones. */
+  ~WorkerPool();
+
+  /** Queues a job. */
+  void submit(const std::function<void()>& job);
+
+  /** Returns the number of jobs queued or running. */
+  size_t getNumPending() const;
+
+  /** Returns the number of threads. */
+  size_t getNumThreads() const { return m_threads.size(); }
+
+ protected:
+  /** Body of each thread. */
+  void run();
+
+  std::vector<std::thread>           m_threads;    /// The threads.
+  std::deque<std::function<void()> > m_jobs;       /// Jobs not started yet.
+  size_t                             m_running;    /// Number of jobs running.
+  bool                               m_quit;       /// Tells the threads to stop.
+  mutable std::mutex                 m_mutex;      /// Guards m_jobs, m_running and m_quit.
+  std::condition_variable            m_condition;  /// Signals new jobs and m_quit.
+
+ private:
+  WorkerPool(const WorkerPool&);
+  WorkerPool& operator=(const WorkerPool&);
+};
+
+}  // GfxUtil
+
+#endif
@@ -0,0 +1,147 @@
+/* meshtool.cpp
+ *
+ * Distributed under the GNU GPL.
+ */
+
+#include <iostream>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <stdexcept>
+
+#include "../CompactTriMesh.hpp"
+#include "../MeshFile.hpp"
+#include "../MeshOptimizer.hpp"
+#include "../MeshDecimator.hpp"
+#include "../StreamingSubdivider.hpp"
+
+using GfxUtil::CompactTriMesh;
+
+/**
+ * Processes meshes in batch jobs, without OpenGL.
+ *
+ * Usage: meshtool [-subdivide levels] [-sqrt3 levels] [-decimate triangles] [-optimize]
+ *                 [-stream levels] input.msh output.bmsh
+ *
+ * The mesh is read, processed by the given operations in order, and
+ * written. The formats are given by the extensions: ASCII .msh-files,
+ * Wavefront .obj-files (input only), binary .bmsh-files and compressed
+ * .cmsh-files. The connectivity is built once and stored in .bmsh-files, so
+ * that loading them only maps the file and copies the arrays, and it is
+ * decoded from .cmsh-files, which are much smaller.
+ *
+ * -subdivide levels  Refines the mesh with Loop-subdivision.
+ * -sqrt3 levels      Refines the mesh with sqrt(3)-subdivision, in place.
+ * -decimate triangles
+ *                    Simplifies the mesh to at most the given number of
+ *                    triangles with quadric error edge collapses, keeping
+ *                    the boundary.
+ * -optimize          Reorders the triangles for the vertex cache and for
+ *                    less overdraw, renumbers the nodes in the order they
+ *                    are used, and prints the vertex cache statistics
+ *                    before and after.
+ * -stream levels     Refines the mesh with Loop-subdivision patch by patch,
+ *                    and streams it to the output, which must be a .bmsh-
+ *                    file, so the refined mesh need not fit in memory. Must
+ *                    be the last operation.
+ *
+ * Build from this directory with
+ *   g++ -O2 -fopenmp -I.. meshtool.cpp ../CompactTriMesh.cpp ../CompactTriMeshLoop.cpp \
+ *       ../CompactTriMeshSqrt3.cpp ../MeshFile.cpp ../CompressedMeshFile.cpp ../TextMeshParser.cpp \
+ *       ../MeshOptimizer.cpp ../MeshDecimator.cpp ../StreamingSubdivider.cpp -o meshtool
+ */
+
+static void printStatistics(const std::string& label, const CompactTriMesh& mesh) {
+  const GfxUtil::VertexCacheStatistics statistics =
+      GfxUtil::analyzeVertexCache(mesh.getIndices(), mesh.getNumNodes());
+  std::cout << label << ": ACMR " << statistics.m_acmr_
+            << ", ATVR " << statistics.m_atvr_ << std::endl;
+}
+
+static CompactTriMesh optimize(const CompactTriMesh& mesh) {
+  std::vector<glm::vec3> positions(mesh.getPositions());
+  std::vector<uint32_t> indices(mesh.getIndices());
+  std::vector<uint32_t> clusters, remap;
+  GfxUtil::optimizeVertexCache(indices, positions.size(), 16, &clusters);
+  GfxUtil::optimizeOverdraw(indices, positions, clusters);
+  GfxUtil::optimizeVertexFetch(indices, positions.size(), remap);
+  GfxUtil::remapVertices(positions, remap);
+  return CompactTriMesh(positions, indices);
+}
+
+static void printUsage(const char* program) {
+  std::cout << "Usage: " << program
+            << " [-subdivide levels] [-sqrt3 levels] [-decimate triangles] [-optimize]"
+            << " [-stream levels] input.msh output.bmsh"
+            << std::endl;
+}
+
+int main(int argc, char *argv[]) {
+  if(argc < 3) {
+    printUsage(argv[0]);
+    return -1;
+  }
+  const std::string input = argv[argc-2];
+  const std::string output = argv[argc-1];
+  for(int i=1; i<argc-2; i++) {
+    const std::string option = argv[i];
+    if((option == "-subdivide" || option == "-sqrt3" || option == "-decimate") && i+1 < argc-2) {
+      i++;
+    } else if(option == "-stream" && i+1 == argc-3) {
+      if(!GfxUtil::MeshFile::isMeshFile(output)) {
+        std::cerr << "-stream writes .bmsh-files only: " << output << std::endl;
+        return -1;
+      }
+      i++;
+    } else if(option != "-optimize") {
+      printUsage(argv[0]);
+      return -1;
+    }
+  }
+
+  try {
+    CompactTriMesh mesh(input);
+    for(int i=1; i<argc-2; i++) {
+      const std::string option = argv[i];
+      if(option == "-subdivide") {
+        const int levels = std::atoi(argv[++i]);
+        for(int level=0; level<levels; level++) {
+          CompactTriMesh* refined = mesh.subdivideLoop();
+          mesh = *refined;
+          delete refined;
+        }
+      } else if(option == "-sqrt3") {
+        const int levels = std::atoi(argv[++i]);
+        for(int level=0; level<levels; level++) {
+          mesh.subdivideSqrt3();
+        }
+      } else if(option == "-decimate") {
+        const size_t triangles = std::strtoul(argv[++i], NULL, 10);
+        GfxUtil::MeshDecimator decimator(mesh);
+        decimator.decimate(triangles);
+        CompactTriMesh* decimated = decimator.extractMesh();
+        mesh = *decimated;
+        delete decimated;
+      } else if(option == "-optimize") {
+        printStatistics("before", mesh);
+        mesh = optimize(mesh);
+        printStatistics("after", mesh);
+      } else if(option == "-stream") {
+        const int levels = std::atoi(argv[++i]);
+        GfxUtil::StreamingSubdivider subdivider(mesh);
+        subdivider.subdivide(levels, output);
+        std::cout << output << ": streamed in " << subdivider.getNumPatches() << " patches, "
+                  << subdivider.getMaxRefinedTriangles() << " triangles at most in memory"
+                  << std::endl;
+        return 0;
+      }
+    }
+    mesh.writeMesh(output);
+    std::cout << output << ": " << mesh.getNumNodes() << " nodes, "
+              << mesh.getNumTriangles() << " triangles" << std::endl;
+  } catch(std::exception& e) {
+    std::cerr << e.what() << std::endl;
+    return -1;
+  }
+  return 0;
+}